@@ -110,4 +110,124 @@ TEST(SlotMapTest, BasicIterators3)
     }
     EXPECT_EQ(sum, 10);
     EXPECT_EQ(numSteps, 4);
-}
\ No newline at end of file
+}
+TEST(SlotMapTest, IteratorsSkipTombstones)
+{
+    dod::slot_map32<int, 128, 0> slotMap;
+
+    // deactivate the first page entirely
+    for (size_t i = 0; i < static_cast<size_t>(decltype(slotMap)::kPageSize); i++)
+    {
+        for (size_t j = 0; j < static_cast<size_t>(decltype(slotMap)::key::kMaxVersion) + 1; j++)
+        {
+            slotMap.erase(slotMap.emplace(-1));
+        }
+    }
+    EXPECT_EQ(slotMap.debug_stats().numInactivePages, 1u);
+
+    std::vector<decltype(slotMap)::key> keys;
+    for (int i = 0; i < 2000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+
+    // ~70% tombstones plus a few fully tombstoned pages
+    std::unordered_map<decltype(slotMap)::key, int> expected;
+    for (int i = 0; i < int(keys.size()); i++)
+    {
+        bool isEmptyPageRange = (i >= 256 && i < 640);
+        if (isEmptyPageRange || (i % 10) < 7)
+        {
+            slotMap.erase(keys[size_t(i)]);
+        }
+        else
+        {
+            expected[keys[size_t(i)]] = i;
+        }
+    }
+    EXPECT_EQ(size_t(slotMap.size()), expected.size());
+
+    size_t numValues = 0;
+    for (const int& value : slotMap)
+    {
+        ASSERT_TRUE(value >= 0 && value < int(keys.size()));
+        EXPECT_EQ(*slotMap.get(keys[size_t(value)]), value);
+        numValues++;
+    }
+    EXPECT_EQ(numValues, expected.size());
+
+    size_t numItems = 0;
+    for (const auto& [k, v] : slotMap.items())
+    {
+        auto it = expected.find(k);
+        ASSERT_NE(it, expected.end());
+        EXPECT_EQ(it->second, v.get());
+        numItems++;
+    }
+    EXPECT_EQ(numItems, expected.size());
+
+    for (const auto& kv : expected)
+    {
+        slotMap.erase(kv.first);
+    }
+    EXPECT_EQ(slotMap.begin(), slotMap.end());
+    EXPECT_EQ(slotMap.items().begin(), slotMap.items().end());
+}
+
+TEST(SlotMapTest, ChunkVisitor)
+{
+    dod::slot_map<float, dod::slot_map_key64<float>, 256> slotMap;
+    std::vector<decltype(slotMap)::key> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(float(i)));
+    }
+    for (size_t i = 0; i < keys.size(); i += 3)
+    {
+        slotMap.erase(keys[i]);
+    }
+
+    // branch-free masked update over whole chunks
+    size_t numChunks = 0;
+    slotMap.for_each_chunk(
+        [&](std::span<float> values, std::span<const uint64_t> aliveMask, uint32_t baseIndex)
+        {
+            EXPECT_EQ(baseIndex % decltype(slotMap)::kPageSize, 0u);
+            EXPECT_EQ(aliveMask.size(), (values.size() + 63) / 64);
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                float mask = float((aliveMask[i / 64] >> (i % 64)) & 1);
+                values[i] = values[i] * (1.0f + mask);
+            }
+            numChunks++;
+        });
+    EXPECT_EQ(numChunks, 4u);
+
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        const float* v = slotMap.get(keys[i]);
+        if ((i % 3) == 0)
+        {
+            EXPECT_EQ(v, nullptr);
+            continue;
+        }
+        ASSERT_NE(v, nullptr);
+        EXPECT_EQ(*v, float(i) * 2.0f);
+    }
+
+    const auto& constSlotMap = slotMap;
+    size_t numAlive = 0;
+    constSlotMap.for_each_chunk(
+        [&](std::span<const float> values, std::span<const uint64_t> aliveMask, uint32_t baseIndex)
+        {
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                if ((aliveMask[i / 64] >> (i % 64)) & 1)
+                {
+                    EXPECT_EQ(values[i], float(baseIndex + i) * 2.0f);
+                    numAlive++;
+                }
+            }
+        });
+    EXPECT_EQ(numAlive, size_t(slotMap.size()));
+}
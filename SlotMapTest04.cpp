@@ -254,4 +254,144 @@ TEST(SlotMapTest, CompileTimeTypeSafety)
     {
     }
 }
-#endif
\ No newline at end of file
+#endif
+TEST(SlotMapTest, FreeIndicesAging)
+{
+    dod::slot_map<int, dod::slot_map_key64<int>, 4096, 4> slotMap;
+    using key = decltype(slotMap)::key;
+
+    std::vector<key> keys;
+    for (int i = 0; i < 8; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+
+    // with only kMinFreeIndices recycled indices nothing is reused yet
+    for (size_t i = 0; i < 4; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    key k = slotMap.emplace(100);
+    EXPECT_EQ(key::toIndex(k), 8u);
+
+    // once the threshold is exceeded, indices are recycled in FIFO order with a bumped version
+    slotMap.erase(keys[4]);
+    slotMap.erase(k);
+    for (size_t i = 0; i < 2; i++)
+    {
+        key recycled = slotMap.emplace(200 + int(i));
+        EXPECT_EQ(key::toIndex(recycled), key::toIndex(keys[i]));
+        EXPECT_EQ(key::toVersion(recycled), key::toVersion(keys[i]) + 1);
+        EXPECT_FALSE(slotMap.has_key(keys[i]));
+    }
+
+    // long erase/emplace churn (the queue wraps around and grows)
+    std::vector<key> live;
+    for (int iter = 0; iter < 10000; iter++)
+    {
+        live.emplace_back(slotMap.emplace(iter));
+        if ((iter % 3) != 0)
+        {
+            slotMap.erase(live[live.size() / 2]);
+            live.erase(live.begin() + std::ptrdiff_t(live.size() / 2));
+        }
+    }
+    for (const key& lk : live)
+    {
+        EXPECT_TRUE(slotMap.has_key(lk));
+    }
+    EXPECT_EQ(size_t(slotMap.size()), live.size() + 5u);
+}
+
+TEST(SlotMapTest, DeactivatedSlotRejectsLastKey)
+{
+    dod::slot_map32<int, 16, 0> slotMap;
+    using key = dod::slot_map32<int>::key;
+
+    // exhaust the versions of the first slot
+    key lastKey = slotMap.emplace(0);
+    slotMap.emplace(1);
+    for (uint32_t i = key::kMinVersion; i < key::kMaxVersion; i++)
+    {
+        slotMap.erase(lastKey);
+        lastKey = slotMap.emplace(int(i));
+        EXPECT_EQ(key::toIndex(lastKey), 0u);
+    }
+    EXPECT_EQ(key::toVersion(lastKey), key::kMaxVersion);
+    EXPECT_TRUE(slotMap.has_key(lastKey));
+
+    // the slot is deactivated, but the key with the max version must not resolve to it
+    slotMap.erase(lastKey);
+    EXPECT_EQ(slotMap.debug_stats().numInactiveItems, 1u);
+    EXPECT_FALSE(slotMap.has_key(lastKey));
+    EXPECT_EQ(slotMap.get(lastKey), nullptr);
+    std::vector<key> keys = {lastKey};
+    bool found[1] = {true};
+    EXPECT_EQ(slotMap.has_key_many(keys, found), 0u);
+
+    key k = slotMap.emplace(42);
+    EXPECT_NE(key::toIndex(k), 0u);
+}
+
+TEST(SlotMapTest, CustomKeyLayout)
+{
+    // the predefined keys keep their layouts
+    using key64 = dod::slot_map_key64<int>;
+    using key32 = dod::slot_map_key32<int>;
+    using key16 = dod::slot_map_key16<int>;
+    static_assert(sizeof(key64) == 8 && sizeof(key32) == 4 && sizeof(key16) == 2);
+    static_assert(std::is_same_v<key32::version_t, uint16_t> && std::is_same_v<key16::version_t, uint8_t>);
+    EXPECT_EQ(key64::make(5, 7).raw, (5ull << 32) | 7ull);
+    EXPECT_EQ(key32::make(5, 7).raw, (5u << 20) | 7u);
+    EXPECT_EQ(key64::kMaxVersion, 0xfffffu);
+    EXPECT_EQ(key32::kMaxIndex, 0xfffffu);
+
+    // more version headroom for a 32-bit key: 16 index bits, 14 version bits, 2 tag bits
+    using custom = dod::slot_map_key<int, 16, 14, 2>;
+    static_assert(sizeof(custom) == 4);
+    EXPECT_EQ(custom::kMaxIndex, 0xffffu);
+    EXPECT_EQ(custom::kMaxVersion, 0x3fffu);
+    custom k = custom::make(custom::kMaxVersion, custom::kMaxIndex);
+    k.set_tag(custom::kMaxTag);
+    EXPECT_EQ(custom::toIndex(k), custom::kMaxIndex);
+    EXPECT_EQ(custom::toVersion(k), custom::kMaxVersion);
+    EXPECT_EQ(k.get_tag(), custom::kMaxTag);
+    k = custom::clearTagAndUpdateVersion(k, 3);
+    EXPECT_EQ(k.get_tag(), 0u);
+    EXPECT_EQ(custom::toVersion(k), 3u);
+    EXPECT_EQ(custom::toIndex(k), custom::kMaxIndex);
+
+    // 16-bit keys: twice as many handles per cache line
+    dod::slot_map<int, key16, 64> slotMap;
+    std::unordered_map<key16, int> lookup;
+    for (int i = 0; i <= int(key16::kMaxIndex); i++)
+    {
+        key16 newKey = slotMap.emplace(i);
+        EXPECT_EQ(key16::toIndex(newKey), uint32_t(i));
+        lookup[newKey] = i;
+    }
+    EXPECT_EQ(lookup.size(), size_t(key16::kMaxIndex) + 1);
+    EXPECT_THROW(slotMap.emplace(-1), std::length_error);
+    EXPECT_EQ(slotMap.size(), key16::kMaxIndex + 1);
+    for (const auto& [lk, value] : lookup)
+    {
+        EXPECT_EQ(*slotMap.get(lk), value);
+    }
+
+    // erased indices are recycled with a bumped version
+    key16 first = lookup.begin()->first;
+    slotMap.erase(first);
+    EXPECT_FALSE(slotMap.has_key(first));
+    for (const auto& [lk, value] : lookup)
+    {
+        if (!(lk == first))
+        {
+            slotMap.erase(lk);
+        }
+    }
+    EXPECT_EQ(slotMap.size(), 0u);
+    key16 recycled = slotMap.emplace(1);
+    EXPECT_EQ(key16::toVersion(recycled), key16::kMinVersion + 1);
+    EXPECT_FALSE(slotMap.has_key(first));
+    EXPECT_TRUE(slotMap.has_key(recycled));
+}
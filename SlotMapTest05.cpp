@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <random>
+#include <slot_map.h>
+
+TEST(SlotMapTest, BatchedLookup)
+{
+    dod::slot_map<int, dod::slot_map_key64<int>, 64, 0> slotMap;
+    using key = decltype(slotMap)::key;
+
+    std::vector<key> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+
+    // erased keys, recycled slots, out of bounds and malformed keys should all be rejected
+    for (size_t i = 0; i < keys.size(); i += 3)
+    {
+        slotMap.erase(keys[i]);
+    }
+    for (int i = 0; i < 100; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i + 5000));
+    }
+    keys.emplace_back(key::invalid());
+    keys.emplace_back(key::make(1, 100000));
+    keys.emplace_back(key{0xffffffffffffffffull});
+
+    std::vector<int*> values(keys.size(), nullptr);
+    uint32_t numExpected = 0;
+    for (const key& k : keys)
+    {
+        numExpected += slotMap.has_key(k) ? 1 : 0;
+    }
+
+    EXPECT_EQ(slotMap.get_many(keys, values), numExpected);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        EXPECT_EQ(values[i], slotMap.get(keys[i]));
+    }
+
+    const auto& constSlotMap = slotMap;
+    std::vector<const int*> constValues(keys.size(), nullptr);
+    EXPECT_EQ(constSlotMap.get_many(keys, constValues), numExpected);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        EXPECT_EQ(constValues[i], constSlotMap.get(keys[i]));
+    }
+
+    std::unique_ptr<bool[]> has(new bool[keys.size()]);
+    EXPECT_EQ(slotMap.has_key_many(keys, std::span<bool>(has.get(), keys.size())), numExpected);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        EXPECT_EQ(has[i], slotMap.has_key(keys[i]));
+    }
+
+    // empty input and empty map
+    EXPECT_EQ(slotMap.get_many(std::span<const key>(), std::span<int*>()), 0u);
+    dod::slot_map<int> emptyMap;
+    std::vector<int*> emptyValues(keys.size(), nullptr);
+    EXPECT_EQ(emptyMap.get_many(keys, emptyValues), 0u);
+}
+
+TEST(SlotMapTest, BatchedLookupThroughput_Slow)
+{
+    static const size_t kNumElements = 16 * 1024 * 1024;
+    static const size_t kNumLookups = 4 * 1024 * 1024;
+
+    dod::slot_map<uint64_t> slotMap;
+    std::vector<dod::slot_map<uint64_t>::key> keys;
+    keys.reserve(kNumElements);
+    for (size_t i = 0; i < kNumElements; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+
+    std::mt19937_64 rng(113);
+    std::vector<dod::slot_map<uint64_t>::key> lookups(kNumLookups);
+    for (auto& k : lookups)
+    {
+        k = keys[rng() % keys.size()];
+    }
+
+    // both sides do the same work: look up every key, load its value and feed it to 'work'
+    // get_many is called on small chunks that are consumed right away, so its value prefetches are still in the cache when used
+    static const size_t kChunkSize = 256;
+    auto measure = [&](const char* name, auto work)
+    {
+        using clock = std::chrono::steady_clock;
+        uint64_t sumScalar = 0;
+        auto t0 = clock::now();
+        for (const auto& k : lookups)
+        {
+            sumScalar += work(*slotMap.get(k));
+        }
+        auto t1 = clock::now();
+
+        uint64_t sumBatched = 0;
+        size_t numFound = 0;
+        uint64_t* values[kChunkSize];
+        for (size_t first = 0; first < kNumLookups; first += kChunkSize)
+        {
+            std::span<const dod::slot_map<uint64_t>::key> chunk(lookups.data() + first, std::min(kChunkSize, kNumLookups - first));
+            numFound += slotMap.get_many(chunk, values);
+            for (size_t i = 0; i < chunk.size(); i++)
+            {
+                sumBatched += work(*values[i]);
+            }
+        }
+        auto t2 = clock::now();
+
+        EXPECT_EQ(numFound, kNumLookups);
+        EXPECT_EQ(sumScalar, sumBatched);
+        printf("%s: get() loop %3.2f ms, chunked get_many() %3.2f ms\n", name, std::chrono::duration<double, std::milli>(t1 - t0).count(),
+               std::chrono::duration<double, std::milli>(t2 - t1).count());
+    };
+
+    measure("load only", [](uint64_t v) { return v; });
+    measure("load + hash", [](uint64_t v)
+            {
+                for (int round = 0; round < 6; round++)
+                {
+                    v ^= v >> 29;
+                    v *= 0xbf58476d1ce4e5b9ull;
+                }
+                return v;
+            });
+}
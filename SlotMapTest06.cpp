@@ -0,0 +1,248 @@
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <slot_map.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+TEST(SlotMapTest, ParallelForEach)
+{
+    dod::slot_map<int, dod::slot_map_key64<int>, 64> slotMap;
+    std::vector<decltype(slotMap)::key> keys;
+    for (int i = 0; i < 5000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+    // uneven tombstone density across pages
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if ((i < 2000 && (i % 7) != 0) || (i >= 3000 && i < 3500))
+        {
+            slotMap.erase(keys[i]);
+        }
+    }
+
+    for (unsigned numThreads : {0u, 1u, 3u, 8u, 200u})
+    {
+        std::vector<std::atomic<int>> visits(keys.size());
+        slotMap.parallel_for_each([&](int& value) { visits[size_t(value)]++; }, numThreads);
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            ASSERT_EQ(visits[i].load(), slotMap.has_key(keys[i]) ? 1 : 0);
+        }
+
+        std::atomic<uint32_t> numItems(0);
+        const auto& constSlotMap = slotMap;
+        constSlotMap.parallel_items(
+            [&](decltype(slotMap)::key k, const int& value)
+            {
+                EXPECT_EQ(k, keys[size_t(value)]);
+                numItems++;
+            },
+            numThreads);
+        EXPECT_EQ(numItems.load(), slotMap.size());
+    }
+
+    slotMap.parallel_items([](decltype(slotMap)::key, int& value) { value = -value; }, 4);
+    for (const int& value : slotMap)
+    {
+        EXPECT_LE(value, 0);
+    }
+
+    // an exception stops the traversal and is rethrown on the calling thread once all the workers are joined
+    for (unsigned numThreads : {1u, 4u})
+    {
+        std::atomic<int> numVisited(0);
+        EXPECT_THROW(slotMap.parallel_for_each(
+                         [&](int& value)
+                         {
+                             numVisited++;
+                             if (value == -2500)
+                             {
+                                 throw std::runtime_error("visit failed");
+                             }
+                         },
+                         numThreads),
+                     std::runtime_error);
+        EXPECT_LE(numVisited.load(), int(slotMap.size()));
+    }
+    EXPECT_EQ(*slotMap.get(keys[2500]), -2500);
+
+    dod::slot_map<int> emptyMap;
+    emptyMap.parallel_for_each([](int&) { FAIL(); }, 4);
+}
+
+TEST(SlotMapTest, ParallelForEachScaling_Slow)
+{
+    static const size_t kNumElements = 20 * 1024 * 1024;
+    dod::slot_map<float> slotMap;
+    std::vector<dod::slot_map<float>::key> keys;
+    keys.reserve(kNumElements);
+    for (size_t i = 0; i < kNumElements; i++)
+    {
+        keys.emplace_back(slotMap.emplace(float(i % 1024)));
+    }
+    // uneven work per page
+    for (size_t i = 0; i < kNumElements / 2; i++)
+    {
+        if ((i % 3) != 0)
+        {
+            slotMap.erase(keys[i]);
+        }
+    }
+
+    auto run = [&](unsigned numThreads)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        slotMap.parallel_for_each([](float& v) { v = v * 0.5f + 1.0f; }, numThreads);
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    };
+
+    unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    double singleThreaded = run(1);
+    for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        double ms = run(numThreads);
+        printf("threads: %3u, %8.2f ms, speedup: %5.2fx\n", numThreads, ms, singleThreaded / ms);
+    }
+}
+
+struct ThrowingCopy
+{
+    static inline std::atomic<int> numAlive{0};
+    static inline std::atomic<int> copiesUntilThrow{-1};
+
+    explicit ThrowingCopy(int _value)
+        : value(_value)
+    {
+        numAlive++;
+    }
+    ThrowingCopy(const ThrowingCopy& other)
+        : value(other.value)
+    {
+        if (copiesUntilThrow.fetch_sub(1) == 0)
+        {
+            throw std::runtime_error("copy failed");
+        }
+        numAlive++;
+    }
+    ~ThrowingCopy() { numAlive--; }
+
+    int value;
+};
+
+template <typename TSlotMap, typename MAKE> static void checkParallelCopy(MAKE&& makeValue)
+{
+    TSlotMap slotMap;
+    slotMap.set_release_empty_pages(true);
+    std::vector<typename TSlotMap::key> keys;
+    for (int i = 0; i < 5000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(makeValue(i)));
+    }
+    // released pages, empty pages and pages with tombstones
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if ((i >= 640 && i < 1280) || (i % 3) == 0)
+        {
+            slotMap.erase(keys[i]);
+        }
+    }
+
+    for (unsigned numThreads : {0u, 1u, 3u, 200u})
+    {
+        TSlotMap copy;
+        copy.emplace(makeValue(-1));
+        copy.copy_from(slotMap, numThreads);
+        EXPECT_EQ(copy.size(), slotMap.size());
+        EXPECT_EQ(copy.debug_stats().numReleasedPages, slotMap.debug_stats().numReleasedPages);
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            ASSERT_EQ(copy.has_key(keys[i]), slotMap.has_key(keys[i]));
+            if (slotMap.has_key(keys[i]))
+            {
+                EXPECT_TRUE(*copy.get(keys[i]) == makeValue(int(i)));
+            }
+        }
+        // both maps keep working on their own
+        auto k = copy.emplace(makeValue(7));
+        EXPECT_TRUE(*copy.get(k) == makeValue(7));
+        copy.copy_from(copy, numThreads);
+        EXPECT_EQ(copy.size(), slotMap.size() + 1);
+    }
+
+    // the free queue is copied: the copy reuses the same tombstones and hands out the same keys
+    TSlotMap copy(slotMap);
+    for (int i = 0; i < 3000; i++)
+    {
+        ASSERT_EQ(copy.emplace(makeValue(i)), slotMap.emplace(makeValue(i)));
+    }
+    EXPECT_EQ(copy.debug_stats().numPagesTotal, slotMap.debug_stats().numPagesTotal);
+}
+
+TEST(SlotMapTest, ParallelCopy)
+{
+    checkParallelCopy<dod::slot_map<int, dod::slot_map_key64<int>, 64>>([](int i) { return i; });
+    checkParallelCopy<dod::slot_map<std::string, dod::slot_map_key64<std::string>, 64>>(
+        [](int i) { return std::string(40, 'x') + std::to_string(i); });
+    checkParallelCopy<dod::interleaved_slot_map<int, dod::slot_map_key64<int>, 64>>([](int i) { return i; });
+    checkParallelCopy<dod::interleaved_slot_map<std::string, dod::slot_map_key64<std::string>, 64>>(
+        [](int i) { return std::to_string(i); });
+
+    // a throwing copy constructor leaves an empty map behind
+    {
+        dod::slot_map<ThrowingCopy, dod::slot_map_key64<ThrowingCopy>, 64> slotMap;
+        for (int i = 0; i < 5000; i++)
+        {
+            slotMap.emplace(i);
+        }
+        for (unsigned numThreads : {1u, 4u})
+        {
+            decltype(slotMap) copy;
+            copy.emplace(-1);
+            ThrowingCopy::copiesUntilThrow = 3000;
+            EXPECT_THROW(copy.copy_from(slotMap, numThreads), std::runtime_error);
+            ThrowingCopy::copiesUntilThrow = -1000000;
+            EXPECT_TRUE(copy.empty());
+            EXPECT_EQ(ThrowingCopy::numAlive.load(), 5000);
+            copy.emplace(1);
+            EXPECT_EQ(copy.size(), 1u);
+        }
+    }
+    EXPECT_EQ(ThrowingCopy::numAlive.load(), 0);
+}
+
+TEST(SlotMapTest, ParallelCopyScaling_Slow)
+{
+    static const size_t kNumElements = 5 * 1000 * 1000;
+    dod::slot_map<std::string> slotMap;
+    std::vector<dod::slot_map<std::string>::key> keys;
+    keys.reserve(kNumElements);
+    for (size_t i = 0; i < kNumElements; i++)
+    {
+        keys.emplace_back(slotMap.emplace(std::string(40, 'x')));
+    }
+    for (size_t i = 0; i < kNumElements; i += 4)
+    {
+        slotMap.erase(keys[i]);
+    }
+
+    auto run = [&](unsigned numThreads)
+    {
+        dod::slot_map<std::string> copy;
+        auto t0 = std::chrono::steady_clock::now();
+        copy.copy_from(slotMap, numThreads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        EXPECT_EQ(copy.size(), slotMap.size());
+        return ms;
+    };
+
+    unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    double singleThreaded = run(1);
+    for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        double ms = run(numThreads);
+        printf("threads: %3u, copy: %8.2f ms, speedup: %5.2fx\n", numThreads, ms, singleThreaded / ms);
+    }
+}
@@ -0,0 +1,281 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <set>
+#include <slot_map.h>
+#include <unordered_set>
+
+TEST(SlotMapTest, ReserveAndShrinkToFit)
+{
+    dod::slot_map<int, dod::slot_map_key64<int>, 256, 16> slotMap;
+    using key = decltype(slotMap)::key;
+
+    slotMap.reserve(1000);
+    auto stats = slotMap.debug_stats();
+    EXPECT_EQ(stats.numPagesTotal, 0u);
+    EXPECT_EQ(stats.numCachedPages, 4u);
+
+    std::vector<key> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+    stats = slotMap.debug_stats();
+    EXPECT_EQ(stats.numActivePages, 4u);
+    EXPECT_EQ(stats.numCachedPages, 0u);
+
+    // reserve accounts for free space in the last page
+    slotMap.reserve(1024);
+    EXPECT_EQ(slotMap.debug_stats().numCachedPages, 0u);
+    slotMap.reserve(1025);
+    EXPECT_EQ(slotMap.debug_stats().numCachedPages, 1u);
+
+    // only trailing pages without alive elements are released
+    for (size_t i = 300; i < keys.size(); i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    slotMap.erase(keys[10]);
+    slotMap.shrink_to_fit();
+    stats = slotMap.debug_stats();
+    EXPECT_EQ(stats.numCachedPages, 0u);
+    EXPECT_EQ(stats.numActivePages, 2u);
+    EXPECT_EQ(stats.numReleasedPages, 2u);
+    EXPECT_EQ(slotMap.size(), 299u);
+
+    std::unordered_set<key> oldKeys(keys.begin(), keys.end());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        bool isAlive = (i < 300 && i != 10);
+        EXPECT_EQ(slotMap.has_key(keys[i]), isAlive);
+        if (isAlive)
+        {
+            EXPECT_EQ(*slotMap.get(keys[i]), int(i));
+        }
+    }
+
+    int sum = 0;
+    for (const int& v : slotMap)
+    {
+        sum += v;
+    }
+    EXPECT_EQ(sum, 299 * 300 / 2 - 10);
+
+    // released pages are revived before the slot map grows, without key collisions
+    for (int i = 0; i < 1000; i++)
+    {
+        key k = slotMap.emplace(i);
+        EXPECT_EQ(oldKeys.count(k), 0u);
+        EXPECT_TRUE(oldKeys.insert(k).second);
+    }
+    stats = slotMap.debug_stats();
+    EXPECT_EQ(stats.numReleasedPages, 0u);
+    EXPECT_EQ(slotMap.size(), 1299u);
+    for (size_t i = 300; i < keys.size(); i++)
+    {
+        EXPECT_FALSE(slotMap.has_key(keys[i]));
+    }
+
+    // copies keep released pages
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    slotMap.clear();
+    slotMap.shrink_to_fit();
+    EXPECT_EQ(slotMap.debug_stats().numActivePages, 0u);
+    decltype(slotMap) copy = slotMap;
+    EXPECT_EQ(copy.debug_stats().numReleasedPages, slotMap.debug_stats().numReleasedPages);
+    key k = copy.emplace(7);
+    EXPECT_EQ(oldKeys.count(k), 0u);
+    EXPECT_EQ(*copy.get(k), 7);
+}
+
+TEST(SlotMapTest, ReleaseEmptyPages)
+{
+    dod::slot_map<std::string, dod::slot_map_key64<std::string>, 64, 8> slotMap;
+    using key = decltype(slotMap)::key;
+    EXPECT_FALSE(slotMap.release_empty_pages());
+    slotMap.set_release_empty_pages(true);
+
+    std::vector<key> keys;
+    for (int i = 0; i < 640; i++)
+    {
+        keys.emplace_back(slotMap.emplace(std::to_string(i)));
+    }
+
+    // empty two pages in the middle
+    for (size_t i = 128; i < 256; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    auto stats = slotMap.debug_stats();
+    EXPECT_EQ(stats.numReleasedPages, 2u);
+    EXPECT_EQ(stats.numActivePages, 8u);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        bool isAlive = (i < 128 || i >= 256);
+        EXPECT_EQ(slotMap.has_key(keys[i]), isAlive);
+        EXPECT_EQ(slotMap.get(keys[i]) != nullptr, isAlive);
+    }
+    size_t numVisited = 0;
+    for (const auto& [k, value] : slotMap.items())
+    {
+        EXPECT_EQ(value.get(), std::to_string(key::toIndex(k)));
+        numVisited++;
+    }
+    EXPECT_EQ(numVisited, 512u);
+
+    // a partially emptied page is kept
+    for (size_t i = 256; i < 300; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    EXPECT_EQ(slotMap.debug_stats().numReleasedPages, 2u);
+
+    // released pages are reused before the slot map grows
+    std::unordered_set<key> seenKeys(keys.begin(), keys.end());
+    for (int i = 0; i < 150; i++)
+    {
+        key k = slotMap.emplace("new");
+        EXPECT_TRUE(seenKeys.insert(k).second);
+    }
+    stats = slotMap.debug_stats();
+    EXPECT_EQ(stats.numReleasedPages, 0u);
+    EXPECT_EQ(stats.numPagesTotal, 10u);
+    for (size_t i = 128; i < 300; i++)
+    {
+        EXPECT_FALSE(slotMap.has_key(keys[i]));
+    }
+
+    // random churn against a reference
+    std::vector<key> alive;
+    for (const auto& [k, value] : slotMap.items())
+    {
+        alive.emplace_back(k);
+    }
+    uint32_t seed = 1;
+    for (int iter = 0; iter < 20000; iter++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        bool doErase = !alive.empty() && ((seed >> 16) % 100) < uint32_t(iter % 4000 < 2000 ? 70 : 30);
+        if (doErase)
+        {
+            size_t pos = (seed >> 8) % alive.size();
+            slotMap.erase(alive[pos]);
+            alive[pos] = alive.back();
+            alive.pop_back();
+        }
+        else
+        {
+            key k = slotMap.emplace("churn");
+            EXPECT_TRUE(seenKeys.insert(k).second);
+            alive.emplace_back(k);
+        }
+    }
+    EXPECT_EQ(slotMap.size(), alive.size());
+    size_t numAlive = 0;
+    for (const key& k : seenKeys)
+    {
+        numAlive += slotMap.has_key(k) ? 1 : 0;
+    }
+    EXPECT_EQ(numAlive, alive.size());
+
+    slotMap.clear();
+    stats = slotMap.debug_stats();
+    // only a partially used last page can stay
+    EXPECT_LE(stats.numActivePages, 1u);
+    EXPECT_EQ(stats.numReleasedPages + stats.numActivePages, stats.numPagesTotal);
+}
+
+template <typename TSlotMap, typename MAKE> static void checkCompaction(MAKE&& makeValue)
+{
+    using key = typename TSlotMap::key;
+    TSlotMap slotMap;
+
+    // thinly populated pages after a burst of erases
+    std::map<key, int> reference;
+    std::vector<key> erased;
+    uint32_t seed = 7;
+    std::vector<key> keys;
+    for (int i = 0; i < 64 * 40; i++)
+    {
+        keys.emplace_back(slotMap.emplace(makeValue(i)));
+    }
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        if (((seed >> 16) % 100) < 85)
+        {
+            slotMap.erase(keys[i]);
+            erased.emplace_back(keys[i]);
+        }
+        else
+        {
+            reference[keys[i]] = int(i);
+        }
+    }
+    auto before = slotMap.debug_stats();
+
+    // spread over many small steps
+    const uint32_t kBudget = 5;
+    uint32_t numSteps = 0;
+    for (;;)
+    {
+        std::vector<std::pair<key, key>> remap;
+        uint32_t numMoved = slotMap.compact(kBudget, [&](key oldKey, key newKey) { remap.emplace_back(oldKey, newKey); });
+        EXPECT_LE(numMoved, kBudget);
+        EXPECT_EQ(numMoved, remap.size());
+        if (numMoved == 0)
+        {
+            break;
+        }
+        numSteps++;
+        for (const auto& [oldKey, newKey] : remap)
+        {
+            auto it = reference.find(oldKey);
+            ASSERT_NE(it, reference.end());
+            EXPECT_FALSE(slotMap.has_key(oldKey));
+            EXPECT_EQ(reference.count(newKey), 0u);
+            int value = it->second;
+            reference.erase(it);
+            reference[newKey] = value;
+        }
+
+        // the slot map stays fully usable between the steps
+        for (const auto& [k, value] : reference)
+        {
+            ASSERT_TRUE(slotMap.has_key(k));
+            EXPECT_TRUE(*slotMap.get(k) == makeValue(value));
+        }
+    }
+    EXPECT_GT(numSteps, 1u);
+    EXPECT_EQ(slotMap.size(), reference.size());
+    for (const key& k : erased)
+    {
+        EXPECT_FALSE(slotMap.has_key(k));
+    }
+
+    auto after = slotMap.debug_stats();
+    size_t numNeededPages = (reference.size() + 63) / 64;
+    EXPECT_LT(after.numActivePages, before.numActivePages);
+    EXPECT_LE(after.numActivePages, numNeededPages + 1);
+    EXPECT_EQ(after.numReleasedPages + after.numActivePages, after.numPagesTotal);
+
+    // released pages are reused and never hand out old keys
+    std::set<key> oldKeys(erased.begin(), erased.end());
+    for (int i = 0; i < 64 * 10; i++)
+    {
+        key k = slotMap.emplace(makeValue(i));
+        EXPECT_EQ(oldKeys.count(k), 0u);
+        EXPECT_EQ(reference.count(k), 0u);
+    }
+    EXPECT_EQ(slotMap.compact(kBudget, [](key, key) {}), 0u);
+}
+
+TEST(SlotMapTest, Compaction)
+{
+    checkCompaction<dod::slot_map<int, dod::slot_map_key64<int>, 64, 8>>([](int i) { return i; });
+    checkCompaction<dod::slot_map<std::string, dod::slot_map_key32<std::string>, 64, 8>>(
+        [](int i) { return std::string(40, 'x') + std::to_string(i); });
+    checkCompaction<dod::interleaved_slot_map<int64_t, dod::slot_map_key64<int64_t>, 64, 8>>([](int i) { return int64_t(i) << 33; });
+}
@@ -0,0 +1,592 @@
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory_resource>
+#include <random>
+#include <slot_map_vm.h>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+namespace
+{
+// forwards to an upstream resource and tracks the amount of memory in use
+class counting_resource : public std::pmr::memory_resource
+{
+  public:
+    explicit counting_resource(std::pmr::memory_resource* _upstream = std::pmr::new_delete_resource())
+        : upstream(_upstream)
+    {
+    }
+
+    size_t numBytesInUse = 0;
+    size_t numAllocations = 0;
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        numBytesInUse += bytes;
+        numAllocations++;
+        return upstream->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        EXPECT_GE(numBytesInUse, bytes);
+        numBytesInUse -= bytes;
+        upstream->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::pmr::memory_resource* upstream;
+};
+
+// throws std::bad_alloc while isFailing is set or once numAllocationsLeft allocations were made
+class failing_resource : public std::pmr::memory_resource
+{
+  public:
+    bool isFailing = false;
+    size_t numAllocationsLeft = SIZE_MAX;
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        if (isFailing || numAllocationsLeft == 0)
+        {
+            throw std::bad_alloc();
+        }
+        numAllocationsLeft -= (numAllocationsLeft != SIZE_MAX) ? 1 : 0;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+// counts dTLB load misses of the calling thread (where perf events are available)
+class dtlb_miss_counter
+{
+  public:
+    dtlb_miss_counter()
+    {
+#if defined(__linux__)
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+
+    ~dtlb_miss_counter()
+    {
+#if defined(__linux__)
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+#endif
+    }
+
+    bool is_available() const { return fd >= 0; }
+
+    void start()
+    {
+#if defined(__linux__)
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    uint64_t stop()
+    {
+        uint64_t count = 0;
+#if defined(__linux__)
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+            {
+                count = 0;
+            }
+        }
+#endif
+        return count;
+    }
+
+  private:
+    int fd = -1;
+};
+} // namespace
+
+TEST(SlotMapTest, PolymorphicAllocator)
+{
+    counting_resource resource;
+    {
+        dod::pmr::slot_map<std::string, dod::slot_map_key64<std::string>, 64, 8> slotMap(&resource);
+        using key = decltype(slotMap)::key;
+        EXPECT_EQ(slotMap.get_allocator().resource(), &resource);
+
+        std::vector<key> keys;
+        for (int i = 0; i < 1000; i++)
+        {
+            keys.emplace_back(slotMap.emplace(std::to_string(i)));
+        }
+        for (size_t i = 0; i < keys.size(); i += 2)
+        {
+            slotMap.erase(keys[i]);
+        }
+        slotMap.reserve(2000);
+        EXPECT_GT(resource.numBytesInUse, 1000 * sizeof(std::string));
+        size_t numAllocations = resource.numAllocations;
+
+        // copies use the default resource (the same as std::pmr containers)
+        auto copy = slotMap;
+        EXPECT_EQ(copy.get_allocator().resource(), std::pmr::get_default_resource());
+        EXPECT_EQ(resource.numAllocations, numAllocations);
+        EXPECT_EQ(*copy.get(keys[1]), "1");
+
+        // moving between different resources moves the elements
+        decltype(slotMap) other(&resource);
+        other = std::move(copy);
+        EXPECT_EQ(other.get_allocator().resource(), &resource);
+        EXPECT_EQ(other.size(), 500u);
+        EXPECT_TRUE(copy.empty());
+        for (size_t i = 1; i < keys.size(); i += 2)
+        {
+            ASSERT_NE(other.get(keys[i]), nullptr);
+            EXPECT_EQ(*other.get(keys[i]), std::to_string(i));
+        }
+
+        // moving between equal resources takes over the memory
+        numAllocations = resource.numAllocations;
+        decltype(slotMap) moved(std::move(other));
+        decltype(slotMap) moveAssigned(&resource);
+        moveAssigned = std::move(moved);
+        EXPECT_EQ(resource.numAllocations, numAllocations);
+        EXPECT_EQ(*moveAssigned.get(keys[999]), "999");
+
+        slotMap.swap(moveAssigned);
+        EXPECT_EQ(*slotMap.get(keys[1]), "1");
+    }
+    EXPECT_EQ(resource.numBytesInUse, 0u);
+}
+
+TEST(SlotMapTest, MonotonicArena)
+{
+    std::pmr::monotonic_buffer_resource arena;
+    counting_resource resource(&arena);
+    dod::pmr::slot_map<uint64_t> slotMap(&resource);
+    std::vector<dod::pmr::slot_map<uint64_t>::key> keys;
+    for (uint64_t i = 0; i < 20000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        EXPECT_EQ(*slotMap.get(keys[i]), i);
+    }
+    EXPECT_GT(resource.numAllocations, 0u);
+    slotMap.reset();
+    EXPECT_EQ(resource.numBytesInUse, 0u);
+}
+
+TEST(SlotMapTest, AllocationFailure)
+{
+    failing_resource resource;
+    dod::pmr::slot_map<std::string, dod::slot_map_key64<std::string>, 64, 0> slotMap(&resource);
+    using key = decltype(slotMap)::key;
+    slotMap.set_page_cache_capacity(0);
+    slotMap.set_release_empty_pages(true);
+
+    std::vector<key> keys;
+    for (int i = 0; i < 640; i++)
+    {
+        keys.emplace_back(slotMap.emplace(std::to_string(i)));
+    }
+    auto expectUnchanged = [&](size_t numErased)
+    {
+        EXPECT_EQ(slotMap.size(), keys.size() - numErased);
+        EXPECT_EQ(slotMap.debug_stats().numPagesTotal, 10u);
+        for (size_t i = numErased; i < keys.size(); i++)
+        {
+            ASSERT_EQ(*slotMap.get(keys[i]), std::to_string(i));
+        }
+    };
+
+    // a failed page allocation leaves the map as it was
+    resource.isFailing = true;
+    EXPECT_THROW(slotMap.emplace("new page"), std::bad_alloc);
+    EXPECT_THROW(slotMap.emplace("new page"), std::bad_alloc);
+    expectUnchanged(0);
+
+    // the same for a released page that can't be brought back
+    resource.isFailing = false;
+    for (size_t i = 0; i < 64; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    EXPECT_EQ(slotMap.debug_stats().numReleasedPages, 1u);
+    resource.isFailing = true;
+    EXPECT_THROW(slotMap.emplace("revived"), std::bad_alloc);
+    EXPECT_THROW(slotMap.emplace("revived"), std::bad_alloc);
+    EXPECT_EQ(slotMap.debug_stats().numReleasedPages, 1u);
+    expectUnchanged(64);
+
+    resource.isFailing = false;
+    key k = slotMap.emplace("revived");
+    EXPECT_EQ(*slotMap.get(k), "revived");
+    EXPECT_EQ(slotMap.debug_stats().numReleasedPages, 0u);
+    EXPECT_FALSE(slotMap.has_key(keys[0]));
+
+    // a page cache that can't grow frees the block of a released page
+    slotMap.set_page_cache_capacity(16);
+    for (size_t i = 64; i < 127; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    resource.isFailing = true;
+    slotMap.erase(keys[127]);
+    resource.isFailing = false;
+    EXPECT_EQ(slotMap.debug_stats().numReleasedPages, 1u);
+    EXPECT_EQ(slotMap.page_cache_stats().numCachedPages, 0u);
+
+    // a copy that runs out of memory halfway through the pages is left empty and usable
+    failing_resource copyResource;
+    decltype(slotMap) copy(&copyResource);
+    copyResource.numAllocationsLeft = 4;
+    EXPECT_THROW(copy = slotMap, std::bad_alloc);
+    EXPECT_TRUE(copy.empty());
+    EXPECT_EQ(copy.debug_stats().numPagesTotal, 0u);
+    copyResource.numAllocationsLeft = SIZE_MAX;
+    k = copy.emplace("copied");
+    EXPECT_EQ(*copy.get(k), "copied");
+    copy = slotMap;
+    EXPECT_EQ(copy.size(), slotMap.size());
+    EXPECT_EQ(*copy.get(keys[639]), "639");
+}
+
+TEST(SlotMapTest, OverAlignedAllocator)
+{
+    dod::slot_map64<int, 64, 4, stl::Allocator<int, 256>> slotMap;
+    for (int i = 0; i < 300; i++)
+    {
+        auto k = slotMap.emplace(i);
+        if ((i % 64) == 0)
+        {
+            // the first slot of every page is at the start of the page memory block
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(slotMap.get(k)) % 256, 0u);
+        }
+    }
+    EXPECT_EQ(slotMap.size(), 300u);
+}
+
+TEST(SlotMapTest, PageCache)
+{
+    counting_resource resource;
+    dod::pmr::slot_map<int, dod::slot_map_key64<int>, 64, 0> slotMap(&resource);
+    using key = decltype(slotMap)::key;
+    EXPECT_EQ(slotMap.page_cache_capacity(), decltype(slotMap)::kDefaultPageCacheCapacity);
+    slotMap.set_release_empty_pages(true);
+
+    std::vector<key> keys;
+    for (int i = 0; i < 128; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+    auto stats = slotMap.page_cache_stats();
+    EXPECT_EQ(stats.numHits, 0u);
+    EXPECT_EQ(stats.numMisses, 2u);
+
+    // oscillate around a page boundary: the page is released and revived without touching the allocator
+    // (after the first round, which grows the free indices and the bookkeeping)
+    size_t numAllocations = 0;
+    for (int iter = 0; iter < 100; iter++)
+    {
+        if (iter == 1)
+        {
+            numAllocations = resource.numAllocations;
+        }
+        for (size_t i = 64; i < 128; i++)
+        {
+            slotMap.erase(keys[i]);
+        }
+        EXPECT_EQ(slotMap.page_cache_stats().numCachedPages, 1u);
+        for (size_t i = 64; i < 128; i++)
+        {
+            keys[i] = slotMap.emplace(int(i));
+        }
+    }
+    EXPECT_EQ(resource.numAllocations, numAllocations);
+    stats = slotMap.page_cache_stats();
+    EXPECT_EQ(stats.numHits, 100u);
+    EXPECT_EQ(stats.numMisses, 2u);
+    EXPECT_EQ(stats.numCachedPages, 0u);
+
+    // copy assignment draws from the cache
+    decltype(slotMap) copy(&resource);
+    copy.set_page_cache_capacity(4);
+    copy = slotMap;
+    EXPECT_EQ(copy.page_cache_stats().numMisses, 2u);
+    copy.erase(keys[0]);
+    copy = slotMap;
+    EXPECT_EQ(copy.page_cache_stats().numHits, 2u);
+    EXPECT_EQ(copy.page_cache_stats().numMisses, 2u);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        EXPECT_EQ(*copy.get(keys[i]), int(i));
+    }
+
+    // the cache is bounded
+    slotMap.set_page_cache_capacity(0);
+    for (size_t i = 64; i < 128; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    EXPECT_EQ(slotMap.page_cache_stats().numCachedPages, 0u);
+    slotMap.reserve(1000);
+    EXPECT_GT(slotMap.page_cache_stats().numCachedPages, 0u);
+    slotMap.shrink_to_fit();
+    EXPECT_EQ(slotMap.page_cache_stats().numCachedPages, 0u);
+}
+
+TEST(SlotMapTest, HugePageResource)
+{
+    dod::huge_page_resource resource(1);
+    {
+        dod::pmr::slot_map<std::string, dod::slot_map_key64<std::string>, 256> slotMap(&resource);
+        std::vector<decltype(slotMap)::key> keys;
+        for (int i = 0; i < 5000; i++)
+        {
+            keys.emplace_back(slotMap.emplace(std::to_string(i)));
+        }
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            EXPECT_EQ(*slotMap.get(keys[i]), std::to_string(i));
+        }
+
+        auto stats = resource.stats();
+        EXPECT_GE(stats.numRegions, 1u);
+        EXPECT_EQ(stats.numBytesMapped % dod::vm::kHugePageSize, 0u);
+
+        // freed page blocks are reused
+        slotMap.reset();
+        for (int i = 0; i < 5000; i++)
+        {
+            slotMap.emplace("x");
+        }
+        EXPECT_EQ(resource.stats().numRegions, stats.numRegions);
+    }
+
+    // allocations larger than a region get their own mapping
+    void* large = resource.allocate(8 * dod::vm::kHugePageSize, 64);
+    std::memset(large, 0xcd, 8 * dod::vm::kHugePageSize);
+    size_t numRegions = resource.stats().numRegions;
+    resource.deallocate(large, 8 * dod::vm::kHugePageSize, 64);
+    EXPECT_EQ(resource.stats().numRegions, numRegions - 1);
+
+    resource.release();
+    EXPECT_EQ(resource.stats().numRegions, 0u);
+}
+
+TEST(SlotMapTest, HugePageLookup_Slow)
+{
+    static const size_t kNumElements = 16 * 1024 * 1024;
+    static const size_t kNumLookups = 8 * 1024 * 1024;
+
+    std::mt19937_64 rng(7);
+    std::vector<uint32_t> lookupIndices(kNumLookups);
+    for (uint32_t& index : lookupIndices)
+    {
+        index = static_cast<uint32_t>(rng() % kNumElements);
+    }
+
+    auto run = [&](const char* name, auto& slotMap)
+    {
+        std::vector<typename std::remove_reference_t<decltype(slotMap)>::key> keys;
+        keys.reserve(kNumElements);
+        for (size_t i = 0; i < kNumElements; i++)
+        {
+            keys.emplace_back(slotMap.emplace(i));
+        }
+
+        dtlb_miss_counter counter;
+        uint64_t sum = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        counter.start();
+        for (uint32_t index : lookupIndices)
+        {
+            sum += *slotMap.get(keys[index]);
+        }
+        uint64_t numMisses = counter.stop();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        if (counter.is_available())
+        {
+            printf("%-12s %8.2f ms, dTLB misses: %6.3f per lookup (sum %" PRIu64 ")\n", name, ms, double(numMisses) / kNumLookups, sum);
+        }
+        else
+        {
+            printf("%-12s %8.2f ms, dTLB misses: n/a (sum %" PRIu64 ")\n", name, ms, sum);
+        }
+    };
+
+    {
+        dod::slot_map<uint64_t> slotMap;
+        run("default", slotMap);
+    }
+    {
+        dod::huge_page_resource resource;
+        dod::pmr::slot_map<uint64_t> slotMap(&resource);
+        run("huge pages", slotMap);
+        auto stats = resource.stats();
+        printf("regions: %d (explicit huge pages: %d), %d MB mapped\n", int(stats.numRegions), int(stats.numHugeTlbRegions),
+               int(stats.numBytesMapped / (1024 * 1024)));
+    }
+}
+
+TEST(SlotMapTest, ReservedRange)
+{
+    dod::slot_map<std::string, dod::slot_map_key64<std::string>, 64, 8> slotMap;
+    using key = decltype(slotMap)::key;
+    EXPECT_EQ(slotMap.reserved_range_capacity(), 0u);
+    ASSERT_TRUE(slotMap.use_reserved_range(1000));
+    EXPECT_EQ(slotMap.reserved_range_capacity(), 1024u);
+    slotMap.set_release_empty_pages(true);
+
+    std::vector<key> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(std::to_string(i)));
+    }
+    // values are addressed as base + index (across pages)
+    const std::string* first = slotMap.get(keys[0]);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        ASSERT_EQ(slotMap.get(keys[i]), first + i);
+        EXPECT_EQ(*slotMap.get(keys[i]), std::to_string(i));
+    }
+    EXPECT_FALSE(slotMap.has_key(key{uint64_t(5)}));
+    EXPECT_EQ(slotMap.get(key{uint64_t(5)}), nullptr);
+
+    // empty pages are discarded, stale keys are still rejected
+    for (size_t i = 64; i < 192; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    EXPECT_EQ(slotMap.debug_stats().numReleasedPages, 2u);
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        bool isAlive = (i < 64 || i >= 192);
+        EXPECT_EQ(slotMap.has_key(keys[i]), isAlive);
+        EXPECT_EQ(slotMap.get(keys[i]) != nullptr, isAlive);
+    }
+
+    // released pages come back at the same addresses
+    std::vector<key> newKeys;
+    for (int i = 0; i < 140; i++)
+    {
+        key k = slotMap.emplace("new");
+        EXPECT_EQ(slotMap.get(k), first + key::toIndex(k));
+        newKeys.emplace_back(k);
+    }
+    EXPECT_EQ(slotMap.debug_stats().numReleasedPages, 0u);
+    for (size_t i = 64; i < 192; i++)
+    {
+        EXPECT_FALSE(slotMap.has_key(keys[i]));
+    }
+
+    // copies use the reserved range too
+    decltype(slotMap) copy = slotMap;
+    EXPECT_EQ(copy.reserved_range_capacity(), 1024u);
+    EXPECT_EQ(*copy.get(keys[999]), "999");
+    EXPECT_EQ(*copy.get(newKeys.back()), "new");
+
+    // a copy that doesn't fit into its own reserved range is left empty and usable
+    decltype(slotMap) small;
+    ASSERT_TRUE(small.use_reserved_range(64));
+    EXPECT_THROW(small = slotMap, std::bad_alloc);
+    EXPECT_TRUE(small.empty());
+    EXPECT_EQ(small.debug_stats().numPagesTotal, 0u);
+    key smallKey = small.emplace("small");
+    EXPECT_EQ(*small.get(smallKey), "small");
+
+    // the reserved range is bounded
+    EXPECT_THROW(
+        for (int i = 0; i < 1024; i++) { slotMap.emplace("overflow"); }, std::bad_alloc);
+
+    // a failed emplace leaves the map as it was
+    size_t numElements = slotMap.size();
+    EXPECT_THROW(slotMap.emplace("overflow"), std::bad_alloc);
+    EXPECT_EQ(slotMap.size(), numElements);
+    EXPECT_EQ(*slotMap.get(keys[999]), "999");
+    for (size_t i = 0; i < 16; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    key recycled = slotMap.emplace("recycled");
+    EXPECT_EQ(*slotMap.get(recycled), "recycled");
+
+    slotMap.reset();
+    EXPECT_EQ(slotMap.reserved_range_capacity(), 1024u);
+    key k = slotMap.emplace("after reset");
+    EXPECT_EQ(*slotMap.get(k), "after reset");
+
+    dod::slot_map<int> regularMap;
+    regularMap.emplace(1);
+    EXPECT_FALSE(regularMap.use_reserved_range(100));
+}
+
+TEST(SlotMapTest, ReservedRangeLookup_Slow)
+{
+    static const size_t kNumElements = 16 * 1024 * 1024;
+    static const size_t kNumLookups = 8 * 1024 * 1024;
+
+    std::mt19937_64 rng(11);
+    std::vector<uint32_t> lookupIndices(kNumLookups);
+    for (uint32_t& index : lookupIndices)
+    {
+        index = static_cast<uint32_t>(rng() % kNumElements);
+    }
+
+    auto run = [&](const char* name, dod::slot_map<uint64_t>& slotMap)
+    {
+        std::vector<dod::slot_map<uint64_t>::key> keys;
+        keys.reserve(kNumElements);
+        for (size_t i = 0; i < kNumElements; i++)
+        {
+            keys.emplace_back(slotMap.emplace(i));
+        }
+        uint64_t sum = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (uint32_t index : lookupIndices)
+        {
+            sum += *slotMap.get(keys[index]);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        printf("%-16s %8.2f ms (sum %" PRIu64 ")\n", name, ms, sum);
+    };
+
+    {
+        dod::slot_map<uint64_t> slotMap;
+        run("page table", slotMap);
+    }
+    {
+        dod::slot_map<uint64_t> slotMap;
+        EXPECT_TRUE(slotMap.use_reserved_range(uint32_t(kNumElements)));
+        run("reserved range", slotMap);
+    }
+}
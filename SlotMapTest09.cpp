@@ -0,0 +1,186 @@
+#include <chrono>
+#include <gtest/gtest.h>
+#include <random>
+#include <slot_map_vm.h>
+#include <string>
+
+struct alignas(32) OverAlignedPayload
+{
+    uint64_t a;
+    uint64_t b;
+
+    bool operator==(const OverAlignedPayload& other) const { return a == other.a && b == other.b; }
+};
+
+template <typename TSlotMap, typename MAKE> static void checkInterleavedLayout(MAKE&& makeValue)
+{
+    static_assert(TSlotMap::kLayout == dod::slot_layout::interleaved);
+    using key = typename TSlotMap::key;
+
+    TSlotMap slotMap;
+    std::vector<key> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(makeValue(i)));
+    }
+    for (size_t i = 0; i < keys.size(); i += 3)
+    {
+        slotMap.erase(keys[i]);
+    }
+    for (int i = 0; i < 200; i++)
+    {
+        keys.emplace_back(slotMap.emplace(makeValue(1000 + i)));
+    }
+
+    auto expectSameContent = [&](const TSlotMap& other)
+    {
+        EXPECT_EQ(other.size(), slotMap.size());
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            const auto* value = slotMap.get(keys[i]);
+            const auto* otherValue = other.get(keys[i]);
+            ASSERT_EQ(value != nullptr, otherValue != nullptr);
+            ASSERT_EQ(value != nullptr, other.has_key(keys[i]));
+            if (value)
+            {
+                EXPECT_TRUE(*value == *otherValue);
+                EXPECT_TRUE(*value == makeValue(int(i)));
+            }
+        }
+    };
+    expectSameContent(slotMap);
+
+    // iteration visits every live element once, at its own address
+    size_t numVisited = 0;
+    for (const auto& [k, value] : slotMap.items())
+    {
+        EXPECT_EQ(slotMap.get(k), &value.get());
+        numVisited++;
+    }
+    EXPECT_EQ(numVisited, slotMap.size());
+
+    std::vector<const decltype(makeValue(0))*> values(keys.size(), nullptr);
+    std::unique_ptr<bool[]> found(new bool[keys.size()]);
+    const TSlotMap& constSlotMap = slotMap;
+    EXPECT_EQ(constSlotMap.get_many(keys, values), slotMap.size());
+    EXPECT_EQ(slotMap.has_key_many(keys, std::span<bool>(found.get(), keys.size())), slotMap.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        EXPECT_EQ(values[i], slotMap.get(keys[i]));
+        EXPECT_EQ(found[i], slotMap.has_key(keys[i]));
+    }
+
+    TSlotMap copy(slotMap);
+    expectSameContent(copy);
+    TSlotMap moved(std::move(copy));
+    expectSameContent(moved);
+
+    // reserved range mode
+    TSlotMap reserved;
+    ASSERT_TRUE(reserved.use_reserved_range(4096));
+    reserved = slotMap;
+    expectSameContent(reserved);
+    TSlotMap reservedCopy(reserved);
+    expectSameContent(reservedCopy);
+
+    // released and revived pages
+    slotMap.set_release_empty_pages(true);
+    for (const key& k : keys)
+    {
+        slotMap.erase(k);
+    }
+    EXPECT_EQ(slotMap.size(), 0u);
+    for (const key& k : keys)
+    {
+        EXPECT_FALSE(slotMap.has_key(k));
+    }
+    key k = slotMap.emplace(makeValue(7));
+    EXPECT_TRUE(*slotMap.get(k) == makeValue(7));
+}
+
+TEST(SlotMapTest, InterleavedLayout)
+{
+    checkInterleavedLayout<dod::interleaved_slot_map<uint32_t, dod::slot_map_key64<uint32_t>, 64>>([](int i) { return uint32_t(i); });
+    checkInterleavedLayout<dod::interleaved_slot_map<std::string, dod::slot_map_key32<std::string>, 64>>(
+        [](int i) { return std::string("value_") + std::to_string(i) + std::string(32, 'x'); });
+    checkInterleavedLayout<dod::interleaved_slot_map<OverAlignedPayload, dod::slot_map_key64<OverAlignedPayload>, 128>>(
+        [](int i) { return OverAlignedPayload{uint64_t(i), ~uint64_t(i)}; });
+    checkInterleavedLayout<dod::slot_map64<uint16_t, 256, 64, stl::Allocator<uint16_t>, dod::slot_layout::interleaved>>(
+        [](int i) { return uint16_t(i); });
+
+    // the version and the value of a slot are neighbours
+    dod::interleaved_slot_map<OverAlignedPayload> slotMap;
+    auto k0 = slotMap.emplace(OverAlignedPayload{1, 2});
+    auto k1 = slotMap.emplace(OverAlignedPayload{3, 4});
+    const char* v0 = reinterpret_cast<const char*>(slotMap.get(k0));
+    const char* v1 = reinterpret_cast<const char*>(slotMap.get(k1));
+    EXPECT_EQ(uintptr_t(v0) % alignof(OverAlignedPayload), 0u);
+    EXPECT_EQ(size_t(v1 - v0), size_t(64));
+}
+
+template <size_t NUMBYTES> struct LookupPayload
+{
+    uint64_t data[NUMBYTES / sizeof(uint64_t)];
+};
+
+template <typename TSlotMap, typename TValue>
+static double measureRandomLookups(size_t numElements, const std::vector<uint32_t>& order, uint64_t& sum)
+{
+    TSlotMap slotMap;
+    std::vector<typename TSlotMap::key> keys;
+    keys.reserve(numElements);
+    for (size_t i = 0; i < numElements; i++)
+    {
+        TValue value{};
+        value.data[0] = i;
+        keys.emplace_back(slotMap.emplace(value));
+    }
+
+    // the keys are gathered up front, so the timed loop only misses on the slot map itself
+    std::vector<typename TSlotMap::key> lookups(order.size());
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        lookups[i] = keys[order[i]];
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto& k : lookups)
+    {
+        sum += slotMap.get(k)->data[0];
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+template <size_t NUMBYTES> static void compareLayouts(const std::vector<uint32_t>& order, size_t numElements)
+{
+    using payload = LookupPayload<NUMBYTES>;
+    uint64_t sumSplit = 0;
+    uint64_t sumInterleaved = 0;
+    double splitMs = measureRandomLookups<dod::slot_map<payload>, payload>(numElements, order, sumSplit);
+    double interleavedMs = measureRandomLookups<dod::interleaved_slot_map<payload>, payload>(numElements, order, sumInterleaved);
+    EXPECT_EQ(sumSplit, sumInterleaved);
+    printf("sizeof(T) = %4zu, split: %8.2f ms, interleaved: %8.2f ms, speedup: %5.2fx\n", NUMBYTES, splitMs, interleavedMs,
+           splitMs / interleavedMs);
+}
+
+// Random get() over a working set way bigger than the CPU caches (32M slots, 0.4-2.2 GB): split layout pays for two cache misses per
+// lookup, interleaved for one until the slot no longer fits a cache line with its metadata.
+// Measured at -O2 with a 105 MB LLC: interleaved is 1.1-1.6x faster for T of 8 to 64 bytes. With 1M slots the whole map stays
+// in the LLC and both layouts are within a few percent of each other.
+TEST(SlotMapTest, SlotLayoutCrossover_Slow)
+{
+    static const size_t kNumElements = 32 * 1024 * 1024;
+    static const size_t kNumLookups = 4 * 1024 * 1024;
+
+    std::mt19937 rng(42);
+    std::vector<uint32_t> order(kNumLookups);
+    for (uint32_t& i : order)
+    {
+        i = uint32_t(rng() % kNumElements);
+    }
+
+    compareLayouts<8>(order, kNumElements);
+    compareLayouts<16>(order, kNumElements);
+    compareLayouts<32>(order, kNumElements);
+    compareLayouts<64>(order, kNumElements);
+}
@@ -0,0 +1,220 @@
+#include <chrono>
+#include <gtest/gtest.h>
+#include <memory_resource>
+#include <random>
+#include <slot_map.h>
+#include <string>
+
+TEST(SlotMapTest, DenseSlotMap)
+{
+    dod::dense_slot_map<std::string, dod::slot_map_key64<std::string>, 4> slotMap;
+    using key = decltype(slotMap)::key;
+
+    std::vector<key> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(std::to_string(i)));
+    }
+    for (size_t i = 0; i < keys.size(); i += 3)
+    {
+        slotMap.erase(keys[i]);
+    }
+    std::optional<std::string> popped = slotMap.pop(keys[1]);
+    ASSERT_TRUE(popped.has_value());
+    EXPECT_EQ(*popped, "1");
+    EXPECT_FALSE(slotMap.pop(keys[1]).has_value());
+
+    auto expectValid = [&](const decltype(slotMap)& other, size_t numOtherItems = 0)
+    {
+        size_t numAlive = 0;
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            bool isAlive = (i % 3) != 0 && i != 1;
+            ASSERT_EQ(other.has_key(keys[i]), isAlive);
+            if (isAlive)
+            {
+                EXPECT_EQ(*other.get(keys[i]), std::to_string(i));
+                numAlive++;
+            }
+            else
+            {
+                EXPECT_EQ(other.get(keys[i]), nullptr);
+            }
+        }
+        EXPECT_EQ(other.size(), numAlive + numOtherItems);
+        // the packed array has no holes and every value knows its key
+        ASSERT_EQ(other.values().size(), other.size());
+        for (size_t i = 0; i < other.values().size(); i++)
+        {
+            EXPECT_EQ(other.get(other.key_at(dod::dense_slot_map<std::string>::size_type(i))), &other.values()[i]);
+        }
+    };
+    expectValid(slotMap);
+
+    // invalid and malformed keys
+    EXPECT_FALSE(slotMap.has_key(key::invalid()));
+    EXPECT_FALSE(slotMap.has_key(key::make(1, 100000)));
+    EXPECT_FALSE(slotMap.has_key(key{0xffffffffffffffffull}));
+    slotMap.erase(key::make(1, 100000));
+
+    decltype(slotMap) copy(slotMap);
+    expectValid(copy);
+    decltype(slotMap) moved(std::move(copy));
+    expectValid(moved);
+    EXPECT_TRUE(copy.empty());
+    copy = std::move(moved);
+    expectValid(copy);
+    EXPECT_TRUE(moved.empty());
+    moved.swap(copy);
+    expectValid(moved);
+
+    // recycled slots get a new version, old keys stay invalid
+    std::vector<key> newKeys;
+    for (int i = 0; i < 500; i++)
+    {
+        newKeys.emplace_back(slotMap.emplace("new"));
+    }
+    expectValid(slotMap, newKeys.size());
+    for (const key& k : newKeys)
+    {
+        EXPECT_EQ(*slotMap.get(k), "new");
+    }
+
+    size_t numIterated = 0;
+    for (std::string& value : slotMap)
+    {
+        value += "!";
+        numIterated++;
+    }
+    EXPECT_EQ(numIterated, slotMap.size());
+
+    slotMap.clear();
+    EXPECT_TRUE(slotMap.empty());
+    for (const key& k : newKeys)
+    {
+        EXPECT_FALSE(slotMap.has_key(k));
+    }
+    key k = slotMap.emplace("after clear");
+    EXPECT_EQ(*slotMap.get(k), "after clear");
+    slotMap.reset();
+    EXPECT_TRUE(slotMap.empty());
+}
+
+TEST(SlotMapTest, DenseSlotMapLimits)
+{
+    // move-only values
+    dod::dense_slot_map<std::unique_ptr<int>, dod::slot_map_key16<std::unique_ptr<int>>, 0> slotMap;
+    using key = decltype(slotMap)::key;
+
+    // versions run out: the slot is retired and never reused
+    key lastKey = slotMap.emplace(std::make_unique<int>(0));
+    for (uint32_t i = key::kMinVersion; i < key::kMaxVersion; i++)
+    {
+        slotMap.erase(lastKey);
+        lastKey = slotMap.emplace(std::make_unique<int>(int(i)));
+        EXPECT_EQ(key::toIndex(lastKey), 0u);
+    }
+    EXPECT_EQ(key::toVersion(lastKey), key::kMaxVersion);
+    slotMap.erase(lastKey);
+    EXPECT_EQ(slotMap.num_retired_slots(), 1u);
+    EXPECT_FALSE(slotMap.has_key(lastKey));
+    EXPECT_EQ(key::toIndex(slotMap.emplace(std::make_unique<int>(1))), 1u);
+
+    // the key index space runs out
+    for (uint32_t i = 2; i <= key::kMaxIndex; i++)
+    {
+        slotMap.emplace(std::make_unique<int>(int(i)));
+    }
+    EXPECT_THROW(slotMap.emplace(std::make_unique<int>(-1)), std::length_error);
+    EXPECT_EQ(slotMap.size(), key::kMaxIndex);
+
+    // allocator support
+    std::pmr::monotonic_buffer_resource arena;
+    dod::dense_slot_map<int, dod::slot_map_key32<int>, 64, std::pmr::polymorphic_allocator<int>> arenaMap(&arena);
+    for (int i = 0; i < 100; i++)
+    {
+        arenaMap.emplace(i);
+    }
+    EXPECT_EQ(arenaMap.get_allocator().resource(), &arena);
+    EXPECT_EQ(arenaMap.size(), 100u);
+}
+
+struct DenseBenchItem
+{
+    float position[3];
+    float velocity[3];
+};
+
+template <typename TSlotMap, typename FUNC> static double measureMs(TSlotMap& slotMap, FUNC&& fn)
+{
+    auto t0 = std::chrono::steady_clock::now();
+    fn(slotMap);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// Builds a map with a realistic erase/emplace history (holes in slot_map pages, shuffled order in dense_slot_map)
+template <typename TSlotMap> static std::vector<typename TSlotMap::key> fillWithChurn(TSlotMap& slotMap, size_t numElements)
+{
+    std::mt19937 rng(7);
+    std::vector<typename TSlotMap::key> keys;
+    for (size_t i = 0; i < numElements; i++)
+    {
+        keys.emplace_back(slotMap.emplace(DenseBenchItem{{1.0f, 2.0f, 3.0f}, {0.1f, 0.2f, 0.3f}}));
+    }
+    for (size_t i = 0; i < numElements / 2; i++)
+    {
+        size_t index = rng() % keys.size();
+        slotMap.erase(keys[index]);
+        keys[index] = keys.back();
+        keys.pop_back();
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+}
+
+template <typename TSlotMap> static void runDenseBenchmark(const char* name)
+{
+    static const size_t kNumElements = 2 * 1024 * 1024;
+    static const int kNumIterations = 20;
+
+    TSlotMap slotMap;
+    std::vector<typename TSlotMap::key> keys = fillWithChurn(slotMap, kNumElements);
+
+    // iterate-heavy: integrate all the elements several times
+    double iterateMs = measureMs(slotMap,
+                                 [](TSlotMap& m)
+                                 {
+                                     for (int iter = 0; iter < kNumIterations; iter++)
+                                     {
+                                         for (DenseBenchItem& item : m)
+                                         {
+                                             for (int c = 0; c < 3; c++)
+                                             {
+                                                 item.position[c] += item.velocity[c] * 0.016f;
+                                             }
+                                         }
+                                     }
+                                 });
+
+    // lookup-heavy: random access by key
+    float sum = 0.0f;
+    double lookupMs = measureMs(slotMap,
+                                [&](TSlotMap& m)
+                                {
+                                    for (int iter = 0; iter < 4; iter++)
+                                    {
+                                        for (const auto& k : keys)
+                                        {
+                                            sum += m.get(k)->position[0];
+                                        }
+                                    }
+                                });
+    EXPECT_GT(sum, 0.0f);
+    printf("%-16s iterate: %8.2f ms, lookup: %8.2f ms\n", name, iterateMs, lookupMs);
+}
+
+TEST(SlotMapTest, DenseSlotMapIterateVsLookup_Slow)
+{
+    runDenseBenchmark<dod::slot_map<DenseBenchItem>>("slot_map");
+    runDenseBenchmark<dod::dense_slot_map<DenseBenchItem>>("dense_slot_map");
+}
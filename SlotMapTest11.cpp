@@ -0,0 +1,203 @@
+#include <array>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <slot_map.h>
+#include <string>
+
+namespace
+{
+struct Position
+{
+    float x, y, z;
+};
+
+struct Velocity
+{
+    float x, y, z;
+};
+
+struct alignas(64) Transform
+{
+    float m[16];
+};
+} // namespace
+
+TEST(SlotMapTest, SoaSlotMap)
+{
+    dod::soa_slot_map<Position, std::string, Velocity, Transform> slotMap;
+    using key = decltype(slotMap)::key;
+
+    std::vector<key> keys;
+    for (int i = 0; i < 10000; i++)
+    {
+        float f = float(i);
+        keys.emplace_back(slotMap.emplace(Position{f, f, f}, std::to_string(i), Velocity{1.0f, 0.0f, 0.0f}, Transform{}));
+    }
+    for (size_t i = 0; i < keys.size(); i += 3)
+    {
+        slotMap.erase(keys[i]);
+    }
+
+    auto expectValid = [&](const decltype(slotMap)& other)
+    {
+        size_t numAlive = 0;
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            bool isAlive = (i % 3) != 0;
+            ASSERT_EQ(other.has_key(keys[i]), isAlive);
+            ASSERT_EQ(other.get<1>(keys[i]) != nullptr, isAlive);
+            if (isAlive)
+            {
+                EXPECT_EQ(other.get<0>(keys[i])->y, float(i));
+                EXPECT_EQ(*other.get<1>(keys[i]), std::to_string(i));
+                EXPECT_EQ(other.get<2>(keys[i])->x, 1.0f);
+                EXPECT_EQ(uintptr_t(other.get<3>(keys[i])) % 64, 0u);
+                numAlive++;
+            }
+        }
+        EXPECT_EQ(other.size(), numAlive);
+    };
+    expectValid(slotMap);
+
+    // columns are contiguous per page
+    EXPECT_EQ(slotMap.get<0>(keys[2]) + 1, slotMap.get<0>(keys[1]) + 2);
+    EXPECT_EQ(slotMap.get<1>(keys[2]), slotMap.get<1>(keys[1]) + 1);
+
+    decltype(slotMap) copy(slotMap);
+    expectValid(copy);
+    decltype(slotMap) moved(std::move(copy));
+    expectValid(moved);
+    EXPECT_TRUE(copy.empty());
+    copy = moved;
+    expectValid(copy);
+
+    // integrate positions touching only two columns
+    size_t numVisited = 0;
+    slotMap.for_each_chunk<0, 2>(
+        [&](std::span<Position> positions, std::span<Velocity> velocities, std::span<const uint64_t> aliveMask, uint32_t baseIndex)
+        {
+            EXPECT_EQ(positions.size(), velocities.size());
+            EXPECT_EQ(baseIndex % decltype(slotMap)::kPageSize, 0u);
+            for (size_t i = 0; i < positions.size(); i++)
+            {
+                if ((aliveMask[i / 64] >> (i % 64)) & 1)
+                {
+                    positions[i].x += velocities[i].x;
+                    numVisited++;
+                }
+            }
+        });
+    EXPECT_EQ(numVisited, slotMap.size());
+    for (size_t i = 1; i < keys.size(); i += 3)
+    {
+        EXPECT_EQ(slotMap.get<0>(keys[i])->x, float(i) + 1.0f);
+    }
+
+    // all the columns
+    const auto& constSlotMap = slotMap;
+    size_t numStrings = 0;
+    constSlotMap.for_each_chunk(
+        [&](std::span<const Position>, std::span<const std::string> names, std::span<const Velocity>, std::span<const Transform>,
+            std::span<const uint64_t> aliveMask, uint32_t)
+        {
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                numStrings += (aliveMask[i / 64] >> (i % 64)) & 1;
+            }
+        });
+    EXPECT_EQ(numStrings, slotMap.size());
+
+    // recycled slots
+    for (int i = 0; i < 1000; i++)
+    {
+        key k = slotMap.emplace(Position{}, "recycled", Velocity{}, Transform{});
+        EXPECT_EQ(*slotMap.get<1>(k), "recycled");
+    }
+    slotMap.clear();
+    EXPECT_TRUE(slotMap.empty());
+    EXPECT_EQ(slotMap.get<1>(keys[1]), nullptr);
+    slotMap.reset();
+    key k = slotMap.emplace(Position{}, "after reset", Velocity{}, Transform{});
+    EXPECT_EQ(*slotMap.get<1>(k), "after reset");
+}
+
+namespace
+{
+struct ThrowingComponent
+{
+    static inline int numAlive = 0;
+    explicit ThrowingComponent(bool shouldThrow)
+    {
+        if (shouldThrow)
+        {
+            throw std::runtime_error("component");
+        }
+        numAlive++;
+    }
+    ThrowingComponent(const ThrowingComponent&) { numAlive++; }
+    ~ThrowingComponent() { numAlive--; }
+};
+} // namespace
+
+TEST(SlotMapTest, SoaSlotMapExceptionSafety)
+{
+    {
+        dod::soa_slot_map<std::string, ThrowingComponent> slotMap;
+        auto k = slotMap.emplace("ok", false);
+        EXPECT_THROW(slotMap.emplace("throws", true), std::runtime_error);
+        EXPECT_EQ(slotMap.size(), 1u);
+        EXPECT_EQ(ThrowingComponent::numAlive, 1);
+        EXPECT_EQ(*slotMap.get<0>(k), "ok");
+    }
+    EXPECT_EQ(ThrowingComponent::numAlive, 0);
+}
+
+struct SoaBigEntity
+{
+    Position position;
+    Velocity velocity;
+    float payload[30];
+};
+
+TEST(SlotMapTest, SoaSlotMapPartialPass_Slow)
+{
+    static const size_t kNumElements = 1024 * 1024;
+    static const int kNumIterations = 20;
+
+    dod::slot_map<SoaBigEntity> aos;
+    dod::soa_slot_map<Position, Velocity, std::array<float, 30>> soa;
+    for (size_t i = 0; i < kNumElements; i++)
+    {
+        aos.emplace(SoaBigEntity{{0.0f, 0.0f, 0.0f}, {1.0f, 2.0f, 3.0f}, {}});
+        soa.emplace(Position{0.0f, 0.0f, 0.0f}, Velocity{1.0f, 2.0f, 3.0f}, std::array<float, 30>{});
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int iter = 0; iter < kNumIterations; iter++)
+    {
+        for (SoaBigEntity& e : aos)
+        {
+            e.position.x += e.velocity.x;
+            e.position.y += e.velocity.y;
+            e.position.z += e.velocity.z;
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int iter = 0; iter < kNumIterations; iter++)
+    {
+        soa.for_each_chunk<0, 1>(
+            [](std::span<Position> positions, std::span<Velocity> velocities, std::span<const uint64_t>, uint32_t)
+            {
+                // no erases: every slot in the chunk is alive
+                for (size_t i = 0; i < positions.size(); i++)
+                {
+                    positions[i].x += velocities[i].x;
+                    positions[i].y += velocities[i].y;
+                    positions[i].z += velocities[i].z;
+                }
+            });
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    printf("slot_map<Big>: %8.2f ms, soa_slot_map (2 of 3 columns): %8.2f ms\n",
+           std::chrono::duration<double, std::milli>(t1 - t0).count(), std::chrono::duration<double, std::milli>(t2 - t1).count());
+}
@@ -0,0 +1,249 @@
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <slot_map_vm.h>
+#include <string>
+#include <thread>
+
+// Fills two maps with the same history, clears one with clear() and the other one by erasing every key in slot order
+template <typename TSlotMap, typename MAKE> static void checkClearMatchesErase(bool releaseEmptyPages, MAKE&& makeValue)
+{
+    using key = typename TSlotMap::key;
+    TSlotMap cleared;
+    TSlotMap erased;
+    cleared.set_release_empty_pages(releaseEmptyPages);
+    erased.set_release_empty_pages(releaseEmptyPages);
+
+    auto fill = [&](TSlotMap& slotMap)
+    {
+        std::vector<key> keys;
+        for (int i = 0; i < 3000; i++)
+        {
+            keys.emplace_back(slotMap.emplace(makeValue(i)));
+        }
+        // burn all the versions of the first page and a few more slots, so clear() has to deactivate them
+        for (size_t i = 0; i < 70; i++)
+        {
+            while (key::toVersion(keys[i]) != key::kMaxVersion)
+            {
+                slotMap.erase(keys[i]);
+                keys[i] = slotMap.emplace(makeValue(int(i)));
+            }
+        }
+        for (size_t i = 0; i < keys.size(); i += 5)
+        {
+            slotMap.erase(keys[i]);
+        }
+        return keys;
+    };
+    std::vector<key> keys = fill(cleared);
+    ASSERT_EQ(fill(erased), keys);
+
+    cleared.clear();
+    std::vector<key> aliveKeys;
+    for (const auto& [k, value] : erased.items())
+    {
+        aliveKeys.emplace_back(k);
+    }
+    for (const key& k : aliveKeys)
+    {
+        erased.erase(k);
+    }
+
+    EXPECT_TRUE(cleared.empty());
+    for (const key& k : keys)
+    {
+        EXPECT_FALSE(cleared.has_key(k));
+    }
+    auto clearedStats = cleared.debug_stats();
+    auto erasedStats = erased.debug_stats();
+    EXPECT_EQ(clearedStats.numActivePages, erasedStats.numActivePages);
+    EXPECT_EQ(clearedStats.numInactivePages, erasedStats.numInactivePages);
+    EXPECT_EQ(clearedStats.numReleasedPages, erasedStats.numReleasedPages);
+    EXPECT_EQ(clearedStats.numTombstoneItems, erasedStats.numTombstoneItems);
+    EXPECT_EQ(clearedStats.numInactiveItems, erasedStats.numInactiveItems);
+    EXPECT_GT(clearedStats.numInactiveItems, 0u);
+
+    // recycled keys come back in the same order with the same versions
+    for (int i = 0; i < 4000; i++)
+    {
+        key k = cleared.emplace(makeValue(i));
+        ASSERT_EQ(k, erased.emplace(makeValue(i)));
+        EXPECT_TRUE(*cleared.get(k) == makeValue(i));
+    }
+}
+
+TEST(SlotMapTest, ClearMatchesErase)
+{
+    for (bool releaseEmptyPages : {false, true})
+    {
+        checkClearMatchesErase<dod::slot_map<int, dod::slot_map_key32<int>, 64, 0>>(releaseEmptyPages, [](int i) { return i; });
+        checkClearMatchesErase<dod::slot_map<std::string, dod::slot_map_key32<std::string>, 64, 0>>(
+            releaseEmptyPages, [](int i) { return std::string(32, 'x') + std::to_string(i); });
+        checkClearMatchesErase<dod::interleaved_slot_map<int, dod::slot_map_key32<int>, 64, 0>>(releaseEmptyPages,
+                                                                                                 [](int i) { return i; });
+    }
+
+    // reserved range mode
+    dod::slot_map<int, dod::slot_map_key64<int>, 64> slotMap;
+    ASSERT_TRUE(slotMap.use_reserved_range(4096));
+    std::vector<dod::slot_map<int, dod::slot_map_key64<int>, 64>::key> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+    slotMap.clear();
+    for (const auto& k : keys)
+    {
+        EXPECT_FALSE(slotMap.has_key(k));
+    }
+    EXPECT_EQ(*slotMap.get(slotMap.emplace(7)), 7);
+}
+
+template <typename TValue, typename MAKE> static void compareClearAndErase(const char* name, MAKE&& makeValue)
+{
+    static const size_t kNumElements = 10 * 1000 * 1000;
+    using map_t = dod::slot_map<TValue>;
+
+    auto fill = [&](map_t& slotMap)
+    {
+        std::vector<typename map_t::key> keys;
+        keys.reserve(kNumElements);
+        for (size_t i = 0; i < kNumElements; i++)
+        {
+            keys.emplace_back(slotMap.emplace(makeValue(i)));
+        }
+        // a third of the slots are tombstones already
+        for (size_t i = 0; i < kNumElements; i += 3)
+        {
+            slotMap.erase(keys[i]);
+        }
+        return keys;
+    };
+
+    // the previous clear() erased every element one by one
+    map_t erased;
+    std::vector<typename map_t::key> keys = fill(erased);
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto& k : keys)
+    {
+        erased.erase(k);
+    }
+    double eraseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    map_t cleared;
+    fill(cleared);
+    t0 = std::chrono::steady_clock::now();
+    cleared.clear();
+    double clearMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+    EXPECT_TRUE(erased.empty() && cleared.empty());
+    printf("%-12s erase all: %8.2f ms, clear: %8.2f ms, speedup: %5.2fx\n", name, eraseMs, clearMs, eraseMs / clearMs);
+}
+
+TEST(SlotMapTest, ClearVsErase_Slow)
+{
+    compareClearAndErase<uint64_t>("uint64_t", [](size_t i) { return uint64_t(i); });
+    compareClearAndErase<std::string>("std::string", [](size_t i) { return std::to_string(i); });
+}
+
+struct CountedValue
+{
+    static inline std::atomic<int> numAlive{0};
+
+    explicit CountedValue(int _value)
+        : value(_value)
+    {
+        numAlive++;
+    }
+    CountedValue(const CountedValue& other)
+        : value(other.value)
+    {
+        numAlive++;
+    }
+    ~CountedValue() { numAlive--; }
+
+    int value;
+};
+
+TEST(SlotMapTest, ParallelDestruction)
+{
+    for (unsigned numThreads : {1u, 0u, 3u, 200u})
+    {
+        {
+            dod::slot_map<CountedValue, dod::slot_map_key64<CountedValue>, 64> slotMap;
+            slotMap.set_destruction_threads(numThreads);
+            EXPECT_EQ(slotMap.destruction_threads(), numThreads);
+
+            std::vector<decltype(slotMap)::key> keys;
+            for (int i = 0; i < 5000; i++)
+            {
+                keys.emplace_back(slotMap.emplace(i));
+            }
+            for (size_t i = 0; i < keys.size(); i += 3)
+            {
+                slotMap.erase(keys[i]);
+            }
+            EXPECT_EQ(CountedValue::numAlive.load(), int(slotMap.size()));
+
+            // assignment destroys the previous content
+            decltype(slotMap) copy(slotMap);
+            EXPECT_EQ(CountedValue::numAlive.load(), int(slotMap.size() * 2));
+            copy = slotMap;
+            EXPECT_EQ(CountedValue::numAlive.load(), int(slotMap.size() * 2));
+            copy.reset();
+            EXPECT_EQ(CountedValue::numAlive.load(), int(slotMap.size()));
+
+            slotMap.clear();
+            EXPECT_EQ(CountedValue::numAlive.load(), 0);
+            for (const auto& k : keys)
+            {
+                EXPECT_FALSE(slotMap.has_key(k));
+            }
+            for (int i = 0; i < 1000; i++)
+            {
+                slotMap.emplace(i);
+            }
+            EXPECT_EQ(CountedValue::numAlive.load(), 1000);
+        }
+        // destructor
+        EXPECT_EQ(CountedValue::numAlive.load(), 0);
+    }
+}
+
+TEST(SlotMapTest, Teardown_Slow)
+{
+    // trivially destructible: no per element work at all
+    {
+        static const size_t kNumElements = 50 * 1000 * 1000;
+        auto slotMap = std::make_unique<dod::slot_map<uint64_t>>();
+        for (size_t i = 0; i < kNumElements; i++)
+        {
+            slotMap->emplace(uint64_t(i));
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        slotMap.reset();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        printf("uint64_t x %zu, destructor: %8.2f ms\n", kNumElements, ms);
+    }
+
+    // expensive destructors: parallel destruction
+    static const size_t kNumElements = 4 * 1000 * 1000;
+    unsigned maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    double singleThreaded = 0.0;
+    for (unsigned numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        auto slotMap = std::make_unique<dod::slot_map<std::string>>();
+        slotMap->set_destruction_threads(numThreads);
+        for (size_t i = 0; i < kNumElements; i++)
+        {
+            slotMap->emplace(std::string(48, 'x'));
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        slotMap.reset();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        singleThreaded = (numThreads == 1) ? ms : singleThreaded;
+        printf("std::string x %zu, threads: %3u, destructor: %8.2f ms, speedup: %5.2fx\n", kNumElements, numThreads, ms,
+               singleThreaded / ms);
+    }
+}
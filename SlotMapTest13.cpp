@@ -0,0 +1,315 @@
+#include <atomic>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <map>
+#include <memory_resource>
+#include <slot_map_vm.h>
+#include <string>
+#include <thread>
+
+struct SharedValue
+{
+    static inline std::atomic<int> numAlive{0};
+
+    explicit SharedValue(int _value)
+        : value(_value)
+    {
+        numAlive++;
+    }
+    SharedValue(const SharedValue& other)
+        : value(other.value)
+    {
+        numAlive++;
+    }
+    SharedValue(SharedValue&& other) noexcept
+        : value(other.value)
+    {
+        numAlive++;
+    }
+    ~SharedValue() { numAlive--; }
+
+    int value;
+};
+
+template <typename TSlotMap> static void expectContent(const TSlotMap& slotMap, const std::map<typename TSlotMap::key, int>& reference)
+{
+    ASSERT_EQ(slotMap.size(), reference.size());
+    for (const auto& [k, value] : reference)
+    {
+        ASSERT_TRUE(slotMap.has_key(k));
+        EXPECT_EQ(slotMap.get(k)->value, value);
+    }
+    size_t numVisited = 0;
+    for (const auto& [k, value] : slotMap.items())
+    {
+        EXPECT_EQ(reference.at(k), value.get().value);
+        numVisited++;
+    }
+    EXPECT_EQ(numVisited, reference.size());
+}
+
+template <typename TSlotMap> static void checkCopyOnWrite()
+{
+    static_assert(TSlotMap::kSharing == dod::slot_sharing::copy_on_write);
+    using key = typename TSlotMap::key;
+    {
+        TSlotMap slotMap;
+        std::map<key, int> reference;
+        for (int i = 0; i < 5000; i++)
+        {
+            reference[slotMap.emplace(i)] = i;
+        }
+        for (auto it = reference.begin(); it != reference.end();)
+        {
+            if ((it->second % 3) == 0)
+            {
+                slotMap.erase(it->first);
+                it = reference.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        const int numAlive = SharedValue::numAlive.load();
+
+        // a snapshot shares all the pages and copies nothing
+        TSlotMap snapshot(slotMap);
+        const std::map<key, int> snapshotReference = reference;
+        auto stats = slotMap.debug_stats();
+        EXPECT_EQ(stats.numSharedPages, stats.numActivePages);
+        EXPECT_EQ(snapshot.debug_stats().numSharedPages, stats.numActivePages);
+        EXPECT_EQ(SharedValue::numAlive.load(), numAlive);
+        expectContent(snapshot, snapshotReference);
+
+        // writes copy the touched pages only
+        const key erasedKey = reference.begin()->first;
+        slotMap.erase(erasedKey);
+        reference.erase(erasedKey);
+        EXPECT_EQ(slotMap.debug_stats().numSharedPages, stats.numActivePages - 1);
+        EXPECT_EQ(snapshot.debug_stats().numSharedPages, stats.numActivePages - 1);
+
+        const key modifiedKey = std::prev(reference.end())->first;
+        slotMap.get(modifiedKey)->value = -1;
+        reference[modifiedKey] = -1;
+        EXPECT_EQ(slotMap.debug_stats().numSharedPages, stats.numActivePages - 2);
+
+        std::vector<key> keys;
+        std::vector<SharedValue*> values;
+        for (const auto& [k, value] : reference)
+        {
+            keys.emplace_back(k);
+        }
+        values.resize(keys.size());
+        EXPECT_EQ(slotMap.get_many(keys, values), keys.size());
+        for (size_t i = 0; i < keys.size(); i += 100)
+        {
+            values[i]->value += 1000;
+            reference[keys[i]] += 1000;
+        }
+        for (int i = 0; i < 3000; i++)
+        {
+            reference[slotMap.emplace(10000 + i)] = 10000 + i;
+        }
+        expectContent(slotMap, reference);
+        expectContent(snapshot, snapshotReference);
+
+        // a snapshot of a snapshot, then the original goes away first
+        TSlotMap second;
+        second = snapshot;
+        slotMap.reset();
+        expectContent(snapshot, snapshotReference);
+        snapshot.clear();
+        expectContent(second, snapshotReference);
+        EXPECT_EQ(SharedValue::numAlive.load(), int(snapshotReference.size()));
+
+        // compaction and mutable iteration
+        TSlotMap third(second);
+        std::map<key, int> thirdReference = snapshotReference;
+        for (auto it = thirdReference.begin(); it != thirdReference.end();)
+        {
+            if ((it->second % 4) != 0)
+            {
+                third.erase(it->first);
+                it = thirdReference.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        while (third.compact(64,
+                             [&](key oldKey, key newKey)
+                             {
+                                 thirdReference[newKey] = thirdReference.at(oldKey);
+                                 thirdReference.erase(oldKey);
+                             }) != 0)
+        {
+        }
+        TSlotMap fourth(third);
+        for (auto& value : fourth)
+        {
+            value.value = 7;
+        }
+        EXPECT_EQ(fourth.debug_stats().numSharedPages, 0u);
+        expectContent(third, thirdReference);
+        expectContent(second, snapshotReference);
+    }
+    EXPECT_EQ(SharedValue::numAlive.load(), 0);
+}
+
+TEST(SlotMapTest, CopyOnWrite)
+{
+    checkCopyOnWrite<dod::cow_slot_map<SharedValue, dod::slot_map_key64<SharedValue>, 64>>();
+    checkCopyOnWrite<dod::cow_slot_map<SharedValue, dod::slot_map_key32<SharedValue>, 128, 0, stl::Allocator<SharedValue>,
+                                       dod::slot_layout::interleaved>>();
+
+    // pages are only shared between slot maps with equal allocators
+    std::pmr::monotonic_buffer_resource arena;
+    using pmr_map = dod::pmr::slot_map<int, dod::slot_map_key64<int>, 64, 64, dod::slot_layout::split, dod::slot_sharing::copy_on_write>;
+    pmr_map slotMap(&arena);
+    auto k = slotMap.emplace(42);
+    pmr_map sameArena(&arena);
+    sameArena = slotMap;
+    EXPECT_EQ(sameArena.debug_stats().numSharedPages, 1u);
+    pmr_map otherArena(std::pmr::new_delete_resource());
+    otherArena = slotMap;
+    EXPECT_EQ(otherArena.debug_stats().numSharedPages, 0u);
+    EXPECT_EQ(*otherArena.get(k), 42);
+    EXPECT_FALSE(pmr_map().use_reserved_range(1024));
+}
+
+TEST(SlotMapTest, CopyOnWritePointers)
+{
+    dod::cow_slot_map<int, dod::slot_map_key64<int>, 64> slotMap;
+    auto first = slotMap.emplace(1);
+    auto second = slotMap.emplace(2);
+    int* value = slotMap.get(first);
+
+    // without a copy, pointers are as stable as with slot_sharing::exclusive
+    *slotMap.get(second) = 3;
+    EXPECT_EQ(slotMap.get(first), value);
+
+    // the first write after a copy moves the page, the old pointer now belongs to the snapshot
+    auto snapshot = slotMap;
+    *slotMap.get(second) = 20;
+    EXPECT_NE(slotMap.get(first), value);
+    EXPECT_EQ(std::as_const(snapshot).get(first), value);
+    EXPECT_EQ(*std::as_const(snapshot).get(second), 3);
+
+    // pointers taken after the write are stable again
+    value = slotMap.get(first);
+    *value = 100;
+    slotMap.emplace(4);
+    EXPECT_EQ(slotMap.get(first), value);
+    EXPECT_EQ(*slotMap.get(first), 100);
+    EXPECT_EQ(*std::as_const(snapshot).get(first), 1);
+}
+
+TEST(SlotMapTest, CopyOnWriteRollback)
+{
+    dod::cow_slot_map<int, dod::slot_map_key64<int>, 64> slotMap;
+    std::vector<decltype(slotMap)::key> keys;
+    for (int i = 0; i < 640; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+    for (size_t i = 0; i < keys.size(); i += 2)
+    {
+        slotMap.erase(keys[i]);
+    }
+
+    // snapshots keep the free queue: rolling back and refilling doesn't grow the map
+    const auto numPages = slotMap.debug_stats().numPagesTotal;
+    const auto checkpoint = slotMap;
+    for (int round = 0; round < 4; round++)
+    {
+        for (int i = 0; i < 320; i++)
+        {
+            slotMap.emplace(i);
+        }
+        // at most one new page: the last kMinFreeIndices tombstones are held back
+        EXPECT_LE(slotMap.debug_stats().numPagesTotal, numPages + 1);
+        slotMap = checkpoint;
+    }
+}
+
+TEST(SlotMapTest, CopyOnWriteBackgroundSnapshot)
+{
+    dod::cow_slot_map<uint64_t> slotMap;
+    std::vector<dod::cow_slot_map<uint64_t>::key> keys;
+    uint64_t expectedSum = 0;
+    for (uint64_t i = 0; i < 100000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+        expectedSum += i;
+    }
+
+    // the snapshot is read and destroyed on another thread while the original keeps changing
+    for (int round = 0; round < 4; round++)
+    {
+        auto snapshot = std::make_unique<dod::cow_slot_map<uint64_t>>(slotMap);
+        std::thread serializer(
+            [snapshotSum = expectedSum, snapshot = std::move(snapshot)]() mutable
+            {
+                uint64_t sum = 0;
+                for (const uint64_t& value : *std::as_const(snapshot))
+                {
+                    sum += value;
+                }
+                EXPECT_EQ(sum, snapshotSum);
+                snapshot.reset();
+            });
+        for (size_t i = size_t(round); i < keys.size(); i += 7)
+        {
+            uint64_t& value = *slotMap.get(keys[i]);
+            expectedSum -= value;
+            value = 0;
+        }
+        serializer.join();
+    }
+    uint64_t sum = 0;
+    for (const uint64_t& value : std::as_const(slotMap))
+    {
+        sum += value;
+    }
+    EXPECT_EQ(sum, expectedSum);
+}
+
+TEST(SlotMapTest, CopyOnWriteSnapshot_Slow)
+{
+    static const size_t kNumElements = 5 * 1000 * 1000;
+    static const size_t kNumWrites = 10000;
+
+    auto run = [](auto& slotMap, const char* name)
+    {
+        using map_t = std::remove_reference_t<decltype(slotMap)>;
+        std::vector<typename map_t::key> keys;
+        keys.reserve(kNumElements);
+        for (size_t i = 0; i < kNumElements; i++)
+        {
+            keys.emplace_back(slotMap.emplace(std::to_string(i)));
+        }
+
+        auto t0 = std::chrono::steady_clock::now();
+        map_t snapshot(slotMap);
+        double copyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+        // a frame worth of writes after the snapshot, to a hot set of 1% of the elements
+        t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kNumWrites; i++)
+        {
+            *slotMap.get(keys[(i * 7919) % (kNumElements / 100)]) += "!";
+        }
+        double writeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        EXPECT_EQ(snapshot.size(), slotMap.size());
+        auto stats = slotMap.debug_stats();
+        printf("%-10s snapshot: %8.2f ms, %zu writes after the snapshot: %8.2f ms, pages copied: %u of %u\n", name, copyMs, kNumWrites,
+               writeMs, stats.numActivePages - stats.numSharedPages, stats.numActivePages);
+    };
+
+    dod::slot_map<std::string> exclusive;
+    run(exclusive, "exclusive");
+    dod::cow_slot_map<std::string> cow;
+    run(cow, "cow");
+}
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <memory_resource>
+#include <random>
+#include <slot_map_vm.h>
+#include <string>
+
+struct SnapshotItem
+{
+    uint64_t id;
+    float position[3];
+
+    bool operator==(const SnapshotItem& other) const
+    {
+        return id == other.id && position[0] == other.position[0] && position[1] == other.position[1] &&
+               position[2] == other.position[2];
+    }
+};
+
+// Hands out memory filled with a byte pattern, so slots that were never written hold that pattern
+class pattern_resource : public std::pmr::memory_resource
+{
+  public:
+    explicit pattern_resource(unsigned char _pattern)
+        : pattern(_pattern)
+    {
+    }
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        void* p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+        std::memset(p, pattern, bytes);
+        return p;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    unsigned char pattern;
+};
+
+static std::string getSnapshotPath(const char* name)
+{
+    return (std::filesystem::temp_directory_path() / (std::string("slot_map_") + name + ".bin")).string();
+}
+
+// Builds a map with holes, inactive slots (all the versions used) and released pages
+template <typename TSlotMap, typename MAKE> static std::vector<typename TSlotMap::key> fillForSnapshot(TSlotMap& slotMap, MAKE&& makeValue)
+{
+    using key = typename TSlotMap::key;
+    std::vector<key> keys;
+    for (int i = 0; i < 3000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(makeValue(i)));
+    }
+    while (key::toVersion(keys[5]) != key::kMaxVersion)
+    {
+        slotMap.erase(keys[5]);
+        keys[5] = slotMap.emplace(makeValue(5));
+    }
+    slotMap.erase(keys[5]);
+    for (size_t i = 0; i < keys.size(); i += 3)
+    {
+        slotMap.erase(keys[i]);
+    }
+    // empty out a page in the middle of the map
+    slotMap.set_release_empty_pages(true);
+    for (size_t i = 1024; i < 1088; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    slotMap.set_release_empty_pages(false);
+    return keys;
+}
+
+template <typename TSlotMap, typename MAKE> static void checkSnapshotRoundTrip(const char* name, MAKE&& makeValue)
+{
+    using key = typename TSlotMap::key;
+    const std::string path = getSnapshotPath(name);
+
+    TSlotMap slotMap;
+    std::vector<key> keys = fillForSnapshot(slotMap, makeValue);
+    ASSERT_GT(slotMap.debug_stats().numReleasedPages, 0u);
+    ASSERT_TRUE(slotMap.save(path.c_str()));
+
+    auto expectSameContent = [&](const TSlotMap& other)
+    {
+        EXPECT_EQ(other.size(), slotMap.size());
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            const auto* value = slotMap.get(keys[i]);
+            const auto* otherValue = other.get(keys[i]);
+            ASSERT_EQ(value != nullptr, otherValue != nullptr);
+            ASSERT_EQ(value != nullptr, other.has_key(keys[i]));
+            if (value)
+            {
+                EXPECT_TRUE(*value == *otherValue);
+            }
+        }
+        auto stats = slotMap.debug_stats();
+        auto otherStats = other.debug_stats();
+        EXPECT_EQ(stats.numActivePages, otherStats.numActivePages);
+        EXPECT_EQ(stats.numInactivePages, otherStats.numInactivePages);
+        EXPECT_EQ(stats.numReleasedPages, otherStats.numReleasedPages);
+        EXPECT_EQ(stats.numInactiveItems, otherStats.numInactiveItems);
+    };
+
+    for (dod::load_mode mode : {dod::load_mode::copy, dod::load_mode::map})
+    {
+        for (bool useReservedRange : {false, true})
+        {
+            TSlotMap loaded;
+            if (useReservedRange && !loaded.use_reserved_range(16384))
+            {
+                // not available with slot_sharing::copy_on_write
+                continue;
+            }
+            loaded.emplace(makeValue(-1));
+            ASSERT_TRUE(loaded.load(path.c_str(), mode));
+            expectSameContent(loaded);
+
+            size_t numVisited = 0;
+            for (const auto& [k, value] : loaded.items())
+            {
+                EXPECT_TRUE(value.get() == *slotMap.get(k));
+                numVisited++;
+            }
+            EXPECT_EQ(numVisited, slotMap.size());
+
+            // the free queue is restored: a map with the same history hands out the same keys from here on
+            TSlotMap reference;
+            fillForSnapshot(reference, makeValue);
+            for (int i = 0; i < 3000; i++)
+            {
+                key k = loaded.emplace(makeValue(10000 + i));
+                ASSERT_EQ(k, reference.emplace(makeValue(10000 + i)));
+            }
+            for (size_t i = 1; i < keys.size(); i += 3)
+            {
+                loaded.erase(keys[i]);
+                if (auto* value = loaded.get(keys[i + 1]))
+                {
+                    *value = makeValue(-2);
+                }
+            }
+            loaded.compact(1000, [](key, key) {});
+
+            // writes to a mapped snapshot never reach the file
+            TSlotMap reloaded;
+            ASSERT_TRUE(reloaded.load(path.c_str(), mode));
+            expectSameContent(reloaded);
+
+            // copies of a loaded map own their memory
+            TSlotMap copy(reloaded);
+            reloaded.reset();
+            expectSameContent(copy);
+        }
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(SlotMapTest, Snapshot)
+{
+    auto makeItem = [](int i) { return SnapshotItem{uint64_t(i), {float(i), 1.0f, -float(i)}}; };
+    checkSnapshotRoundTrip<dod::slot_map<int, dod::slot_map_key32<int>, 64, 0>>("split", [](int i) { return i; });
+    checkSnapshotRoundTrip<dod::slot_map<SnapshotItem, dod::slot_map_key32<SnapshotItem>, 64>>("split_item", makeItem);
+    checkSnapshotRoundTrip<dod::interleaved_slot_map<SnapshotItem, dod::slot_map_key32<SnapshotItem>, 64, 0>>("interleaved", makeItem);
+    checkSnapshotRoundTrip<dod::slot_map<uint16_t, dod::slot_map_key32<uint16_t>, 64, 0, stl::Allocator<uint16_t>,
+                                         dod::slot_layout::split, dod::slot_sharing::copy_on_write>>("cow",
+                                                                                                     [](int i) { return uint16_t(i); });
+
+    // an empty map
+    const std::string path = getSnapshotPath("empty");
+    dod::slot_map<int> empty;
+    ASSERT_TRUE(empty.save(path.c_str()));
+    dod::slot_map<int> loaded;
+    loaded.emplace(1);
+    ASSERT_TRUE(loaded.load(path.c_str(), dod::load_mode::map));
+    EXPECT_TRUE(loaded.empty());
+    EXPECT_EQ(*loaded.get(loaded.emplace(2)), 2);
+    std::filesystem::remove(path);
+}
+
+TEST(SlotMapTest, SnapshotErrors)
+{
+    const std::string path = getSnapshotPath("errors");
+    dod::slot_map<int, dod::slot_map_key64<int>, 64> slotMap;
+    for (int i = 0; i < 1000; i++)
+    {
+        slotMap.emplace(i);
+    }
+    ASSERT_TRUE(slotMap.save(path.c_str()));
+    const auto fileSize = std::filesystem::file_size(path);
+
+    auto expectLoadFails = [&](auto& other)
+    {
+        for (dod::load_mode mode : {dod::load_mode::copy, dod::load_mode::map})
+        {
+            other.emplace();
+            EXPECT_FALSE(other.load(path.c_str(), mode));
+            EXPECT_TRUE(other.empty());
+            EXPECT_EQ(other.debug_stats().numPagesTotal, 0u);
+            other.emplace();
+            EXPECT_EQ(other.size(), 1u);
+        }
+    };
+
+    // a slot map with a different memory layout
+    dod::slot_map<uint64_t, dod::slot_map_key64<uint64_t>, 64> otherValue;
+    expectLoadFails(otherValue);
+    dod::slot_map<int, dod::slot_map_key32<int>, 64> otherKey;
+    expectLoadFails(otherKey);
+    dod::slot_map<int, dod::slot_map_key64<int>, 128> otherPageSize;
+    expectLoadFails(otherPageSize);
+    dod::slot_map<int, dod::slot_map_key64<int>, 64, 64, stl::Allocator<int>, dod::slot_layout::interleaved> otherLayout;
+    expectLoadFails(otherLayout);
+
+    // a slot whose metadata says it is alive without an alive bit: the files of two maps that only differ in the version of a
+    // tombstone last differ in the low byte of its metadata (the page content follows the free queue), the alive flag is the top bit
+    using tombstone_map_t = dod::slot_map<int, dod::slot_map_key64<int>, 64, 0>;
+    auto saveTombstone = [&](int numReuses)
+    {
+        tombstone_map_t tombstone;
+        std::vector<tombstone_map_t::key> tombstoneKeys;
+        for (int i = 0; i < 10; i++)
+        {
+            tombstoneKeys.emplace_back(tombstone.emplace(i));
+        }
+        tombstone.erase(tombstoneKeys[5]);
+        for (int i = 0; i < numReuses; i++)
+        {
+            tombstone.erase(tombstone.emplace(5));
+        }
+        EXPECT_TRUE(tombstone.save(path.c_str()));
+        std::vector<char> bytes(size_t(std::filesystem::file_size(path)));
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        EXPECT_NE(file, nullptr);
+        EXPECT_EQ(std::fread(bytes.data(), 1, bytes.size(), file), bytes.size());
+        std::fclose(file);
+        return bytes;
+    };
+    std::vector<char> reusedBytes = saveTombstone(1);
+    std::vector<char> bytes = saveTombstone(0);
+    ASSERT_EQ(bytes.size(), reusedBytes.size());
+    auto mismatch = std::mismatch(bytes.rbegin(), bytes.rend(), reusedBytes.rbegin());
+    ASSERT_NE(mismatch.first, bytes.rend());
+    size_t metaOffset = size_t(bytes.rend() - mismatch.first) - 1;
+    bytes[metaOffset + sizeof(tombstone_map_t::version_t) - 1] |= char(0x80);
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    ASSERT_NE(file, nullptr);
+    EXPECT_EQ(std::fwrite(bytes.data(), 1, bytes.size(), file), bytes.size());
+    std::fclose(file);
+    // only a copy checks the page content, a mapped load reads nothing but the header and the page table
+    tombstone_map_t corruptedMeta;
+    EXPECT_FALSE(corruptedMeta.load(path.c_str(), dod::load_mode::copy));
+    EXPECT_TRUE(corruptedMeta.empty());
+    EXPECT_TRUE(corruptedMeta.load(path.c_str(), dod::load_mode::map));
+    EXPECT_EQ(corruptedMeta.size(), 9u);
+    ASSERT_TRUE(slotMap.save(path.c_str()));
+
+    // a truncated file
+    std::filesystem::resize_file(path, fileSize - 1);
+    dod::slot_map<int, dod::slot_map_key64<int>, 64> truncated;
+    expectLoadFails(truncated);
+
+    // a missing file
+    std::filesystem::remove(path);
+    expectLoadFails(truncated);
+    EXPECT_FALSE(slotMap.save((std::filesystem::temp_directory_path() / "missing_dir" / "snapshot.bin").string().c_str()));
+}
+
+TEST(SlotMapTest, SnapshotSaveOverMapped)
+{
+    // the warm restart workflow: map the last snapshot, keep working, save over it periodically
+    const std::string path = getSnapshotPath("over_mapped");
+    using slot_map_t = dod::slot_map<uint64_t, dod::slot_map_key32<uint64_t>, 64>;
+    slot_map_t slotMap;
+    std::vector<slot_map_t::key> keys;
+    for (uint64_t i = 0; i < 1000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(i));
+    }
+    ASSERT_TRUE(slotMap.save(path.c_str()));
+
+    slot_map_t mapped;
+    ASSERT_TRUE(mapped.load(path.c_str(), dod::load_mode::map));
+    for (int round = 0; round < 3; round++)
+    {
+        *mapped.get(keys[10]) += 100;
+        keys.emplace_back(mapped.emplace(uint64_t(5000 + round)));
+        ASSERT_TRUE(mapped.save(path.c_str()));
+        EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+
+        // the mapped pages still read the snapshot they were loaded from
+        for (size_t i = 0; i < 1000; i++)
+        {
+            ASSERT_EQ(*mapped.get(keys[i]), (i == 10) ? 10 + 100 * uint64_t(round + 1) : i);
+        }
+        slot_map_t reloaded;
+        ASSERT_TRUE(reloaded.load(path.c_str(), dod::load_mode::map));
+        EXPECT_EQ(reloaded.size(), mapped.size());
+        EXPECT_EQ(*reloaded.get(keys[10]), *mapped.get(keys[10]));
+        EXPECT_EQ(*reloaded.get(keys.back()), uint64_t(5000 + round));
+    }
+
+    // a failed save leaves the previous snapshot in place
+    std::filesystem::create_directory(path + ".tmp");
+    EXPECT_FALSE(slotMap.save(path.c_str()));
+    std::filesystem::remove(path + ".tmp");
+    slot_map_t reloaded;
+    ASSERT_TRUE(reloaded.load(path.c_str()));
+    EXPECT_EQ(reloaded.size(), mapped.size());
+    std::filesystem::remove(path);
+}
+
+TEST(SlotMapTest, SnapshotUnusedSlots)
+{
+    // the slots past the used part of a page are written as zeros, so two maps with the same content give the same file
+    // no matter what their page memory held before
+    const std::string path = getSnapshotPath("unused");
+    auto saveBytes = [&](unsigned char pattern)
+    {
+        pattern_resource resource(pattern);
+        dod::pmr::slot_map<int, dod::slot_map_key64<int>, 64, 0> slotMap(&resource);
+        std::vector<dod::pmr::slot_map<int, dod::slot_map_key64<int>, 64, 0>::key> keys;
+        for (int i = 0; i < 10; i++)
+        {
+            keys.emplace_back(slotMap.emplace(i));
+        }
+        slotMap.erase(keys[3]);
+        EXPECT_TRUE(slotMap.save(path.c_str()));
+        std::vector<char> bytes(size_t(std::filesystem::file_size(path)));
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        EXPECT_NE(file, nullptr);
+        EXPECT_EQ(std::fread(bytes.data(), 1, bytes.size(), file), bytes.size());
+        std::fclose(file);
+        return bytes;
+    };
+    std::vector<char> bytes = saveBytes(0xCD);
+    EXPECT_TRUE(bytes == saveBytes(0x5A));
+
+    dod::slot_map<int, dod::slot_map_key64<int>, 64, 0> loaded;
+    ASSERT_TRUE(loaded.load(path.c_str()));
+    EXPECT_EQ(loaded.size(), 9u);
+    std::filesystem::remove(path);
+}
+
+TEST(SlotMapTest, SnapshotLoad_Slow)
+{
+    static const size_t kNumElements = 20 * 1000 * 1000;
+    static const size_t kNumLookups = 1000;
+    const std::string path = getSnapshotPath("bench");
+
+    std::vector<dod::slot_map<uint64_t>::key> keys;
+    {
+        dod::slot_map<uint64_t> slotMap;
+        keys.reserve(kNumElements);
+        for (size_t i = 0; i < kNumElements; i++)
+        {
+            keys.emplace_back(slotMap.emplace(uint64_t(i)));
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        ASSERT_TRUE(slotMap.save(path.c_str()));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        printf("uint64_t x %zu, save: %8.2f ms\n", kNumElements, ms);
+    }
+
+    std::mt19937 rng(3);
+    std::vector<size_t> lookups(kNumLookups);
+    for (size_t& i : lookups)
+    {
+        i = rng() % kNumElements;
+    }
+
+    for (dod::load_mode mode : {dod::load_mode::copy, dod::load_mode::map})
+    {
+        dod::slot_map<uint64_t> slotMap;
+        auto t0 = std::chrono::steady_clock::now();
+        ASSERT_TRUE(slotMap.load(path.c_str(), mode));
+        double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+        uint64_t sum = 0;
+        t0 = std::chrono::steady_clock::now();
+        for (size_t i : lookups)
+        {
+            sum += *slotMap.get(keys[i]);
+        }
+        double lookupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        EXPECT_GT(sum, 0u);
+        printf("%-4s load: %8.2f ms, first %zu lookups: %8.2f ms\n", mode == dod::load_mode::copy ? "copy" : "map", loadMs, kNumLookups,
+               lookupMs);
+    }
+    std::filesystem::remove(path);
+}
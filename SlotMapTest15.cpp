@@ -0,0 +1,284 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <slot_map_vm.h>
+#include <string>
+
+template <> struct dod::slot_map_codec<std::string>
+{
+    template <typename WRITE> static bool encode(const std::string& value, WRITE& write)
+    {
+        uint32_t length = static_cast<uint32_t>(value.size());
+        return write(std::as_bytes(std::span<const uint32_t>(&length, 1))) && write(std::as_bytes(std::span<const char>(value)));
+    }
+
+    template <typename READ> static std::optional<std::string> decode(READ& read)
+    {
+        uint32_t length = 0;
+        if (!read(std::as_writable_bytes(std::span<uint32_t>(&length, 1))) || length > 1024 * 1024)
+        {
+            return std::nullopt;
+        }
+        std::string value(length, '\0');
+        if (!read(std::as_writable_bytes(std::span<char>(value))))
+        {
+            return std::nullopt;
+        }
+        return value;
+    }
+};
+
+struct StreamItem
+{
+    uint32_t id;
+    uint16_t flags;
+
+    bool operator==(const StreamItem& other) const { return id == other.id && flags == other.flags; }
+};
+
+// In-memory stream, maxReadSize limits how much of the stream can be read (a truncated stream)
+struct MemoryStream
+{
+    std::vector<std::byte> bytes;
+    size_t readCursor = 0;
+    size_t maxReadSize = SIZE_MAX;
+    size_t maxWriteSize = 0;
+
+    auto writer()
+    {
+        return [this](std::span<const std::byte> data)
+        {
+            bytes.insert(bytes.end(), data.begin(), data.end());
+            maxWriteSize = std::max(maxWriteSize, data.size());
+            return true;
+        };
+    }
+
+    auto reader()
+    {
+        readCursor = 0;
+        return [this](std::span<std::byte> dst)
+        {
+            if (dst.size() > std::min(bytes.size(), maxReadSize) - readCursor)
+            {
+                return false;
+            }
+            std::memcpy(dst.data(), bytes.data() + readCursor, dst.size());
+            readCursor += dst.size();
+            return true;
+        };
+    }
+};
+
+// Builds a map with holes, inactive slots (all the versions used) and a released page
+template <typename TSlotMap, typename MAKE> static std::vector<typename TSlotMap::key> fillForStream(TSlotMap& slotMap, MAKE&& makeValue)
+{
+    using key = typename TSlotMap::key;
+    std::vector<key> keys;
+    for (int i = 0; i < 2000; i++)
+    {
+        keys.emplace_back(slotMap.emplace(makeValue(i)));
+    }
+    while (key::toVersion(keys[3]) != key::kMaxVersion)
+    {
+        slotMap.erase(keys[3]);
+        keys[3] = slotMap.emplace(makeValue(3));
+    }
+    slotMap.erase(keys[3]);
+    for (size_t i = 0; i < keys.size(); i += 4)
+    {
+        slotMap.erase(keys[i]);
+    }
+    slotMap.set_release_empty_pages(true);
+    for (size_t i = 640; i < 704; i++)
+    {
+        slotMap.erase(keys[i]);
+    }
+    slotMap.set_release_empty_pages(false);
+    return keys;
+}
+
+template <typename TSlotMap, typename MAKE> static void checkStreamRoundTrip(MAKE&& makeValue)
+{
+    using key = typename TSlotMap::key;
+    TSlotMap slotMap;
+    std::vector<key> keys = fillForStream(slotMap, makeValue);
+    ASSERT_GT(slotMap.debug_stats().numReleasedPages, 0u);
+
+    MemoryStream stream;
+    ASSERT_TRUE(slotMap.save_stream(stream.writer()));
+
+    auto expectSameContent = [&](const TSlotMap& other)
+    {
+        EXPECT_EQ(other.size(), slotMap.size());
+        for (const key& k : keys)
+        {
+            const auto* value = slotMap.get(k);
+            const auto* otherValue = other.get(k);
+            ASSERT_EQ(value != nullptr, otherValue != nullptr);
+            if (value)
+            {
+                EXPECT_TRUE(*value == *otherValue);
+            }
+        }
+        auto stats = slotMap.debug_stats();
+        auto otherStats = other.debug_stats();
+        EXPECT_EQ(stats.numActivePages, otherStats.numActivePages);
+        EXPECT_EQ(stats.numReleasedPages, otherStats.numReleasedPages);
+        EXPECT_EQ(stats.numInactiveItems, otherStats.numInactiveItems);
+    };
+
+    for (bool useReservedRange : {false, true})
+    {
+        TSlotMap loaded;
+        ASSERT_TRUE(!useReservedRange || loaded.use_reserved_range(8192));
+        loaded.emplace(makeValue(-1));
+        ASSERT_TRUE(loaded.load_stream(stream.reader()));
+        EXPECT_EQ(stream.readCursor, stream.bytes.size());
+        expectSameContent(loaded);
+
+        // the free queue is restored: a map with the same history hands out the same keys from here on
+        TSlotMap reference;
+        fillForStream(reference, makeValue);
+        for (int i = 0; i < 2000; i++)
+        {
+            ASSERT_EQ(loaded.emplace(makeValue(5000 + i)), reference.emplace(makeValue(5000 + i)));
+        }
+
+        // a loaded map streams back to the same bytes
+        MemoryStream again;
+        TSlotMap reloaded;
+        ASSERT_TRUE(reloaded.load_stream(stream.reader()));
+        ASSERT_TRUE(reloaded.save_stream(again.writer()));
+        EXPECT_TRUE(again.bytes == stream.bytes);
+    }
+
+    // truncated streams leave an empty map (and no leaked values)
+    for (size_t size = 0; size < stream.bytes.size(); size += 1 + size / 4)
+    {
+        stream.maxReadSize = size;
+        TSlotMap truncated;
+        truncated.emplace(makeValue(-1));
+        EXPECT_FALSE(truncated.load_stream(stream.reader()));
+        EXPECT_TRUE(truncated.empty());
+        EXPECT_EQ(truncated.debug_stats().numPagesTotal, 0u);
+    }
+    stream.maxReadSize = stream.bytes.size() - 1;
+    TSlotMap truncated;
+    EXPECT_FALSE(truncated.load_stream(stream.reader()));
+
+    // a failing sink stops the stream
+    size_t numWrites = 0;
+    EXPECT_FALSE(slotMap.save_stream([&](std::span<const std::byte>) { return ++numWrites < 10; }));
+    EXPECT_EQ(numWrites, 10u);
+}
+
+TEST(SlotMapTest, Stream)
+{
+    auto makeItem = [](int i) { return StreamItem{uint32_t(i), uint16_t(i * 3)}; };
+    auto makeString = [](int i) { return std::string(size_t(i % 40 + 1), 's') + std::to_string(i); };
+    checkStreamRoundTrip<dod::slot_map<int, dod::slot_map_key32<int>, 64, 0>>([](int i) { return i; });
+    checkStreamRoundTrip<dod::interleaved_slot_map<StreamItem, dod::slot_map_key32<StreamItem>, 64, 0>>(makeItem);
+    checkStreamRoundTrip<dod::slot_map<std::string, dod::slot_map_key32<std::string>, 64, 0>>(makeString);
+    checkStreamRoundTrip<dod::interleaved_slot_map<std::string, dod::slot_map_key32<std::string>, 64>>(makeString);
+
+    // nothing is buffered: a write never exceeds the content of one page
+    dod::slot_map<uint64_t, dod::slot_map_key64<uint64_t>, 256> slotMap;
+    for (uint64_t i = 0; i < 100000; i++)
+    {
+        slotMap.emplace(i);
+    }
+    MemoryStream stream;
+    ASSERT_TRUE(slotMap.save_stream(stream.writer()));
+    EXPECT_LE(stream.maxWriteSize, 256 * sizeof(uint64_t));
+
+    // streams and snapshot files are not interchangeable, nor are different slot map types
+    const std::string path = (std::filesystem::temp_directory_path() / "slot_map_stream.bin").string();
+    ASSERT_TRUE(slotMap.save(path.c_str()));
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    decltype(slotMap) fromFile;
+    EXPECT_FALSE(fromFile.load_stream([&](std::span<std::byte> dst) { return std::fread(dst.data(), 1, dst.size(), file) == dst.size(); }));
+    std::fclose(file);
+    std::filesystem::remove(path);
+
+    dod::slot_map<uint64_t, dod::slot_map_key64<uint64_t>, 512> otherPageSize;
+    EXPECT_FALSE(otherPageSize.load_stream(stream.reader()));
+    EXPECT_TRUE(otherPageSize.empty());
+}
+
+TEST(SlotMapTest, StreamCorruptMeta)
+{
+    using slot_map_t = dod::slot_map<std::string, dod::slot_map_key32<std::string>, 64, 0>;
+    slot_map_t tombstone;
+    slot_map_t reusedTombstone;
+    std::vector<slot_map_t::key> keys;
+    for (int i = 0; i < 10; i++)
+    {
+        keys.emplace_back(tombstone.emplace(std::to_string(i)));
+        reusedTombstone.emplace(std::to_string(i));
+    }
+    tombstone.erase(keys[5]);
+    reusedTombstone.erase(keys[5]);
+    reusedTombstone.erase(reusedTombstone.emplace("reused"));
+
+    // the streams first differ in the version of slot 5, the alive flag is the top bit of its metadata
+    MemoryStream stream;
+    MemoryStream reusedStream;
+    ASSERT_TRUE(tombstone.save_stream(stream.writer()));
+    ASSERT_TRUE(reusedTombstone.save_stream(reusedStream.writer()));
+    ASSERT_EQ(stream.bytes.size(), reusedStream.bytes.size());
+    auto mismatch = std::mismatch(stream.bytes.begin(), stream.bytes.end(), reusedStream.bytes.begin());
+    ASSERT_NE(mismatch.first, stream.bytes.end());
+    size_t metaOffset = size_t(mismatch.first - stream.bytes.begin());
+    stream.bytes[metaOffset + sizeof(slot_map_t::version_t) - 1] |= std::byte{0x80};
+
+    // a slot that claims to be alive without an alive bit (and a constructed value) is rejected
+    slot_map_t loaded;
+    EXPECT_FALSE(loaded.load_stream(stream.reader()));
+    EXPECT_TRUE(loaded.empty());
+    ASSERT_TRUE(loaded.load_stream(reusedStream.reader()));
+    EXPECT_EQ(loaded.size(), 9u);
+    EXPECT_EQ(loaded.get(keys[5]), nullptr);
+}
+
+template <typename TValue, typename MAKE> static void measureStream(const char* name, size_t numElements, MAKE&& makeValue)
+{
+    const std::string path = (std::filesystem::temp_directory_path() / "slot_map_stream_bench.bin").string();
+    dod::slot_map<TValue> slotMap;
+    for (size_t i = 0; i < numElements; i++)
+    {
+        slotMap.emplace(makeValue(i));
+    }
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    ASSERT_NE(file, nullptr);
+    auto t0 = std::chrono::steady_clock::now();
+    bool isSaved =
+        slotMap.save_stream([&](std::span<const std::byte> data) { return std::fwrite(data.data(), 1, data.size(), file) == data.size(); });
+    double saveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    std::fclose(file);
+    ASSERT_TRUE(isSaved);
+
+    file = std::fopen(path.c_str(), "rb");
+    ASSERT_NE(file, nullptr);
+    dod::slot_map<TValue> loaded;
+    t0 = std::chrono::steady_clock::now();
+    bool isLoaded = loaded.load_stream([&](std::span<std::byte> dst) { return std::fread(dst.data(), 1, dst.size(), file) == dst.size(); });
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    std::fclose(file);
+    ASSERT_TRUE(isLoaded);
+    EXPECT_EQ(loaded.size(), slotMap.size());
+
+    printf("%-12s x %zu, stream size: %8.2f MB, save_stream: %8.2f ms, load_stream: %8.2f ms\n", name, numElements,
+           double(std::filesystem::file_size(path)) / (1024.0 * 1024.0), saveMs, loadMs);
+    std::filesystem::remove(path);
+}
+
+TEST(SlotMapTest, Stream_Slow)
+{
+    measureStream<uint64_t>("uint64_t", 20 * 1000 * 1000, [](size_t i) { return uint64_t(i); });
+    measureStream<std::string>("std::string", 2 * 1000 * 1000, [](size_t i) { return std::to_string(i) + std::string(24, 'x'); });
+}
@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <random>
+#include <slot_map.h>
+#include <string>
+
+struct DeltaName
+{
+    std::string text;
+
+    bool operator==(const DeltaName& other) const { return text == other.text; }
+};
+
+template <> struct dod::slot_map_codec<DeltaName>
+{
+    template <typename WRITE> static bool encode(const DeltaName& value, WRITE& write)
+    {
+        uint32_t length = static_cast<uint32_t>(value.text.size());
+        return write(std::as_bytes(std::span<const uint32_t>(&length, 1))) && write(std::as_bytes(std::span<const char>(value.text)));
+    }
+
+    template <typename READ> static std::optional<DeltaName> decode(READ& read)
+    {
+        uint32_t length = 0;
+        if (!read(std::as_writable_bytes(std::span<uint32_t>(&length, 1))) || length > 1024 * 1024)
+        {
+            return std::nullopt;
+        }
+        DeltaName value{std::string(length, '\0')};
+        if (!read(std::as_writable_bytes(std::span<char>(value.text))))
+        {
+            return std::nullopt;
+        }
+        return value;
+    }
+};
+
+// A delta in memory, maxReadSize simulates a connection that breaks in the middle of a delta
+struct DeltaBuffer
+{
+    std::vector<std::byte> bytes;
+    size_t readCursor = 0;
+    size_t maxReadSize = SIZE_MAX;
+
+    bool collect(auto& slotMap, bool full = false)
+    {
+        bytes.clear();
+        return slotMap.collect_delta(
+            [this](std::span<const std::byte> data)
+            {
+                bytes.insert(bytes.end(), data.begin(), data.end());
+                return true;
+            },
+            full);
+    }
+
+    bool apply(auto& slotMap)
+    {
+        readCursor = 0;
+        return slotMap.apply_delta(
+            [this](std::span<std::byte> dst)
+            {
+                if (dst.size() > std::min(bytes.size(), maxReadSize) - readCursor)
+                {
+                    return false;
+                }
+                std::memcpy(dst.data(), bytes.data() + readCursor, dst.size());
+                readCursor += dst.size();
+                return true;
+            });
+    }
+};
+
+template <typename TSlotMap>
+static void expectSameSlotMaps(const TSlotMap& primary, const TSlotMap& replica, const std::vector<typename TSlotMap::key>& keys)
+{
+    ASSERT_EQ(primary.size(), replica.size());
+    for (const auto& k : keys)
+    {
+        const auto* value = primary.get(k);
+        const auto* replicaValue = replica.get(k);
+        ASSERT_EQ(value != nullptr, replicaValue != nullptr);
+        if (value)
+        {
+            ASSERT_TRUE(*value == *replicaValue);
+        }
+    }
+    auto stats = primary.debug_stats();
+    auto replicaStats = replica.debug_stats();
+    EXPECT_EQ(stats.numPagesTotal, replicaStats.numPagesTotal);
+    EXPECT_EQ(stats.numActivePages, replicaStats.numActivePages);
+    EXPECT_EQ(stats.numReleasedPages, replicaStats.numReleasedPages);
+    EXPECT_EQ(stats.numTombstoneItems, replicaStats.numTombstoneItems);
+    EXPECT_EQ(stats.numInactiveItems, replicaStats.numInactiveItems);
+}
+
+template <typename TSlotMap, typename MAKE> static void checkDeltaReplication(MAKE&& makeValue)
+{
+    using key = typename TSlotMap::key;
+    std::mt19937 rng(11);
+    TSlotMap primary;
+    TSlotMap replica;
+    TSlotMap lateReplica;
+    std::vector<key> keys;
+    std::vector<key> aliveKeys;
+    DeltaBuffer delta;
+
+    // the first delta is a full one
+    ASSERT_TRUE(delta.collect(primary));
+    ASSERT_TRUE(delta.apply(replica));
+
+    for (int round = 0; round < 40; round++)
+    {
+        switch (round % 8)
+        {
+        case 0:
+        case 1:
+        case 2:
+            for (int i = 0; i < 300; i++)
+            {
+                keys.emplace_back(primary.emplace(makeValue(int(keys.size()))));
+                aliveKeys.emplace_back(keys.back());
+            }
+            break;
+        case 3:
+            for (int i = 0; i < 200 && !aliveKeys.empty(); i++)
+            {
+                size_t index = rng() % aliveKeys.size();
+                primary.erase(aliveKeys[index]);
+                aliveKeys[index] = aliveKeys.back();
+                aliveKeys.pop_back();
+            }
+            break;
+        case 4:
+            for (int i = 0; i < 20 && !aliveKeys.empty(); i++)
+            {
+                *primary.get(aliveKeys[rng() % aliveKeys.size()]) = makeValue(-int(i));
+            }
+            break;
+        case 5:
+            // empty pages are released, then compaction moves elements around
+            primary.set_release_empty_pages(true);
+            for (size_t i = 0; i < aliveKeys.size(); i++)
+            {
+                if (key::toIndex(aliveKeys[i]) % 256 < 128)
+                {
+                    primary.erase(aliveKeys[i]);
+                }
+            }
+            aliveKeys.erase(std::remove_if(aliveKeys.begin(), aliveKeys.end(), [&](const key& k) { return !primary.has_key(k); }),
+                            aliveKeys.end());
+            primary.compact(100,
+                            [&](key oldKey, key newKey)
+                            {
+                                *std::find(aliveKeys.begin(), aliveKeys.end(), oldKey) = newKey;
+                                keys.emplace_back(newKey);
+                            });
+            primary.set_release_empty_pages(false);
+            break;
+        case 6:
+            // a write through the iterators
+            for (const auto& [k, value] : primary.items())
+            {
+                if (key::toIndex(k) % 97 == 0)
+                {
+                    value.get() = makeValue(7);
+                }
+            }
+            break;
+        default:
+            if (round == 23)
+            {
+                primary.clear();
+                aliveKeys.clear();
+            }
+            break;
+        }
+
+        ASSERT_TRUE(delta.collect(primary));
+        ASSERT_TRUE(delta.apply(replica));
+        expectSameSlotMaps(primary, replica, keys);
+
+        // a replica that missed deltas is left untouched until it gets a full delta
+        if (round == 10)
+        {
+            EXPECT_FALSE(delta.apply(lateReplica));
+            EXPECT_TRUE(lateReplica.empty());
+            ASSERT_TRUE(delta.collect(primary, true));
+            ASSERT_TRUE(delta.apply(lateReplica));
+            ASSERT_TRUE(delta.apply(replica));
+            expectSameSlotMaps(primary, lateReplica, keys);
+        }
+        if (round > 10)
+        {
+            ASSERT_TRUE(delta.apply(lateReplica));
+        }
+    }
+    expectSameSlotMaps(primary, lateReplica, keys);
+
+    // an empty delta only carries the header and the released pages
+    ASSERT_TRUE(delta.collect(primary));
+    size_t emptyDeltaSize = delta.bytes.size();
+    ASSERT_TRUE(delta.apply(replica));
+    EXPECT_LT(emptyDeltaSize, 1024u);
+
+    // the free queue is replicated: both maps hand out the same keys from here on
+    for (int i = 0; i < 3000; i++)
+    {
+        key k = primary.emplace(makeValue(i));
+        ASSERT_EQ(k, replica.emplace(makeValue(i)));
+    }
+
+    // a broken delta leaves the replica empty, it needs a full delta to recover
+    ASSERT_TRUE(delta.collect(primary));
+    delta.maxReadSize = delta.bytes.size() / 2;
+    EXPECT_FALSE(delta.apply(replica));
+    EXPECT_TRUE(replica.empty());
+    delta.maxReadSize = SIZE_MAX;
+    EXPECT_FALSE(delta.apply(replica));
+    ASSERT_TRUE(delta.collect(primary, true));
+    ASSERT_TRUE(delta.apply(replica));
+    expectSameSlotMaps(primary, replica, keys);
+
+    // a failing sink makes the next delta a full one
+    EXPECT_FALSE(primary.collect_delta([](std::span<const std::byte>) { return false; }));
+    ASSERT_TRUE(delta.collect(primary));
+    ASSERT_TRUE(delta.apply(lateReplica));
+    expectSameSlotMaps(primary, lateReplica, keys);
+}
+
+TEST(SlotMapTest, DeltaReplication)
+{
+    checkDeltaReplication<dod::slot_map<int, dod::slot_map_key32<int>, 64, 0>>([](int i) { return i; });
+    checkDeltaReplication<dod::interleaved_slot_map<int, dod::slot_map_key32<int>, 64>>([](int i) { return i; });
+    checkDeltaReplication<dod::slot_map<DeltaName, dod::slot_map_key32<DeltaName>, 64, 0>>(
+        [](int i) { return DeltaName{std::string(size_t(i & 31), 'n') + std::to_string(i)}; });
+    checkDeltaReplication<dod::slot_map<int, dod::slot_map_key32<int>, 64, 0, stl::Allocator<int>, dod::slot_layout::split,
+                                        dod::slot_sharing::copy_on_write>>([](int i) { return i; });
+}
+
+TEST(SlotMapTest, DeltaDirtyPages)
+{
+    using slot_map_t = dod::slot_map<uint64_t, dod::slot_map_key64<uint64_t>, 256>;
+    slot_map_t primary;
+    slot_map_t replica;
+    std::vector<slot_map_t::key> keys;
+    for (uint64_t i = 0; i < 256 * 100; i++)
+    {
+        keys.emplace_back(primary.emplace(i));
+    }
+    DeltaBuffer delta;
+    ASSERT_TRUE(delta.collect(primary));
+    size_t fullSize = delta.bytes.size();
+    ASSERT_TRUE(delta.apply(replica));
+
+    // only the pages that were written to are sent
+    const slot_map_t& constPrimary = primary;
+    uint64_t sum = 0;
+    for (uint64_t value : constPrimary)
+    {
+        sum += value;
+    }
+    EXPECT_NE(constPrimary.get(keys[5]), nullptr);
+    EXPECT_EQ(primary.get(slot_map_t::key::invalid()), nullptr);
+    ASSERT_TRUE(delta.collect(primary));
+    EXPECT_LT(delta.bytes.size(), 1024u);
+    ASSERT_TRUE(delta.apply(replica));
+
+    *primary.get(keys[10]) = 1;
+    primary.erase(keys[256 * 50]);
+    ASSERT_TRUE(delta.collect(primary));
+    EXPECT_GT(delta.bytes.size(), 2 * 256 * sizeof(uint64_t));
+    EXPECT_LT(delta.bytes.size(), 3 * 256 * sizeof(uint64_t) + 1024);
+    EXPECT_LT(delta.bytes.size() * 20, fullSize);
+    ASSERT_TRUE(delta.apply(replica));
+    EXPECT_EQ(*replica.get(keys[10]), 1u);
+    EXPECT_FALSE(replica.has_key(keys[256 * 50]));
+    EXPECT_EQ(replica.size(), primary.size());
+
+    // non-const iteration touches every page with alive elements
+    for (uint64_t& value : primary)
+    {
+        sum += value;
+    }
+    ASSERT_TRUE(delta.collect(primary));
+    EXPECT_GT(delta.bytes.size() * 2, fullSize);
+    EXPECT_GT(sum, 0u);
+}
+
+TEST(SlotMapTest, DeltaReplication_Slow)
+{
+    static const size_t kNumElements = 10 * 1000 * 1000;
+    using slot_map_t = dod::slot_map<uint64_t>;
+    slot_map_t primary;
+    slot_map_t replica;
+    std::vector<slot_map_t::key> keys;
+    keys.reserve(kNumElements);
+    for (size_t i = 0; i < kNumElements; i++)
+    {
+        keys.emplace_back(primary.emplace(uint64_t(i)));
+    }
+    DeltaBuffer delta;
+    auto t0 = std::chrono::steady_clock::now();
+    ASSERT_TRUE(delta.collect(primary));
+    ASSERT_TRUE(delta.apply(replica));
+    double fullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    printf("uint64_t x %zu, full delta: %8.2f MB, %8.2f ms\n", kNumElements, double(delta.bytes.size()) / (1024.0 * 1024.0), fullMs);
+
+    std::mt19937 rng(5);
+    for (size_t numWrites : {100, 1000, 10000})
+    {
+        for (size_t i = 0; i < numWrites; i++)
+        {
+            *primary.get(keys[rng() % kNumElements]) += 1;
+        }
+        t0 = std::chrono::steady_clock::now();
+        ASSERT_TRUE(delta.collect(primary));
+        ASSERT_TRUE(delta.apply(replica));
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        printf("%6zu random writes, delta: %8.2f MB, %8.2f ms\n", numWrites, double(delta.bytes.size()) / (1024.0 * 1024.0), ms);
+    }
+    EXPECT_EQ(replica.size(), primary.size());
+}
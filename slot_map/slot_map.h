@@ -1,18 +1,33 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cstddef>
+#include <cstdio>
 #include <cstring>
-#include <deque>
+#include <exception>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <new>
 #include <optional>
+#include <span>
+#include <stdexcept>
 #include <stdint.h>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #include <inttypes.h>
 #define PRIslotkey PRIu64
 
-// You could override memory allocator by defining SLOT_MAP_ALLOC/SLOT_MAP_FREE macroses
+// You could override the default memory allocator (stl::Allocator) by defining SLOT_MAP_ALLOC/SLOT_MAP_FREE macroses
+// or use a custom allocator per slot map instance (see the TAllocator template parameter)
 #if !defined(SLOT_MAP_ALLOC) || !defined(SLOT_MAP_FREE)
 
 #if defined(_WIN32)
@@ -38,9 +53,21 @@
 #define SLOT_MAP_ASSERT(expression) assert(expression)
 #endif
 
+// You could override cache prefetch by defining SLOT_MAP_PREFETCH macro
+#if !defined(SLOT_MAP_PREFETCH)
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#define SLOT_MAP_PREFETCH(ptr) _mm_prefetch(reinterpret_cast<const char*>(ptr), _MM_HINT_T0)
+#else
+#define SLOT_MAP_PREFETCH(ptr) __builtin_prefetch(ptr)
+#endif
+#endif
+
 namespace stl
 {
 // STL compatible allocator
+// Alignment is the minimal alignment of allocations, rebound allocators keep it and never align below their own value type
+// (slot maps default to Allocator<T, alignof(void*)>, which allocates the same way but doesn't need T to be a complete type)
 // Note: some platforms (macOS) does not support alignments smaller than `alignof(void*)`
 template <class T, size_t Alignment = std::max(alignof(T), alignof(void*))> struct Allocator
 {
@@ -70,9 +97,10 @@ template <class T, size_t Alignment = std::max(alignof(T), alignof(void*))> stru
 
     pointer allocate(size_type n, [[maybe_unused]] const void* hint = 0)
     {
-        size_t alignment = Alignment;
-        n = std::max(n, alignment);
-        pointer p = reinterpret_cast<pointer>(SLOT_MAP_ALLOC((sizeof(value_type) * n), alignment));
+        size_t alignment = std::max({Alignment, alignof(value_type), alignof(void*)});
+        // aligned_alloc requires the size to be a multiple of the alignment
+        size_t numBytes = (sizeof(value_type) * std::max(n, size_type(1)) + alignment - 1) & ~(alignment - 1);
+        pointer p = reinterpret_cast<pointer>(SLOT_MAP_ALLOC(numBytes, alignment));
         SLOT_MAP_ASSERT(p);
         return p;
     }
@@ -104,6 +132,62 @@ bool operator!=(const Allocator<T1, Alignment>& /*lhs*/, const Allocator<T2, Ali
 namespace dod
 {
 
+// Thin wrappers over the platform virtual memory and file API, defined in slot_map_vm.h (so the OS headers stay out of this header).
+// Include slot_map_vm.h in the files that use huge_page_resource, use_reserved_range(), save() or load(), plain slot maps never
+// reference these functions.
+namespace vm
+{
+static inline constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+/*
+  Maps numBytes (a multiple of kHugePageSize) of zero-initialized read/write memory aligned to kHugePageSize.
+  Explicit huge pages are used if the system has them reserved (usesHugeTlb = true), otherwise normal pages
+  with a transparent huge pages hint. Returns nullptr on failure.
+*/
+inline void* map_huge(size_t numBytes, bool& usesHugeTlb) noexcept;
+
+// Returns the granularity of commit/discard
+inline size_t page_size() noexcept;
+
+// Reserves numBytes of address space without backing memory (inaccessible until committed). Returns nullptr on failure.
+inline void* reserve(size_t numBytes) noexcept;
+
+// Makes reserved memory readable/writable (zero-initialized on first touch)
+inline bool commit(void* p, size_t numBytes) noexcept;
+
+// Gives the physical memory of committed pages back to the system. The pages stay accessible, but their content is lost.
+inline void discard(void* p, size_t numBytes) noexcept;
+
+// Unmaps memory returned by map_huge() or reserve()
+inline void unmap(void* p, size_t numBytes) noexcept;
+
+/*
+  Maps a whole file copy-on-write: the memory is readable and writable, but writes are private and never reach the file.
+  Pages are read from the file on first access. Returns nullptr on failure (or for an empty file), numBytes receives the file size.
+*/
+inline void* map_file(const char* path, size_t& numBytes) noexcept;
+
+// Unmaps memory returned by map_file()
+inline void unmap_file(void* p, size_t numBytes) noexcept;
+
+// Flushes a file written through stdio down to the storage device
+inline bool sync_file(std::FILE* file) noexcept;
+
+// Renames a file, replacing an existing file at the target path. Mappings of the replaced file keep their content.
+inline bool replace_file(const char* from, const char* to) noexcept;
+
+// The calls behind a reserved range. Slot maps reach them through this table, which only use_reserved_range() fills in,
+// so the destructor and the page allocation don't reference the definitions in slot_map_vm.h
+struct range_api
+{
+    size_t (*page_size)() noexcept;
+    void* (*reserve)(size_t numBytes) noexcept;
+    bool (*commit)(void* p, size_t numBytes) noexcept;
+    void (*discard)(void* p, size_t numBytes) noexcept;
+    void (*unmap)(void* p, size_t numBytes) noexcept;
+};
+} // namespace vm
+
 /*
 Even though slot map keys are technically typeless (uint64_t), we artificially add a new type to get extra compiler checks.
 
@@ -116,93 +200,134 @@ const std::string* value = strings.get(numKey);
 ```
 */
 
+namespace detail
+{
+// the smallest unsigned integer type with at least NUMBITS bits
+template <size_t NUMBITS>
+using uint_least_bits_t =
+    std::conditional_t<(NUMBITS <= 8), uint8_t,
+                       std::conditional_t<(NUMBITS <= 16), uint16_t, std::conditional_t<(NUMBITS <= 32), uint32_t, uint64_t>>>;
+} // namespace detail
+
 /*
 
-64-bit key
+Key with a compile-time bit layout
 
-| Component      |  Number of bits        |
-| ---------------|------------------------|
-| tag            |  12                    |
-| version        |  20 (0..1,048,575      |
-| index          |  32 (0..4,294,967,295) |
+| Component      |  Number of bits     |
+| ---------------|---------------------|
+| tag            |  TAGBITS            |
+| version        |  VERSIONBITS        |
+| index          |  INDEXBITS          |
+
+The key is stored in the smallest unsigned integer that holds all the components, masks and shifts are generated at compile time.
+More version bits mean more reuses before a slot is retired, more index bits mean more elements per slot map.
+
+The slot map keeps two marker bits next to every slot version (see slot_map::Meta),
+so version_t is the smallest unsigned integer that holds VERSIONBITS + 2 bits.
 
 */
-template <typename T> struct slot_map_key64
+template <typename T, size_t INDEXBITS, size_t VERSIONBITS, size_t TAGBITS> struct slot_map_key
 {
-    using id_type = uint64_t;
-    using version_t = uint32_t;
+    static_assert(INDEXBITS >= 1 && INDEXBITS <= 32, "Index bits must be in the range [1..32]");
+    static_assert(VERSIONBITS >= 2 && VERSIONBITS <= 30, "Version bits must be in the range [2..30]");
+    static_assert(TAGBITS <= 16, "Tag bits must be in the range [0..16]");
+    static_assert(INDEXBITS + VERSIONBITS + TAGBITS <= 64, "Key components do not fit into 64 bits");
+
+    using id_type = detail::uint_least_bits_t<INDEXBITS + VERSIONBITS + TAGBITS>;
+    using version_t = detail::uint_least_bits_t<VERSIONBITS + 2>;
     using index_t = uint32_t;
-    using tag_t = uint16_t;
+    using tag_t = detail::uint_least_bits_t<(TAGBITS > 0) ? TAGBITS : 1>;
+
+    static inline constexpr size_t kIndexBits = INDEXBITS;
+    static inline constexpr size_t kVersionBits = VERSIONBITS;
+    static inline constexpr size_t kTagBits = TAGBITS;
 
     static inline constexpr version_t kInvalidVersion = 0x0u;
     static inline constexpr version_t kMinVersion = 0x1u;
-    static inline constexpr version_t kMaxVersion = 0x0fffffu;
-    static inline constexpr index_t kMaxIndex = 0xffffffffu;
-    static inline constexpr tag_t kMaxTag = 0x0fffu;
+    static inline constexpr version_t kMaxVersion = static_cast<version_t>((uint64_t(1) << VERSIONBITS) - 1);
+    static inline constexpr index_t kMaxIndex = static_cast<index_t>((uint64_t(1) << INDEXBITS) - 1);
+    static inline constexpr tag_t kMaxTag = static_cast<tag_t>((uint64_t(1) << TAGBITS) - 1);
 
-    static inline constexpr id_type kIndexMask = 0x00000000ffffffffull;
+    static inline constexpr id_type kIndexMask = static_cast<id_type>(kMaxIndex);
 
-    static inline constexpr id_type kVersionMask = 0x0fffff00000000ull;
-    static inline constexpr id_type kVersionShift = 32ull;
+    static inline constexpr id_type kVersionMask = static_cast<id_type>(uint64_t(kMaxVersion) << INDEXBITS);
+    static inline constexpr id_type kVersionShift = static_cast<id_type>(INDEXBITS);
 
-    static inline constexpr id_type kHandleTagMask = 0xfff0000000000000ull;
-    static inline constexpr id_type kHandleTagShift = 52ull;
+    static inline constexpr id_type kHandleTagMask = static_cast<id_type>(uint64_t(kMaxTag) << (INDEXBITS + VERSIONBITS));
+    static inline constexpr id_type kHandleTagShift = static_cast<id_type>(INDEXBITS + VERSIONBITS);
 
-    static inline constexpr slot_map_key64 make(version_t version, index_t index) noexcept
+    static_assert((kIndexMask & kVersionMask) == 0 && (kIndexMask & kHandleTagMask) == 0 && (kVersionMask & kHandleTagMask) == 0,
+                  "Key components overlap");
+
+    static inline constexpr slot_map_key make(version_t version, index_t index) noexcept
     {
         SLOT_MAP_ASSERT(version != kInvalidVersion);
         SLOT_MAP_ASSERT(index <= kMaxIndex);
-        id_type v = (static_cast<id_type>(version) << kVersionShift) & kVersionMask;
-        id_type i = (static_cast<id_type>(index)) & kIndexMask;
-        return slot_map_key64{v | i};
+        id_type v = static_cast<id_type>((static_cast<id_type>(version) << kVersionShift) & kVersionMask);
+        id_type i = static_cast<id_type>(static_cast<id_type>(index) & kIndexMask);
+        return slot_map_key{static_cast<id_type>(v | i)};
     }
 
     inline size_t hash() const noexcept { return std::hash<id_type>{}(raw); }
 
-    static inline slot_map_key64 clearTagAndUpdateVersion(slot_map_key64 key, version_t version) noexcept
+    static inline slot_map_key clearTagAndUpdateVersion(slot_map_key key, version_t version) noexcept
     {
         SLOT_MAP_ASSERT(version != kInvalidVersion);
-        id_type ver = (static_cast<id_type>(version) << kVersionShift) & kVersionMask;
-        return slot_map_key64{((key.raw & (~kVersionMask)) | ver) & (~kHandleTagMask)};
+        id_type ver = static_cast<id_type>((static_cast<id_type>(version) << kVersionShift) & kVersionMask);
+        id_type rest = static_cast<id_type>(key.raw & static_cast<id_type>(~(kVersionMask | kHandleTagMask)));
+        return slot_map_key{static_cast<id_type>(rest | ver)};
     }
-    static inline index_t toIndex(slot_map_key64 key) noexcept { return static_cast<index_t>(key.raw & kIndexMask); }
-    static inline version_t toVersion(slot_map_key64 key) noexcept
+    static inline index_t toIndex(slot_map_key key) noexcept { return static_cast<index_t>(key.raw & kIndexMask); }
+    static inline version_t toVersion(slot_map_key key) noexcept
     {
         return static_cast<version_t>((key.raw & kVersionMask) >> kVersionShift);
     }
-    static inline version_t increaseVersion(version_t version) noexcept { return (version + 1); }
+    static inline version_t increaseVersion(version_t version) noexcept { return static_cast<version_t>(version + 1); }
 
     inline tag_t get_tag() const noexcept { return static_cast<tag_t>((raw & kHandleTagMask) >> kHandleTagShift); }
     inline void set_tag(tag_t tag) noexcept
     {
         SLOT_MAP_ASSERT(tag <= kMaxTag);
-        id_type ud = (static_cast<id_type>(tag) << kHandleTagShift) & kHandleTagMask;
-        raw = ((raw & (~kHandleTagMask)) | ud);
+        id_type ud = static_cast<id_type>((static_cast<uint64_t>(tag) << kHandleTagShift) & kHandleTagMask);
+        raw = static_cast<id_type>((raw & static_cast<id_type>(~kHandleTagMask)) | ud);
     }
 
-    slot_map_key64() noexcept = default;
-    explicit slot_map_key64(id_type raw) noexcept
+    slot_map_key() noexcept = default;
+    explicit slot_map_key(id_type raw) noexcept
         : raw(raw)
     {
     }
-    slot_map_key64(const slot_map_key64&) noexcept = default;
-    slot_map_key64& operator=(const slot_map_key64&) noexcept = default;
-    slot_map_key64(slot_map_key64&&) noexcept = default;
-    slot_map_key64& operator=(slot_map_key64&&) noexcept = default;
+    slot_map_key(const slot_map_key&) noexcept = default;
+    slot_map_key& operator=(const slot_map_key&) noexcept = default;
+    slot_map_key(slot_map_key&&) noexcept = default;
+    slot_map_key& operator=(slot_map_key&&) noexcept = default;
 
-    bool operator==(const slot_map_key64& other) const noexcept { return raw == other.raw; }
-    bool operator<(const slot_map_key64& other) const noexcept { return raw < other.raw; }
+    bool operator==(const slot_map_key& other) const noexcept { return raw == other.raw; }
+    bool operator<(const slot_map_key& other) const noexcept { return raw < other.raw; }
 
     // explicit conversion to id_type (useful for printing and debug)
     explicit operator id_type() const noexcept { return raw; }
 
-    static inline slot_map_key64 invalid() noexcept { return slot_map_key64{0}; }
+    static inline slot_map_key invalid() noexcept { return slot_map_key{0}; }
 
     id_type raw;
 };
 
 /*
 
+64-bit key
+
+| Component      |  Number of bits        |
+| ---------------|------------------------|
+| tag            |  12                    |
+| version        |  20 (0..1,048,575      |
+| index          |  32 (0..4,294,967,295) |
+
+*/
+template <typename T> using slot_map_key64 = slot_map_key<T, 32, 20, 12>;
+
+/*
+
 32-bit key
 
 | Component      |  Number of bits     |
@@ -212,84 +337,95 @@ template <typename T> struct slot_map_key64
 | index          |  20 (0..1,048,576)  |
 
 */
-template <typename T> struct slot_map_key32
-{
-    using id_type = uint32_t;
-    using version_t = uint16_t;
-    using index_t = uint32_t;
-    using tag_t = uint8_t;
-
-    static inline constexpr version_t kInvalidVersion = 0x0u;
-    static inline constexpr version_t kMinVersion = 0x1u;
-    static inline constexpr version_t kMaxVersion = 0x03ffu;
-    static inline constexpr index_t kMaxIndex = 0x000fffffu;
-    static inline constexpr tag_t kMaxTag = 0x03u;
+template <typename T> using slot_map_key32 = slot_map_key<T, 20, 10, 2>;
 
-    static inline constexpr id_type kIndexMask = 0x0fffffull;
-
-    static inline constexpr id_type kVersionMask = 0x3ff00000ull;
-    static inline constexpr id_type kVersionShift = 20ull;
+/*
 
-    static inline constexpr id_type kHandleTagMask = 0xc0000000ull;
-    static inline constexpr id_type kHandleTagShift = 30ull;
+16-bit key for tiny slot maps
 
-    static inline constexpr slot_map_key32 make(version_t version, index_t index) noexcept
-    {
-        SLOT_MAP_ASSERT(version != kInvalidVersion);
-        SLOT_MAP_ASSERT(index <= kMaxIndex);
-        id_type v = (static_cast<id_type>(version) << kVersionShift) & kVersionMask;
-        id_type i = (static_cast<id_type>(index)) & kIndexMask;
-        return slot_map_key32{v | i};
-    }
+| Component      |  Number of bits     |
+| ---------------|---------------------|
+| tag            |  0                  |
+| version        |  6 (0..63)          |
+| index          |  10 (0..1023)       |
 
-    inline size_t hash() const noexcept { return std::hash<id_type>{}(raw); }
+*/
+template <typename T> using slot_map_key16 = slot_map_key<T, 10, 6, 0>;
 
-    static inline slot_map_key32 clearTagAndUpdateVersion(slot_map_key32 key, version_t version) noexcept
-    {
-        SLOT_MAP_ASSERT(version != kInvalidVersion);
-        id_type ver = (static_cast<id_type>(version) << kVersionShift) & kVersionMask;
-        return slot_map_key32{((key.raw & (~kVersionMask)) | ver) & (~kHandleTagMask)};
-    }
-    static inline index_t toIndex(slot_map_key32 key) noexcept { return static_cast<index_t>(key.raw & kIndexMask); }
-    static inline version_t toVersion(slot_map_key32 key) noexcept
-    {
-        return static_cast<version_t>((key.raw & kVersionMask) >> kVersionShift);
-    }
-    static inline version_t increaseVersion(version_t version) noexcept { return (version + 1); }
+/*
+  Slot storage layout of a slot map (picked per instantiation)
+
+  split       - values and slot metadata live in two separate arrays per page.
+                Values are dense, which is best for iteration and required by for_each_chunk.
+  interleaved - every slot stores its metadata right in front of its value ({Meta, T} pairs).
+                A lookup reads the version and the value from the same cache line (for small enough T),
+                at the cost of padding per slot and a wider stride on iteration.
+                This pays off for random lookups into maps well beyond the last-level cache (1.1-1.6x faster get() for T up to
+                64 bytes in SlotLayoutCrossover_Slow), while the two layouts perform about the same when the map fits in the cache.
+*/
+enum class slot_layout
+{
+    split,
+    interleaved
+};
 
-    inline tag_t get_tag() const noexcept { return static_cast<tag_t>((raw & kHandleTagMask) >> kHandleTagShift); }
-    inline void set_tag(tag_t tag) noexcept
-    {
-        SLOT_MAP_ASSERT(tag <= kMaxTag);
-        id_type ud = (static_cast<id_type>(tag) << kHandleTagShift) & kHandleTagMask;
-        raw = ((raw & (~kHandleTagMask)) | ud);
-    }
+/*
+  Page ownership of a slot map (picked per instantiation)
+
+  exclusive     - every slot map owns its pages, a copy is a deep copy of all the elements.
+  copy_on_write - pages are reference counted and shared between a slot map and its copies, so a copy (snapshot) costs O(pages).
+                  The first write to a shared page (emplace, erase, non-const access) copies that page privately,
+                  so memory grows with the write set only. Costs one reference count check per write.
+                  Pointer stability is weaker: the private copy lives at a new address, so pointers and references to values
+                  taken before a copy of the slot map are invalidated by the first write to their page after that copy
+                  (they keep pointing into the block the other slot maps still share). Get them again after copying.
+*/
+enum class slot_sharing
+{
+    exclusive,
+    copy_on_write
+};
 
-    slot_map_key32() noexcept = default;
-    explicit slot_map_key32(id_type raw) noexcept
-        : raw(raw)
-    {
-    }
-    slot_map_key32(const slot_map_key32&) noexcept = default;
-    slot_map_key32& operator=(const slot_map_key32&) noexcept = default;
-    slot_map_key32(slot_map_key32&&) noexcept = default;
-    slot_map_key32& operator=(slot_map_key32&&) noexcept = default;
+/*
+  How slot_map::load() brings the pages of a snapshot file into memory
 
-    bool operator==(const slot_map_key32& other) const noexcept { return raw == other.raw; }
-    bool operator<(const slot_map_key32& other) const noexcept { return raw < other.raw; }
+  copy - pages are read into regular page memory (the file can be deleted right after loading).
+  map  - the file is memory-mapped copy-on-write and the pages point straight into the mapping. Loading costs O(pages),
+         page memory is faulted in on first access and writes never reach the file.
+*/
+enum class load_mode
+{
+    copy,
+    map
+};
 
-    // explicit conversion to id_type (useful for printing and debug)
-    explicit operator id_type() const noexcept { return raw; }
+/*
+  Customization point: element encoding for slot_map::save_stream() / load_stream().
+  Trivially copyable types are streamed as raw page memory, other types need a specialization, i.e.
 
-    static inline slot_map_key32 invalid() noexcept { return slot_map_key32{0}; }
+    template <> struct dod::slot_map_codec<std::string>
+    {
+        // write(std::span<const std::byte>) -> bool
+        template <typename WRITE> static bool encode(const std::string& value, WRITE& write);
+        // read(std::span<std::byte>) -> bool, has to read exactly the bytes written by encode, std::nullopt on errors
+        template <typename READ> static std::optional<std::string> decode(READ& read);
+    };
+*/
+template <typename T> struct slot_map_codec;
 
-    id_type raw;
+/*
+  Customization point: types that can be moved to another address with memcpy (without calling move constructor + destructor).
+  Used by slot_map::compact(), specialize it for your own types if they are safe to relocate bitwise.
+*/
+template <typename T> struct is_trivially_relocatable : std::is_trivially_copyable<T>
+{
 };
 
 /*
   A slot map is a high-performance associative container with persistent unique keys to access stored values. Upon insertion, a key is
   returned that can be used to later access or remove the values. Insertion, removal, and access are all guaranteed to take O(1) time (best,
   worst, and average case) Great for storing collections of objects that need stable, safe references but have no clear ownership.
+  (slot_sharing::copy_on_write slot maps move pages on the first write after a copy, see slot_sharing)
 
   The difference between a std::unordered_map and a slot map is that the slot map generates and returns the key when inserting a value. A
   key is always unique and will only refer to the value that was inserted.
@@ -360,7 +496,10 @@ template <typename T> struct slot_map_key32
   Init, Update, Draw - Data Arrays, 2012
   https://greysphere.tumblr.com/post/31601463396/data-arrays
 */
-template <typename T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4096, size_t MINFREEINDICES = 64> class slot_map
+template <typename T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4096, size_t MINFREEINDICES = 64,
+          typename TAllocator = stl::Allocator<T, alignof(void*)>, slot_layout LAYOUT = slot_layout::split,
+          slot_sharing SHARING = slot_sharing::exclusive>
+class slot_map
 {
   public:
     using key = TKeyType;
@@ -368,6 +507,10 @@ template <typename T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4
     using index_t = typename TKeyType::index_t;
     using tag_t = typename TKeyType::tag_t;
     using size_type = uint32_t;
+    using allocator_type = TAllocator;
+
+    static inline constexpr slot_layout kLayout = LAYOUT;
+    static inline constexpr slot_sharing kSharing = SHARING;
 
     /*
         kPageSize = 4096 (default)
@@ -396,33 +539,121 @@ template <typename T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4
     */
     static inline constexpr size_type kMinFreeIndices = static_cast<size_type>(MINFREEINDICES);
 
+    /*
+        kLookupPrefetchDistance = 16
+
+        Batched lookups (get_many/has_key_many) prefetch the Meta of a key this many keys before they check it,
+        so the cache misses of several keys overlap instead of stalling one by one.
+    */
+    static inline constexpr size_t kLookupPrefetchDistance = 16;
+
+    /*
+        kDefaultPageCacheCapacity = 1
+
+        The number of freed page blocks a slot map keeps for reuse by default (see set_page_cache_capacity).
+        One block is enough to absorb a workload that oscillates around a page boundary.
+    */
+    static inline constexpr size_type kDefaultPageCacheCapacity = 1;
+
   private:
+    using AllocatorTraits = std::allocator_traits<TAllocator>;
+    template <typename U> using RebindAllocator = typename AllocatorTraits::template rebind_alloc<U>;
+    static_assert(std::is_pointer<typename AllocatorTraits::pointer>::value, "Allocators with fancy pointers are not supported");
+
     struct ValueStorage
     {
         std::byte data[sizeof(T)];
     };
 
+    /*
+      Packed slot metadata: version and both markers share a single version_t word
+
+      | Bits           | Meaning                                      |
+      |----------------|----------------------------------------------|
+      | top bit        | alive (inverted tombstone marker)            |
+      | top bit - 1    | inactive (version overflow)                  |
+      | the rest       | version (0 is reserved for kInvalidVersion)  |
+
+      The tombstone marker is stored inverted, so zeroed metadata reads as a dead slot
+      and "alive with version V" is a single compare against getAliveWord(V).
+    */
     struct Meta
     {
-        version_t version; // note: 0 is reserved for kInvalidVersion
-        uint8_t tombstone; // note: we only need 1 bit for tombstone marker
-        uint8_t inactive;  // note: we only need 1 bit for inactive marker
+        static inline constexpr version_t kAliveFlag = static_cast<version_t>(version_t(1) << (sizeof(version_t) * 8 - 1));
+        static inline constexpr version_t kInactiveFlag = static_cast<version_t>(kAliveFlag >> 1);
+        static inline constexpr version_t kVersionMask = static_cast<version_t>(kInactiveFlag - 1);
+        static_assert(key::kMaxVersion <= kVersionMask, "Not enough bits to pack version and markers");
+
+        version_t bits;
+
+        static constexpr version_t getAliveWord(version_t version) noexcept { return static_cast<version_t>(version | kAliveFlag); }
+
+        version_t getVersion() const noexcept { return static_cast<version_t>(bits & kVersionMask); }
+        bool isTombstone() const noexcept { return (bits & kAliveFlag) == 0; }
+        bool isInactive() const noexcept { return (bits & kInactiveFlag) != 0; }
+        bool isAlive(version_t version) const noexcept { return bits == getAliveWord(version); }
+
+        void setAlive(version_t version) noexcept { bits = getAliveWord(version); }
+        void setTombstone(version_t version) noexcept { bits = version; }
+        void setInactive(version_t version) noexcept { bits = static_cast<version_t>(version | kInactiveFlag); }
+    };
+
+    // slot_layout::interleaved: a single slot, the value follows its metadata
+    struct InterleavedSlot
+    {
+        Meta meta;
+        alignas(T) ValueStorage value;
     };
 
+    // Distance in bytes between the values (metadata) of two neighbour slots
+    static constexpr size_t getValueStride() noexcept
+    {
+        return (kLayout == slot_layout::interleaved) ? sizeof(InterleavedSlot) : sizeof(ValueStorage);
+    }
+    static constexpr size_t getMetaStride() noexcept
+    {
+        return (kLayout == slot_layout::interleaved) ? sizeof(InterleavedSlot) : sizeof(Meta);
+    }
+
+    // Slot accessors, values/meta point to the first slot of a page (or of the reserved range)
+    static ValueStorage* valueAt(ValueStorage* values, size_t index) noexcept
+    {
+        return reinterpret_cast<ValueStorage*>(reinterpret_cast<char*>(values) + index * getValueStride());
+    }
+    static Meta* metaAt(Meta* meta, size_t index) noexcept
+    {
+        return reinterpret_cast<Meta*>(reinterpret_cast<char*>(meta) + index * getMetaStride());
+    }
+
+    // one bit per slot, set for alive (non-tombstone) slots
+    static inline constexpr size_type kAliveWordsPerPage = (kPageSize + 63) / 64;
+
+    using PageRefCount = std::atomic<uint32_t>;
+
     struct Page
     {
         void* rawMemory;
         ValueStorage* values;
         Meta* meta;
+        uint64_t* alive;
         size_type numInactiveSlots;
         size_type numUsedElements;
+        size_type numAliveSlots;
+        // released pages only: the lowest version that was never handed out on any slot of this page
+        version_t releasedVersion;
+        // the page changed since the last collect_delta() (new pages are dirty)
+        bool isDirty;
 
         Page() noexcept
             : rawMemory(nullptr)
             , values(nullptr)
             , meta(nullptr)
+            , alive(nullptr)
             , numInactiveSlots(0)
             , numUsedElements(0)
+            , numAliveSlots(0)
+            , releasedVersion(key::kInvalidVersion)
+            , isDirty(true)
         {
         }
 
@@ -433,49 +664,98 @@ template <typename T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4
             : rawMemory(nullptr)
             , values(nullptr)
             , meta(nullptr)
+            , alive(nullptr)
             , numInactiveSlots(0)
             , numUsedElements(0)
+            , numAliveSlots(0)
+            , releasedVersion(key::kInvalidVersion)
+            , isDirty(other.isDirty)
         {
             std::swap(rawMemory, other.rawMemory);
             std::swap(meta, other.meta);
             std::swap(values, other.values);
+            std::swap(alive, other.alive);
             std::swap(numInactiveSlots, other.numInactiveSlots);
             std::swap(numUsedElements, other.numUsedElements);
+            std::swap(numAliveSlots, other.numAliveSlots);
+            std::swap(releasedVersion, other.releasedVersion);
         }
-        ~Page() { deallocate(); }
+        // page memory is owned by the slot map (see freePage)
+        ~Page() { SLOT_MAP_ASSERT(!rawMemory); }
 
-        void deallocate()
+        // Detaches and returns the page memory block (without releasing it)
+        void* detach() noexcept
         {
-            if (!rawMemory)
-            {
-                SLOT_MAP_ASSERT(!values);
-                SLOT_MAP_ASSERT(!meta);
-                return;
-            }
+            SLOT_MAP_ASSERT(rawMemory);
             SLOT_MAP_ASSERT(values);
             SLOT_MAP_ASSERT(meta);
-
-            SLOT_MAP_FREE(rawMemory);
+            void* block = rawMemory;
             rawMemory = nullptr;
             values = nullptr;
             meta = nullptr;
+            alive = nullptr;
+            return block;
         }
 
-        void allocate()
+        // Size in bytes of the values and meta of a page (both arrays or the interleaved slots)
+        static constexpr size_type getSlotsSize() noexcept
         {
-            SLOT_MAP_ASSERT(!rawMemory);
-            SLOT_MAP_ASSERT(!values);
-            SLOT_MAP_ASSERT(!meta);
+            if constexpr (kLayout == slot_layout::interleaved)
+            {
+                return static_cast<size_type>(sizeof(InterleavedSlot)) * kPageSize;
+            }
+            else
+            {
+                size_type metaSize = static_cast<size_type>(sizeof(Meta)) * kPageSize;
+                return getMetaOffset() + metaSize;
+            }
+        }
+
+        static constexpr size_type getValuesOffset() noexcept
+        {
+            if constexpr (kLayout == slot_layout::interleaved)
+            {
+                return static_cast<size_type>(offsetof(InterleavedSlot, value));
+            }
+            else
+            {
+                return 0;
+            }
+        }
+
+        static constexpr size_type getMetaOffset() noexcept
+        {
+            if constexpr (kLayout == slot_layout::interleaved)
+            {
+                return static_cast<size_type>(offsetof(InterleavedSlot, meta));
+            }
+            else
+            {
+                size_type dataSize = static_cast<size_type>(sizeof(ValueStorage)) * kPageSize;
+                return align(dataSize, static_cast<size_type>(alignof(Meta)));
+            }
+        }
+
+        static constexpr size_type getAliveOffset() noexcept { return align(getSlotsSize(), static_cast<size_type>(alignof(uint64_t))); }
+
+        // slot_sharing::copy_on_write only: the number of slot maps sharing the block follows the alive bits
+        static constexpr size_type getRefCountOffset() noexcept
+        {
+            size_type aliveSize = static_cast<size_type>(sizeof(uint64_t)) * kAliveWordsPerPage;
+            return align(getAliveOffset() + aliveSize, static_cast<size_type>(alignof(PageRefCount)));
+        }
 
-            size_type metaSize = static_cast<size_type>(sizeof(Meta)) * kPageSize;
-            size_type dataSize = static_cast<size_type>(sizeof(ValueStorage)) * kPageSize;
-            size_type alignedDataSize = align(dataSize, static_cast<size_type>(alignof(Meta)));
+        static constexpr size_type getBlockAlignment() noexcept
+        {
             size_type alignment = std::max(static_cast<size_type>(alignof(Meta)), static_cast<size_type>(alignof(T)));
             // some platforms (macOS) does not support alignments smaller than `alignof(void*)`
             // and 16 bytes seem like a nice compromise
-            alignment = std::max(alignment, 16u);
-            size_type numBytes = alignedDataSize + metaSize;
+            return std::max(alignment, 16u);
+        }
 
+        static constexpr size_type getBlockSize() noexcept
+        {
+            size_type aliveSize = static_cast<size_type>(sizeof(uint64_t)) * kAliveWordsPerPage;
             /*
               C++11 std::aligned_alloc
 
@@ -483,523 +763,3930 @@ template <typename T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4
               implementation causes the function to fail and return a null pointer (C11, as published, specified undefined behavior in
               this case, this was corrected by DR 460)
             */
-            numBytes = align(numBytes, alignment);
-            SLOT_MAP_ASSERT((numBytes % alignment) == 0);
-            rawMemory = SLOT_MAP_ALLOC(static_cast<size_t>(numBytes), static_cast<size_t>(alignment));
+            size_type numBytes = align(getAliveOffset() + aliveSize, getBlockAlignment());
+            if constexpr (kSharing == slot_sharing::copy_on_write)
+            {
+                numBytes = align(getRefCountOffset() + static_cast<size_type>(sizeof(PageRefCount)), getBlockAlignment());
+            }
+            SLOT_MAP_ASSERT((numBytes % getBlockAlignment()) == 0);
+            return numBytes;
+        }
+
+        // Attaches a memory block of getBlockSize() bytes to an empty page
+        void assign(void* block)
+        {
+            SLOT_MAP_ASSERT(block);
+            char* bytes = reinterpret_cast<char*>(block);
+            assign(reinterpret_cast<ValueStorage*>(bytes + getValuesOffset()), reinterpret_cast<Meta*>(bytes + getMetaOffset()),
+                   reinterpret_cast<uint64_t*>(bytes + getAliveOffset()));
+            if constexpr (kSharing == slot_sharing::copy_on_write)
+            {
+                new (bytes + getRefCountOffset()) PageRefCount(1);
+            }
+        }
+
+        // Attaches a block that already holds the content of a page (see load), the counters are restored by the caller
+        void attach(void* block) noexcept
+        {
+            SLOT_MAP_ASSERT(!rawMemory);
+            char* bytes = reinterpret_cast<char*>(block);
+            rawMemory = block;
+            values = reinterpret_cast<ValueStorage*>(bytes + getValuesOffset());
+            meta = reinterpret_cast<Meta*>(bytes + getMetaOffset());
+            alive = reinterpret_cast<uint64_t*>(bytes + getAliveOffset());
+            SLOT_MAP_ASSERT(isPointerAligned(values, alignof(T)));
+            SLOT_MAP_ASSERT(isPointerAligned(meta, alignof(Meta)));
+        }
+
+        // Size in bytes of the part of a block that holds the page content (values, meta and alive bits)
+        static constexpr size_type getContentSize() noexcept
+        {
+            return getAliveOffset() + static_cast<size_type>(sizeof(uint64_t)) * kAliveWordsPerPage;
+        }
+
+        // Attaches the block of another page to an empty page (slot_sharing::copy_on_write), both pages share it from now on
+        void share(const Page& other) noexcept
+        {
+            SLOT_MAP_ASSERT(!rawMemory);
+            SLOT_MAP_ASSERT(other.rawMemory);
+            other.getRefCount().fetch_add(1, std::memory_order_relaxed);
+            rawMemory = other.rawMemory;
+            values = other.values;
+            meta = other.meta;
+            alive = other.alive;
+            numInactiveSlots = other.numInactiveSlots;
+            numUsedElements = other.numUsedElements;
+            numAliveSlots = other.numAliveSlots;
+            releasedVersion = other.releasedVersion;
+        }
+
+        PageRefCount& getRefCount() const noexcept
+        {
+            static_assert(kSharing == slot_sharing::copy_on_write, "Only shared pages are reference counted");
             SLOT_MAP_ASSERT(rawMemory);
+            return *std::launder(reinterpret_cast<PageRefCount*>(reinterpret_cast<char*>(rawMemory) + getRefCountOffset()));
+        }
+
+        // a shared page can be read, but must be copied before the first write (see beginPageWrite)
+        bool isShared() const noexcept
+        {
+            if constexpr (kSharing == slot_sharing::copy_on_write)
+            {
+                return rawMemory && getRefCount().load(std::memory_order_acquire) != 1;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        // Exchanges the blocks and the counters (the dirty flag belongs to the page table entry and stays)
+        void swap(Page& other) noexcept
+        {
+            std::swap(rawMemory, other.rawMemory);
+            std::swap(values, other.values);
+            std::swap(meta, other.meta);
+            std::swap(alive, other.alive);
+            std::swap(numInactiveSlots, other.numInactiveSlots);
+            std::swap(numUsedElements, other.numUsedElements);
+            std::swap(numAliveSlots, other.numAliveSlots);
+            std::swap(releasedVersion, other.releasedVersion);
+        }
+
+        // Attaches separate values/meta/alive arrays (of kPageSize elements each) to an empty page
+        void assign(ValueStorage* _values, Meta* _meta, uint64_t* _alive)
+        {
+            SLOT_MAP_ASSERT(!rawMemory);
+            SLOT_MAP_ASSERT(!values);
+            SLOT_MAP_ASSERT(!meta);
 
+            // the slots of a page start at rawMemory (the first value or the first interleaved slot)
+            rawMemory = reinterpret_cast<char*>(_values) - getValuesOffset();
             numInactiveSlots = 0;
             numUsedElements = 0;
-            values = reinterpret_cast<ValueStorage*>(rawMemory);
-            meta = reinterpret_cast<Meta*>(reinterpret_cast<char*>(rawMemory) + alignedDataSize);
+            numAliveSlots = 0;
+            releasedVersion = key::kInvalidVersion;
+            values = _values;
+            meta = _meta;
+            alive = _alive;
+            std::memset(alive, 0, sizeof(uint64_t) * kAliveWordsPerPage);
 
-            // TODO: remove rawMemory member
-            SLOT_MAP_ASSERT(values == rawMemory);
             SLOT_MAP_ASSERT(values);
             SLOT_MAP_ASSERT(meta);
             SLOT_MAP_ASSERT(isPointerAligned(values, alignof(T)));
             SLOT_MAP_ASSERT(isPointerAligned(meta, alignof(Meta)));
+            SLOT_MAP_ASSERT(isPointerAligned(alive, alignof(uint64_t)));
+        }
+
+        bool isReleased() const noexcept { return meta == nullptr && releasedVersion != key::kInvalidVersion; }
+
+        void setAlive(size_type index) noexcept
+        {
+            alive[index / 64] |= (uint64_t(1) << (index % 64));
+            numAliveSlots++;
+        }
+
+        void clearAlive(size_type index) noexcept
+        {
+            alive[index / 64] &= ~(uint64_t(1) << (index % 64));
+            SLOT_MAP_ASSERT(numAliveSlots > 0);
+            numAliveSlots--;
         }
     };
 
-    static inline size_type align(size_type cursor, size_type alignment) noexcept { return (cursor + (alignment - 1)) & ~(alignment - 1); }
-    static inline bool isPointerAligned(const void* cursor, size_t alignment) noexcept
+    // Allocators are only exchanged if they propagate on swap, otherwise they are required to be equal (as for std containers)
+    template <typename ALLOCATOR> static void swapAllocators(ALLOCATOR& a, ALLOCATOR& b) noexcept
     {
-        return (uintptr_t(cursor) & (alignment - 1)) == 0;
+        if constexpr (std::allocator_traits<ALLOCATOR>::propagate_on_container_swap::value)
+        {
+            using std::swap;
+            swap(a, b);
+        }
+        else
+        {
+            SLOT_MAP_ASSERT(a == b);
+        }
     }
 
-    template <typename TYPE, class... Args> static void construct(void* mem, Args&&... args)
+    /*
+      FIFO of recycled keys (oldest first).
+      A power-of-two ring buffer that only grows (until reset), so steady erase/emplace churn never touches the allocator.
+    */
+    class FreeIndexQueue
     {
-        new (mem) TYPE(std::forward<Args>(args)...);
-    }
-    template <typename TYPE> void destruct(TYPE* p) { p->~T(); }
+      public:
+        using KeyAllocator = RebindAllocator<key>;
 
-    const T* getImpl(key k) const noexcept
-    {
-        index_t index = key::toIndex(k);
-        if (index > getMaxValidIndex())
+        explicit FreeIndexQueue(const KeyAllocator& _allocator) noexcept
+            : allocator(_allocator)
         {
-            // index out of bounds
-            return nullptr;
         }
+        FreeIndexQueue(const FreeIndexQueue&) = delete;
+        FreeIndexQueue& operator=(const FreeIndexQueue&) = delete;
+        ~FreeIndexQueue() { release(); }
 
-        PageAddr addr = getAddrFromIndex(index);
-        if (!isActivePage(addr))
+        size_type size() const noexcept { return count; }
+        bool empty() const noexcept { return count == 0; }
+
+        const key& front() const noexcept
         {
-            return nullptr;
+            SLOT_MAP_ASSERT(count > 0);
+            return items[head];
         }
 
-        const Meta& m = getMetaByAddr(addr);
+        // i-th oldest key
+        const key& operator[](size_type i) const noexcept
+        {
+            SLOT_MAP_ASSERT(i < count);
+            return items[(head + i) & (capacity - 1)];
+        }
 
-        version_t version = key::toVersion(k);
-        if (m.version != version)
+        void pop_front() noexcept
         {
-            // version mismatch, slot has been reused
-            return nullptr;
+            SLOT_MAP_ASSERT(count > 0);
+            head = (head + 1) & (capacity - 1);
+            count--;
+            numPopped++;
         }
-        SLOT_MAP_ASSERT(m.version != key::kInvalidVersion);
-        SLOT_MAP_ASSERT(m.tombstone == 0);
-        SLOT_MAP_ASSERT(m.inactive == 0);
 
-        const ValueStorage& v = getValueByAddr(addr);
-        SLOT_MAP_ASSERT(isPointerAligned(&v, alignof(T)));
-        const T* value = reinterpret_cast<const T*>(&v);
-        return value;
-    }
+        void push_back(key k)
+        {
+            if (count == capacity)
+            {
+                grow(std::max(capacity * 2, kMinCapacity));
+            }
+            items[(head + count) & (capacity - 1)] = k;
+            count++;
+            numPushed++;
+        }
 
-    index_t appendElement()
-    {
-        if (pages.empty() || pages.back().numUsedElements == kPageSize)
+        // the number of keys pushed to (removed from) the queue since the last resetChangeCounters() call, see collect_delta
+        uint64_t getNumPushed() const noexcept { return numPushed; }
+        uint64_t getNumPopped() const noexcept { return numPopped; }
+        void resetChangeCounters() noexcept
         {
-            Page& p = pages.emplace_back();
-            p.allocate();
+            numPushed = 0;
+            numPopped = 0;
         }
 
-        Page& lastPage = pages.back();
+        void reserve(size_type numItems)
+        {
+            if (numItems > capacity)
+            {
+                grow(std::bit_ceil(numItems));
+            }
+        }
 
-        size_type elementIndex = lastPage.numUsedElements;
-        SLOT_MAP_ASSERT(elementIndex <= kPageSize);
-        lastPage.numUsedElements++;
+        // replaces the content by the keys of another queue, in the same order
+        void assign(const FreeIndexQueue& other)
+        {
+            clear();
+            reserve(other.count);
+            for (size_type i = 0; i < other.count; i++)
+            {
+                push_back(other[i]);
+            }
+        }
 
-        Meta& m = lastPage.meta[elementIndex];
-        m.version = key::kMinVersion;
-        m.tombstone = 0;
-        m.inactive = 0;
+        void clear() noexcept
+        {
+            numPopped += count;
+            head = 0;
+            count = 0;
+        }
 
-        SLOT_MAP_ASSERT(pages.size() >= 1);
-        index_t index = static_cast<index_t>(getIndexFromAddr(PageAddr{static_cast<size_type>(pages.size()) - 1, elementIndex}));
-        return index;
-    }
+        void release() noexcept
+        {
+            if (items)
+            {
+                std::allocator_traits<KeyAllocator>::deallocate(allocator, items, capacity);
+            }
+            numPopped += count;
+            items = nullptr;
+            capacity = 0;
+            head = 0;
+            count = 0;
+        }
 
-    struct PageAddr
-    {
-        size_type page;
-        size_type index;
+        void swap(FreeIndexQueue& other) noexcept
+        {
+            swapAllocators(allocator, other.allocator);
+            std::swap(items, other.items);
+            std::swap(capacity, other.capacity);
+            std::swap(head, other.head);
+            std::swap(count, other.count);
+            std::swap(numPushed, other.numPushed);
+            std::swap(numPopped, other.numPopped);
+        }
+
+      private:
+        static inline constexpr size_type kMinCapacity = 64;
+
+        void grow(size_type newCapacity)
+        {
+            SLOT_MAP_ASSERT(isPow2(newCapacity) && newCapacity > capacity);
+            key* newItems = std::allocator_traits<KeyAllocator>::allocate(allocator, newCapacity);
+            for (size_type i = 0; i < count; i++)
+            {
+                newItems[i] = items[(head + i) & (capacity - 1)];
+            }
+            if (items)
+            {
+                std::allocator_traits<KeyAllocator>::deallocate(allocator, items, capacity);
+            }
+            items = newItems;
+            capacity = newCapacity;
+            head = 0;
+        }
+
+        KeyAllocator allocator;
+        key* items = nullptr;
+        size_type capacity = 0;
+        size_type head = 0;
+        size_type count = 0;
+        uint64_t numPushed = 0;
+        uint64_t numPopped = 0;
     };
 
-    template <typename INTEGRAL_TYPE> inline static constexpr bool isPow2(INTEGRAL_TYPE x) noexcept
+    static inline constexpr size_type align(size_type cursor, size_type alignment) noexcept
     {
-        static_assert(std::is_integral<INTEGRAL_TYPE>::value, "isPow2 must be called on an integer type.");
-        return (x & (x - 1)) == 0 && (x != 0);
+        return (cursor + (alignment - 1)) & ~(alignment - 1);
     }
-
-    static inline PageAddr getAddrFromIndex(size_type index) noexcept
+    static inline bool isPointerAligned(const void* cursor, size_t alignment) noexcept
     {
-        static_assert(isPow2(kPageSize), "kPageSize is expected to be a power of two.");
-        PageAddr res;
-        res.page = index / kPageSize;
-        res.index = index % kPageSize;
-        return res;
+        return (uintptr_t(cursor) & (alignment - 1)) == 0;
     }
 
-    // to global index
-    static inline index_t getIndexFromAddr(PageAddr addr) noexcept
+    template <typename TYPE, class... Args> static void construct(void* mem, Args&&... args)
     {
-        size_type index = (addr.page * kPageSize + addr.index);
-        return index_t(index);
+        new (mem) TYPE(std::forward<Args>(args)...);
     }
+    template <typename TYPE> void destruct(TYPE* p) { p->~T(); }
 
-    const Meta& getMetaByAddrImpl(PageAddr addr) const noexcept
+    const T* getImpl(key k) const noexcept
     {
-        SLOT_MAP_ASSERT(addr.page < pages.size());
-        const Page& page = pages[addr.page];
-        SLOT_MAP_ASSERT(page.meta);
-        SLOT_MAP_ASSERT(addr.index < kPageSize);
-        return page.meta[addr.index];
+        index_t index = key::toIndex(k);
+        if (index > getMaxValidIndex())
+        {
+            // index out of bounds
+            return nullptr;
+        }
+
+        if (reservedRange.meta)
+        {
+            // single reserved range: no page table indirection, slots of freed pages read as tombstones or zeroes
+            if (!metaAt(reservedRange.meta, index)->isAlive(key::toVersion(k)))
+            {
+                return nullptr;
+            }
+            return reinterpret_cast<const T*>(valueAt(reservedRange.values, index));
+        }
+
+        PageAddr addr = getAddrFromIndex(index);
+        if (!isActivePage(addr))
+        {
+            return nullptr;
+        }
+
+        const Meta& m = getMetaByAddr(addr);
+        if (!m.isAlive(key::toVersion(k)))
+        {
+            // version mismatch (slot has been reused) or a dead slot
+            return nullptr;
+        }
+
+        const ValueStorage& v = getValueByAddr(addr);
+        SLOT_MAP_ASSERT(isPointerAligned(&v, alignof(T)));
+        const T* value = reinterpret_cast<const T*>(&v);
+        return value;
     }
 
-    const ValueStorage& getValueByAddrImpl(PageAddr addr) const noexcept
+    // Software pipeline: key [i] has its Meta prefetched while key [i - D] is checked (and its value prefetched) and then resolved.
+    // The page table is small and stays in cache, so only the Meta and value lines are worth prefetching; the value prefetch is issued
+    // right before the caller gets the pointer, so it only pays off when the caller dereferences values shortly after (see get_many).
+    template <bool PREFETCH_VALUES, typename FUNC> void lookupMany(const key* keys, size_t numKeys, FUNC&& resolve) const
     {
-        SLOT_MAP_ASSERT(addr.page < pages.size());
-        const Page& page = pages[addr.page];
-        SLOT_MAP_ASSERT(page.values);
-        SLOT_MAP_ASSERT(addr.index < kPageSize);
-        return page.values[addr.index];
+        const size_t kDist = kLookupPrefetchDistance;
+        const Meta* ring[kDist];
+
+        auto locate = [&](size_t i) -> const Meta*
+        {
+            index_t index = key::toIndex(keys[i]);
+            PageAddr addr = getAddrFromIndex(index);
+            if (index > getMaxValidIndex() || addr.page >= pages.size() || !pages[addr.page].meta)
+            {
+                return nullptr;
+            }
+            const Meta* m = metaAt(pages[addr.page].meta, addr.index);
+            SLOT_MAP_PREFETCH(m);
+            return m;
+        };
+
+        auto finish = [&](size_t i, const Meta* m)
+        {
+            key k = keys[i];
+            const ValueStorage* v = nullptr;
+            if (m && m->isAlive(key::toVersion(k)))
+            {
+                PageAddr addr = getAddrFromIndex(key::toIndex(k));
+                v = valueAt(pages[addr.page].values, addr.index);
+                if constexpr (PREFETCH_VALUES)
+                {
+                    SLOT_MAP_PREFETCH(v);
+                }
+            }
+            resolve(i, v);
+        };
+
+        size_t numHead = std::min(numKeys, kDist);
+        for (size_t i = 0; i < numHead; i++)
+        {
+            ring[i] = locate(i);
+        }
+        for (size_t i = kDist; i < numKeys; i++)
+        {
+            const Meta* m = ring[i % kDist];
+            ring[i % kDist] = locate(i);
+            finish(i - kDist, m);
+        }
+        for (size_t i = numKeys - numHead; i < numKeys; i++)
+        {
+            finish(i, ring[i % kDist]);
+        }
     }
 
-    const Meta& getMetaByAddr(PageAddr addr) const noexcept { return getMetaByAddrImpl(addr); }
-    const ValueStorage& getValueByAddr(PageAddr addr) const noexcept { return getValueByAddrImpl(addr); }
 
-    Meta& getMetaByAddr(PageAddr addr) noexcept
+    // Page memory blocks are allocated in units of the block alignment
+    struct alignas(Page::getBlockAlignment()) PageBlockUnit
     {
-        const Meta& constRes = getMetaByAddrImpl(addr);
-        return const_cast<Meta&>(constRes);
+        std::byte data[Page::getBlockAlignment()];
+    };
+    using PageBlockAllocator = RebindAllocator<PageBlockUnit>;
+    static inline constexpr size_t getNumBlockUnits() noexcept { return Page::getBlockSize() / sizeof(PageBlockUnit); }
+
+    void* allocatePageBlock()
+    {
+        PageBlockAllocator blockAllocator(pages.get_allocator());
+        void* block = std::allocator_traits<PageBlockAllocator>::allocate(blockAllocator, getNumBlockUnits());
+        SLOT_MAP_ASSERT(block);
+        return block;
     }
 
-    ValueStorage& getValueByAddr(PageAddr addr) noexcept
+    void freePageBlock(void* block) noexcept
     {
-        const ValueStorage& constRes = getValueByAddrImpl(addr);
-        return const_cast<ValueStorage&>(constRes);
+        PageBlockAllocator blockAllocator(pages.get_allocator());
+        std::allocator_traits<PageBlockAllocator>::deallocate(blockAllocator, static_cast<PageBlockUnit*>(block), getNumBlockUnits());
     }
 
-    bool isTombstone(size_type index) const noexcept
+    void freePage(Page& page) noexcept
     {
-        PageAddr addr = getAddrFromIndex(index);
-        SLOT_MAP_ASSERT(addr.page < pages.size());
-        const Page& page = pages[addr.page];
-        if (!page.meta)
+        if (!page.rawMemory || !dropSharedReference(page))
         {
-            return true;
+            return;
         }
-        SLOT_MAP_ASSERT(addr.index < kPageSize);
-        const Meta& meta = page.meta[addr.index];
-        return (meta.tombstone != 0) || (meta.inactive != 0);
+        if (isMappedBlock(page.rawMemory))
+        {
+            // the memory goes away with the mapping (see releaseMappedFile)
+            page.detach();
+            return;
+        }
+        if (reservedRange.memory)
+        {
+            discardReservedPage(page);
+            return;
+        }
+        freePageBlock(page.detach());
     }
 
-    bool isActivePage(PageAddr addr) const noexcept
+    /*
+      Single reserved virtual address range (see use_reserved_range).
+      Values, meta and alive bits of all pages live in three contiguous arrays (values and meta share one array of interleaved slots
+      with slot_layout::interleaved), page N occupies the elements [N * kPageSize, (N+1) * kPageSize) of each array
+    */
+    struct ReservedRange
     {
-        if (addr.page >= pages.size())
+        void* memory = nullptr;
+        size_t numBytes = 0;
+        ValueStorage* values = nullptr;
+        Meta* meta = nullptr;
+        uint64_t* alive = nullptr;
+        size_type maxNumPages = 0;
+        const vm::range_api* api = nullptr;
+        size_t osPageSize = 0;
+    };
+
+    static const vm::range_api* getRangeApi() noexcept
+    {
+        static constexpr vm::range_api kApi = {&vm::page_size, &vm::reserve, &vm::commit, &vm::discard, &vm::unmap};
+        return &kApi;
+    }
+
+    bool reserveRange(size_type maxNumPages, const vm::range_api* api)
+    {
+        SLOT_MAP_ASSERT(!reservedRange.memory);
+        size_t osPageSize = api->page_size();
+        auto alignToOsPage = [osPageSize](size_t numBytes) { return (numBytes + osPageSize - 1) & ~(osPageSize - 1); };
+        size_t numElements = size_t(maxNumPages) * kPageSize;
+        size_t valuesSize = alignToOsPage(getValueStride() * numElements);
+        // interleaved slots are covered by the values array already
+        size_t metaSize = (kLayout == slot_layout::interleaved) ? 0 : alignToOsPage(sizeof(Meta) * numElements);
+        size_t aliveSize = alignToOsPage(sizeof(uint64_t) * kAliveWordsPerPage * maxNumPages);
+
+        void* memory = api->reserve(valuesSize + metaSize + aliveSize);
+        if (!memory)
         {
             return false;
         }
-        const Page& page = pages[addr.page];
-        return (page.meta != nullptr);
+        SLOT_MAP_ASSERT(isPointerAligned(memory, alignof(T)));
+        char* bytes = reinterpret_cast<char*>(memory);
+        reservedRange.memory = memory;
+        reservedRange.numBytes = valuesSize + metaSize + aliveSize;
+        if constexpr (kLayout == slot_layout::interleaved)
+        {
+            reservedRange.values = reinterpret_cast<ValueStorage*>(bytes + Page::getValuesOffset());
+            reservedRange.meta = reinterpret_cast<Meta*>(bytes + Page::getMetaOffset());
+        }
+        else
+        {
+            reservedRange.values = reinterpret_cast<ValueStorage*>(bytes);
+            reservedRange.meta = reinterpret_cast<Meta*>(bytes + valuesSize);
+        }
+        reservedRange.alive = reinterpret_cast<uint64_t*>(bytes + valuesSize + metaSize);
+        reservedRange.maxNumPages = maxNumPages;
+        reservedRange.api = api;
+        reservedRange.osPageSize = osPageSize;
+        return true;
     }
 
-    size_type getMaxValidIndex() const noexcept { return maxValidIndex; }
-
-    void copyFrom(const slot_map& other)
+    void releaseReservedRange() noexcept
     {
-        reset();
+        if (reservedRange.memory)
+        {
+            reservedRange.api->unmap(reservedRange.memory, reservedRange.numBytes);
+        }
+        reservedRange = ReservedRange();
+    }
 
-        SLOT_MAP_ASSERT(numItems == 0);
-        SLOT_MAP_ASSERT(maxValidIndex == 0);
-        SLOT_MAP_ASSERT(pages.empty());
-        SLOT_MAP_ASSERT(freeIndices.empty());
+    // Snapshot file mapped by load(path, load_mode::map), pages loaded from it point into the mapping
+    struct MappedFile
+    {
+        void* memory = nullptr;
+        size_t numBytes = 0;
+        // set by loadMapped(), like reservedRange.api
+        void (*unmap)(void* p, size_t numBytes) noexcept = nullptr;
+    };
 
-        static_assert(std::is_standard_layout<Meta>::value && std::is_trivially_copyable<Meta>::value,
-                      "Meta is expected to be memcopyable (POD type)");
+    bool isMappedBlock(const void* block) const noexcept
+    {
+        const char* begin = reinterpret_cast<const char*>(mappedFile.memory);
+        const char* p = reinterpret_cast<const char*>(block);
+        return begin != nullptr && p >= begin && p < begin + mappedFile.numBytes;
+    }
 
-        numItems = other.numItems;
-        maxValidIndex = other.maxValidIndex;
+    // Note: no page may point into the mapping anymore
+    void releaseMappedFile() noexcept
+    {
+        if (mappedFile.memory)
+        {
+            mappedFile.unmap(mappedFile.memory, mappedFile.numBytes);
+        }
+        mappedFile = MappedFile();
+    }
 
-        for (size_t pageIndex = 0; pageIndex < other.pages.size(); pageIndex++)
+    // Calls fn(begin, numBytes) for the OS pages of the values/meta/alive arrays of a page (whole pages only, if INNER_ONLY)
+    template <bool INNER_ONLY, typename FUNC> void forEachReservedPageSpan(size_type pageIndex, FUNC&& fn) const
+    {
+        size_t osPageSize = reservedRange.osPageSize;
+        auto visit = [&](const void* begin, size_t numBytes)
         {
-            const Page& otherPage = other.pages[pageIndex];
-            if (otherPage.meta)
+            uintptr_t first = reinterpret_cast<uintptr_t>(begin);
+            uintptr_t last = first + numBytes;
+            if constexpr (INNER_ONLY)
             {
-                SLOT_MAP_ASSERT(otherPage.values);
-
-                // active page
-                Page& p = pages.emplace_back();
-                p.allocate();
-                p.numInactiveSlots = otherPage.numInactiveSlots;
-                p.numUsedElements = otherPage.numUsedElements;
-
-                // copy meta
-                size_type metaSize = static_cast<size_type>(sizeof(Meta)) * kPageSize;
-                std::memcpy(p.meta, otherPage.meta, metaSize);
-
-                // copy data
-                if constexpr (std::is_standard_layout<T>::value && std::is_trivially_copyable<T>::value)
-                {
-                    size_type dataSize = static_cast<size_type>(sizeof(ValueStorage)) * kPageSize;
-                    std::memcpy(p.values, otherPage.values, dataSize);
-                }
-                else
-                {
-                    for (size_type elementIndex = 0; elementIndex < p.numUsedElements; elementIndex++)
-                    {
-                        PageAddr addr;
-                        addr.page = static_cast<size_type>(pageIndex);
-                        addr.index = elementIndex;
-
-                        const ValueStorage& otherVal = other.getValueByAddr(addr);
-                        SLOT_MAP_ASSERT(isPointerAligned(&otherVal, alignof(T)));
-                        const T* otherV = reinterpret_cast<const T*>(&otherVal);
-                        ValueStorage& val = getValueByAddr(addr);
-                        SLOT_MAP_ASSERT(isPointerAligned(&val, alignof(T)));
-
-                        // copy constructor
-                        construct<T>(&val, *otherV);
-                    }
-                }
+                // neighbour pages might share the boundary OS pages
+                first = (first + osPageSize - 1) & ~uintptr_t(osPageSize - 1);
+                last = last & ~uintptr_t(osPageSize - 1);
             }
             else
             {
-                SLOT_MAP_ASSERT(otherPage.meta == nullptr);
-                SLOT_MAP_ASSERT(otherPage.values == nullptr);
-
-                // inactive page
-                Page& p = pages.emplace_back();
-                p.numInactiveSlots = otherPage.numInactiveSlots;
-                p.numUsedElements = otherPage.numUsedElements;
-                SLOT_MAP_ASSERT(p.values == nullptr);
-                SLOT_MAP_ASSERT(p.meta == nullptr);
+                first = first & ~uintptr_t(osPageSize - 1);
+                last = (last + osPageSize - 1) & ~uintptr_t(osPageSize - 1);
+            }
+            if (first < last)
+            {
+                fn(reinterpret_cast<void*>(first), static_cast<size_t>(last - first));
             }
+        };
+        size_t firstElement = size_t(pageIndex) * kPageSize;
+        if constexpr (kLayout == slot_layout::interleaved)
+        {
+            visit(reinterpret_cast<const char*>(reservedRange.memory) + firstElement * sizeof(InterleavedSlot), Page::getSlotsSize());
+        }
+        else
+        {
+            visit(reservedRange.values + firstElement, sizeof(ValueStorage) * kPageSize);
+            visit(reservedRange.meta + firstElement, sizeof(Meta) * kPageSize);
         }
+        visit(reservedRange.alive + size_t(pageIndex) * kAliveWordsPerPage, sizeof(uint64_t) * kAliveWordsPerPage);
     }
 
-    void callDtors()
+    void assignReservedPage(Page& page)
     {
-        [[maybe_unused]] size_type numItemsDestroyed = 0;
-        for (size_t pageIndex = 0; pageIndex < pages.size(); pageIndex++)
+        size_type pageIndex = static_cast<size_type>(&page - pages.data());
+        if (pageIndex >= reservedRange.maxNumPages)
         {
-            Page& page = pages[pageIndex];
-            if (page.meta == nullptr)
-            {
-                continue;
-            }
-            for (size_type elementIndex = 0; elementIndex < page.numUsedElements; elementIndex++)
-            {
-                PageAddr addr;
-                addr.page = static_cast<size_type>(pageIndex);
-                addr.index = static_cast<size_type>(elementIndex);
-
-                Meta& m = getMetaByAddr(addr);
-                if (m.tombstone != 0)
-                {
-                    continue;
-                }
-                if constexpr (!std::is_trivially_destructible<T>::value)
-                {
-                    ValueStorage& v = getValueByAddr(addr);
-                    SLOT_MAP_ASSERT(isPointerAligned(&v, alignof(T)));
-                    destruct(reinterpret_cast<const T*>(&v));
-                }
-                numItemsDestroyed++;
-            }
+            // the reserved range is exhausted
+            throw std::bad_alloc();
+        }
+        bool isCommitted = true;
+        forEachReservedPageSpan<false>(pageIndex,
+                                       [&](void* begin, size_t numBytes) { isCommitted &= reservedRange.api->commit(begin, numBytes); });
+        if (!isCommitted)
+        {
+            throw std::bad_alloc();
         }
-        SLOT_MAP_ASSERT(numItemsDestroyed == numItems);
+        size_t firstElement = size_t(pageIndex) * kPageSize;
+        page.assign(valueAt(reservedRange.values, firstElement), metaAt(reservedRange.meta, firstElement),
+                    reservedRange.alive + size_t(pageIndex) * kAliveWordsPerPage);
     }
 
-    enum class EraseResult
+    // The page keeps its addresses (stale reads see either the old tombstones or zeroes, which never match a valid key)
+    void discardReservedPage(Page& page) noexcept
     {
-        NotFound,
-        ErasedAndIndexRecycled,
-        ErasedAndPageDeactivated,
-    };
+        size_type pageIndex = static_cast<size_type>(&page - pages.data());
+        page.detach();
+        forEachReservedPageSpan<true>(pageIndex, [this](void* begin, size_t numBytes) { reservedRange.api->discard(begin, numBytes); });
+    }
 
-    template <bool VERSION_CHECK> EraseResult eraseImpl(key k)
+    // Freed page blocks are kept in the page cache (up to its capacity) instead of going back to the allocator
+    void recyclePage(Page& page)
     {
-        index_t index = key::toIndex(k);
-        if (index > getMaxValidIndex())
+        if (!page.rawMemory || !dropSharedReference(page))
         {
-            return EraseResult::NotFound;
+            return;
         }
-
-        PageAddr addr = getAddrFromIndex(index);
-        if (!isActivePage(addr))
+        if (isMappedBlock(page.rawMemory))
         {
-            return EraseResult::NotFound;
+            page.detach();
+            return;
         }
-
-        Meta& m = getMetaByAddr(addr);
-        if (m.tombstone != 0)
+        if (reservedRange.memory)
         {
-            return EraseResult::NotFound;
+            discardReservedPage(page);
+            return;
         }
-
-        version_t slotVersion = m.version;
-
-        if constexpr (VERSION_CHECK)
+        void* block = page.detach();
+        if (cachedPageBlocks.size() < pageCacheCapacity)
         {
-            version_t version = key::toVersion(k);
-            if (slotVersion != version || slotVersion == key::kInvalidVersion || version == key::kInvalidVersion)
+            try
             {
-                return EraseResult::NotFound;
+                cachedPageBlocks.push_back(block);
+                return;
+            }
+            catch (const std::bad_alloc&)
+            {
+                // the cache can't grow, the block is freed instead
             }
         }
+        freePageBlock(block);
+    }
+
+    /*
+      slot_sharing::copy_on_write: gives up the reference to the block of a shared page.
+      Returns false if other slot maps still use the block (the page is detached then) and true if this slot map is its only owner.
+    */
+    bool dropSharedReference(Page& page) noexcept
+    {
+        if constexpr (kSharing == slot_sharing::copy_on_write)
+        {
+            if (page.isShared())
+            {
+                if (page.getRefCount().fetch_sub(1, std::memory_order_acq_rel) != 1)
+                {
+                    page.detach();
+                    return false;
+                }
+                // the other owners are gone in the meantime
+                page.getRefCount().store(1, std::memory_order_relaxed);
+            }
+        }
+        return true;
+    }
+
+    /*
+      Called before every write to a page: marks the page dirty (see collect_delta) and, slot_sharing::copy_on_write,
+      gives a shared page a private copy of its block
+    */
+    void beginPageWrite(Page& page)
+    {
+        page.isDirty = true;
+        if constexpr (kSharing == slot_sharing::copy_on_write)
+        {
+            if (!page.isShared())
+            {
+                return;
+            }
+            Page copy;
+            allocatePage(copy);
+            copy.numInactiveSlots = page.numInactiveSlots;
+            copy.numUsedElements = page.numUsedElements;
+            try
+            {
+                copyPage<false>(copy, std::as_const(page));
+            }
+            catch (...)
+            {
+                recyclePage(copy);
+                throw;
+            }
+            page.swap(copy);
+            if (dropSharedReference(copy))
+            {
+                destroyPageElements(copy);
+                recyclePage(copy);
+            }
+        }
+    }
+
+    void beginAllPagesWrite()
+    {
+        if (kSharing == slot_sharing::exclusive && !isTrackingDirtyPages)
+        {
+            // nothing to copy and no one collects deltas
+            return;
+        }
+        for (Page& page : pages)
+        {
+            // only pages with alive elements are written to by the callers
+            if (page.numAliveSlots != 0)
+            {
+                beginPageWrite(page);
+            }
+        }
+    }
+
+    // the page of an existing key
+    void markKeyPageDirty(key k) noexcept { pages[getAddrFromIndex(key::toIndex(k)).page].isDirty = true; }
+
+    // Non-const access to the value of a key (a no-op if the key doesn't exist)
+    void beginKeyPageWrite(key k)
+    {
+        index_t index = key::toIndex(k);
+        PageAddr addr = getAddrFromIndex(index);
+        if (index <= getMaxValidIndex() && isActivePage(addr) && getMetaByAddr(addr).isAlive(key::toVersion(k)))
+        {
+            beginPageWrite(pages[addr.page]);
+        }
+    }
+
+    // Cached (and reserved) blocks are used first, so a burst of emplace() calls after reserve() never hits the allocator
+    void allocatePage(Page& page)
+    {
+        if (reservedRange.memory)
+        {
+            assignReservedPage(page);
+            return;
+        }
+        if (cachedPageBlocks.empty())
+        {
+            pageCacheMisses++;
+            page.assign(allocatePageBlock());
+            return;
+        }
+        pageCacheHits++;
+        page.assign(cachedPageBlocks.back());
+        cachedPageBlocks.pop_back();
+    }
+
+    /*
+      Returns the memory of a page without alive elements to the allocator.
+
+      Only the lowest version that was never handed out on the page is kept (releasedVersion), which is enough to reject all stale keys
+      and to revive the page later without key collisions. Free queue entries pointing to the released page become stale and are
+      skipped by emplace().
+    */
+    void releasePage(size_type pageIndex)
+    {
+        Page& page = pages[pageIndex];
+        SLOT_MAP_ASSERT(page.meta);
+        SLOT_MAP_ASSERT(page.numAliveSlots == 0);
+        SLOT_MAP_ASSERT(page.numInactiveSlots == 0);
+
+        version_t nextVersion = key::kMinVersion;
+        for (size_type elementIndex = 0; elementIndex < page.numUsedElements; elementIndex++)
+        {
+            // tombstone versions have already been increased on erase and were never handed out
+            nextVersion = std::max(nextVersion, metaAt(page.meta, elementIndex)->getVersion());
+        }
+
+        recyclePage(page);
+        // the page is revived as a whole, so slots that were never used count as used from now on
+        page.numUsedElements = kPageSize;
+        page.releasedVersion = nextVersion;
+        page.isDirty = true;
+        releasedPages.push_back(pageIndex);
+    }
+
+    /*
+      Brings a released page back: all slots become tombstones with a version that was never handed out and go to the free queue.
+      Returns false if there are no released pages.
+    */
+    bool reviveReleasedPage()
+    {
+        if (releasedPages.empty())
+        {
+            return false;
+        }
+        size_type pageIndex = releasedPages.back();
+        Page& page = pages[pageIndex];
+        SLOT_MAP_ASSERT(page.isReleased());
+        version_t version = page.releasedVersion;
+
+        // everything that can throw comes first, so a failed allocation leaves the page released
+        freeIndices.reserve(freeIndices.size() + kPageSize);
+        allocatePage(page);
+        releasedPages.pop_back();
+        page.numUsedElements = kPageSize;
+        page.isDirty = true;
+        for (size_type elementIndex = 0; elementIndex < kPageSize; elementIndex++)
+        {
+            metaAt(page.meta, elementIndex)->setTombstone(version);
+            freeIndices.push_back(key::make(version, getIndexFromAddr(PageAddr{pageIndex, elementIndex})));
+        }
+        maxValidIndex = std::max(maxValidIndex, getIndexFromAddr(PageAddr{pageIndex, kPageSize - 1}));
+        return true;
+    }
+
+    // Free queue entries can go stale (their page was released or revived), so check that the entry still matches its slot
+    bool isRecyclable(key k) const noexcept
+    {
+        index_t index = key::toIndex(k);
+        PageAddr addr = getAddrFromIndex(index);
+        if (index > getMaxValidIndex() || !isActivePage(addr))
+        {
+            return false;
+        }
+        const Meta& m = getMetaByAddr(addr);
+        return m.isTombstone() && !m.isInactive() && m.getVersion() == key::toVersion(k);
+    }
+
+    bool popRecycledKey(key& k)
+    {
+        for (;;)
+        {
+            // Use recycled IDs only if we accumulated enough of them
+            while (static_cast<size_type>(freeIndices.size()) > kMinFreeIndices)
+            {
+                k = freeIndices.front();
+                freeIndices.pop_front();
+                if (isRecyclable(k))
+                {
+                    return true;
+                }
+            }
+            // reuse released pages before growing
+            bool needsNewPage = pages.empty() || pages.back().numUsedElements == kPageSize;
+            if (!needsNewPage || !reviveReleasedPage())
+            {
+                return false;
+            }
+        }
+    }
+
+    index_t appendElement()
+    {
+        size_t nextIndex = pages.empty() ? 0 : (pages.size() - 1) * size_t(kPageSize) + pages.back().numUsedElements;
+        if (nextIndex > size_t(key::kMaxIndex))
+        {
+            // the key index space is exhausted (see slot_map_key)
+            throw std::length_error("slot_map: too many elements for the key type");
+        }
+
+        if (pages.empty() || pages.back().numUsedElements == kPageSize)
+        {
+            // the reserved range addresses pages by their position, so the page is appended first and dropped again on failure
+            Page& page = pages.emplace_back();
+            try
+            {
+                allocatePage(page);
+            }
+            catch (...)
+            {
+                pages.pop_back();
+                throw;
+            }
+        }
+
+        Page& lastPage = pages.back();
+        beginPageWrite(lastPage);
+
+        size_type elementIndex = lastPage.numUsedElements;
+        SLOT_MAP_ASSERT(elementIndex <= kPageSize);
+        lastPage.numUsedElements++;
+
+        metaAt(lastPage.meta, elementIndex)->setAlive(key::kMinVersion);
+        lastPage.setAlive(elementIndex);
+
+        SLOT_MAP_ASSERT(pages.size() >= 1);
+        index_t index = static_cast<index_t>(getIndexFromAddr(PageAddr{static_cast<size_type>(pages.size()) - 1, elementIndex}));
+        return index;
+    }
+
+    struct PageAddr
+    {
+        size_type page;
+        size_type index;
+    };
+
+    template <typename INTEGRAL_TYPE> inline static constexpr bool isPow2(INTEGRAL_TYPE x) noexcept
+    {
+        static_assert(std::is_integral<INTEGRAL_TYPE>::value, "isPow2 must be called on an integer type.");
+        return (x & (x - 1)) == 0 && (x != 0);
+    }
+
+    static inline PageAddr getAddrFromIndex(size_type index) noexcept
+    {
+        static_assert(isPow2(kPageSize), "kPageSize is expected to be a power of two.");
+        PageAddr res;
+        res.page = index / kPageSize;
+        res.index = index % kPageSize;
+        return res;
+    }
+
+    // to global index
+    static inline index_t getIndexFromAddr(PageAddr addr) noexcept
+    {
+        size_type index = (addr.page * kPageSize + addr.index);
+        return index_t(index);
+    }
+
+    const Meta& getMetaByAddrImpl(PageAddr addr) const noexcept
+    {
+        SLOT_MAP_ASSERT(addr.page < pages.size());
+        const Page& page = pages[addr.page];
+        SLOT_MAP_ASSERT(page.meta);
+        SLOT_MAP_ASSERT(addr.index < kPageSize);
+        return *metaAt(page.meta, addr.index);
+    }
+
+    const ValueStorage& getValueByAddrImpl(PageAddr addr) const noexcept
+    {
+        SLOT_MAP_ASSERT(addr.page < pages.size());
+        const Page& page = pages[addr.page];
+        SLOT_MAP_ASSERT(page.values);
+        SLOT_MAP_ASSERT(addr.index < kPageSize);
+        return *valueAt(page.values, addr.index);
+    }
+
+    const Meta& getMetaByAddr(PageAddr addr) const noexcept { return getMetaByAddrImpl(addr); }
+    const ValueStorage& getValueByAddr(PageAddr addr) const noexcept { return getValueByAddrImpl(addr); }
+
+    Meta& getMetaByAddr(PageAddr addr) noexcept
+    {
+        const Meta& constRes = getMetaByAddrImpl(addr);
+        return const_cast<Meta&>(constRes);
+    }
+
+    ValueStorage& getValueByAddr(PageAddr addr) noexcept
+    {
+        const ValueStorage& constRes = getValueByAddrImpl(addr);
+        return const_cast<ValueStorage&>(constRes);
+    }
+
+    // Returns the first alive index >= index (or the end index), skipping dead slots a bitmap word at a time and inactive pages at once
+    size_type nextAliveIndex(size_type index) const noexcept
+    {
+        size_type endIndex = getMaxValidIndex() + static_cast<size_type>(1);
+        while (index < endIndex)
+        {
+            PageAddr addr = getAddrFromIndex(index);
+            if (addr.page >= pages.size())
+            {
+                break;
+            }
+            const Page& page = pages[addr.page];
+            if (page.alive)
+            {
+                size_type wordIndex = addr.index / 64;
+                uint64_t word = page.alive[wordIndex] & (~uint64_t(0) << (addr.index % 64));
+                while (word == 0 && ++wordIndex < kAliveWordsPerPage)
+                {
+                    word = page.alive[wordIndex];
+                }
+                if (word != 0)
+                {
+                    size_type elementIndex = wordIndex * 64 + static_cast<size_type>(std::countr_zero(word));
+                    return std::min(static_cast<size_type>(getIndexFromAddr(PageAddr{addr.page, elementIndex})), endIndex);
+                }
+            }
+            index = (addr.page + 1) * kPageSize;
+        }
+        return endIndex;
+    }
+
+    bool isActivePage(PageAddr addr) const noexcept
+    {
+        if (addr.page >= pages.size())
+        {
+            return false;
+        }
+        const Page& page = pages[addr.page];
+        return (page.meta != nullptr);
+    }
+
+    size_type getMaxValidIndex() const noexcept { return maxValidIndex; }
+
+    /*
+      MOVE_VALUES: move elements out of the other slot map (used when the page memory can't be taken over)
+
+      slot_sharing::copy_on_write: pages are shared with the other slot map (if the allocators are equal), nothing is copied.
+
+      Pages are allocated up front (the allocator and the page cache are not thread safe), then the content of the pages is copied
+      on numThreads threads. Metadata and occupancy bitmaps are copied with memcpy, values either with memcpy (trivially copyable T)
+      or by visiting the alive slots only. The free queue is copied too, so the copy hands out the same keys as the original.
+      If a page allocation or a copy constructor throws, the slot map is left empty and the exception is rethrown.
+    */
+    template <bool MOVE_VALUES = false>
+    void copyFrom(std::conditional_t<MOVE_VALUES, slot_map&, const slot_map&> other, unsigned numThreads = 1)
+    {
+        recycleAllPages();
+
+        SLOT_MAP_ASSERT(numItems == 0);
+        SLOT_MAP_ASSERT(maxValidIndex == 0);
+        SLOT_MAP_ASSERT(pages.empty());
+        SLOT_MAP_ASSERT(freeIndices.empty());
+
+        static_assert(std::is_standard_layout<Meta>::value && std::is_trivially_copyable<Meta>::value,
+                      "Meta is expected to be memcopyable (POD type)");
+
+        if (other.reservedRange.memory && !reservedRange.memory)
+        {
+            reserveRange(other.reservedRange.maxNumPages, other.reservedRange.api);
+        }
+
+        releasedPages = other.releasedPages;
+        releaseEmptyPages = other.releaseEmptyPages;
+        needsFullDelta = true;
+
+        if constexpr (kSharing == slot_sharing::copy_on_write)
+        {
+            if (get_allocator() == other.get_allocator())
+            {
+                // O(pages): both slot maps share the page blocks until one of them writes to a page
+                pages.reserve(other.pages.size());
+                for (const Page& otherPage : other.pages)
+                {
+                    Page& p = pages.emplace_back();
+                    if (otherPage.meta)
+                    {
+                        p.share(otherPage);
+                    }
+                    else
+                    {
+                        p.numInactiveSlots = otherPage.numInactiveSlots;
+                        p.numUsedElements = otherPage.numUsedElements;
+                        p.releasedVersion = otherPage.releasedVersion;
+                    }
+                }
+                numItems = other.numItems;
+                maxValidIndex = other.maxValidIndex;
+                freeIndices.assign(other.freeIndices);
+                return;
+            }
+        }
+
+        SLOT_MAP_ASSERT(other.pages.size() < (uint64_t(1) << 32));
+        try
+        {
+            pages.reserve(other.pages.size());
+            for (size_t pageIndex = 0; pageIndex < other.pages.size(); pageIndex++)
+            {
+                const Page& otherPage = other.pages[pageIndex];
+                Page& p = pages.emplace_back();
+                if (otherPage.meta)
+                {
+                    SLOT_MAP_ASSERT(otherPage.values);
+                    // active page, nothing is alive until its content is copied
+                    allocatePage(p);
+                }
+                else
+                {
+                    SLOT_MAP_ASSERT(otherPage.values == nullptr);
+                    // inactive or released page
+                    p.releasedVersion = otherPage.releasedVersion;
+                }
+                p.numInactiveSlots = otherPage.numInactiveSlots;
+                p.numUsedElements = otherPage.numUsedElements;
+            }
+
+            parallelForPages(pages.size(), numThreads,
+                             [&](size_t pageIndex)
+                             {
+                                 if constexpr (kSharing == slot_sharing::copy_on_write)
+                                 {
+                                     // pages of the other slot map can be shared with its copies, so values are never moved out
+                                     copyPage<false>(pages[pageIndex], std::as_const(other.pages[pageIndex]));
+                                 }
+                                 else
+                                 {
+                                     copyPage<MOVE_VALUES>(pages[pageIndex], other.pages[pageIndex]);
+                                 }
+                             });
+        }
+        catch (...)
+        {
+            // pages that failed, were skipped or never got memory have no alive elements, so only the copied elements are destroyed
+            recycleAllPages();
+            throw;
+        }
+
+        numItems = other.numItems;
+        maxValidIndex = other.maxValidIndex;
+        // the copy reuses the same tombstones as the original
+        freeIndices.assign(other.freeIndices);
+    }
+
+    // Copies (moves) the content of an active page into a freshly allocated one, the page is left empty if a constructor throws
+    template <bool MOVE_VALUES, typename OTHER_PAGE> void copyPage(Page& p, OTHER_PAGE& otherPage)
+    {
+        if (otherPage.meta == nullptr)
+        {
+            return;
+        }
+        SLOT_MAP_ASSERT(p.meta);
+        SLOT_MAP_ASSERT(p.numAliveSlots == 0);
+
+        // slots past numUsedElements were never used, their content doesn't matter
+        size_type numUsedElements = otherPage.numUsedElements;
+        constexpr bool kIsMemcopyable = std::is_standard_layout<T>::value && std::is_trivially_copyable<T>::value;
+        if constexpr (kLayout == slot_layout::interleaved && kIsMemcopyable)
+        {
+            // copy meta and data in one go
+            std::memcpy(p.rawMemory, otherPage.rawMemory, sizeof(InterleavedSlot) * numUsedElements);
+        }
+        else if constexpr (kLayout == slot_layout::interleaved)
+        {
+            for (size_type elementIndex = 0; elementIndex < numUsedElements; elementIndex++)
+            {
+                *metaAt(p.meta, elementIndex) = *metaAt(otherPage.meta, elementIndex);
+            }
+        }
+        else
+        {
+            std::memcpy(p.meta, otherPage.meta, sizeof(Meta) * numUsedElements);
+            if constexpr (kIsMemcopyable)
+            {
+                std::memcpy(p.values, otherPage.values, sizeof(ValueStorage) * numUsedElements);
+            }
+        }
+
+        if constexpr (!kIsMemcopyable)
+        {
+            // erased slots don't hold objects, only the alive ones are visited
+            size_type numConstructed = 0;
+            try
+            {
+                forEachAliveInPage(otherPage,
+                                   [&](size_type elementIndex)
+                                   {
+                                       auto* otherVal = valueAt(otherPage.values, elementIndex);
+                                       SLOT_MAP_ASSERT(isPointerAligned(otherVal, alignof(T)));
+                                       ValueStorage* val = valueAt(p.values, elementIndex);
+                                       SLOT_MAP_ASSERT(isPointerAligned(val, alignof(T)));
+                                       if constexpr (MOVE_VALUES)
+                                       {
+                                           construct<T>(val, std::move(*reinterpret_cast<T*>(otherVal)));
+                                       }
+                                       else
+                                       {
+                                           construct<T>(val, *reinterpret_cast<const T*>(otherVal));
+                                       }
+                                       numConstructed++;
+                                   });
+            }
+            catch (...)
+            {
+                forEachAliveInPage(otherPage,
+                                   [&](size_type elementIndex)
+                                   {
+                                       if (numConstructed > 0)
+                                       {
+                                           destruct(reinterpret_cast<const T*>(valueAt(p.values, elementIndex)));
+                                           numConstructed--;
+                                       }
+                                   });
+                throw;
+            }
+        }
+
+        std::memcpy(p.alive, otherPage.alive, sizeof(uint64_t) * kAliveWordsPerPage);
+        p.numAliveSlots = otherPage.numAliveSlots;
+    }
+
+    // Destroys all the elements, page blocks go to the page cache (up to its capacity)
+    void recycleAllPages()
+    {
+        callDtors();
+        for (Page& page : pages)
+        {
+            recyclePage(page);
+        }
+        pages.clear();
+        releaseMappedFile();
+        freeIndices.clear();
+        releasedPages.clear();
+        numItems = 0;
+        maxValidIndex = 0;
+    }
+
+    void releaseCachedPageBlocks() noexcept
+    {
+        for (void* block : cachedPageBlocks)
+        {
+            freePageBlock(block);
+        }
+        cachedPageBlocks.clear();
+        cachedPageBlocks.shrink_to_fit();
+    }
+
+    /*
+      Runs the destructors of all the alive elements (metadata is left untouched), a no-op for trivially destructible types.
+      slot_sharing::copy_on_write: shared pages are detached instead, their elements are destroyed by the last owner
+      Never throws (it runs in the destructor): if no destruction threads can be started, the calling thread destroys everything.
+    */
+    void callDtors() noexcept
+    {
+        if constexpr (!std::is_trivially_destructible<T>::value || kSharing == slot_sharing::copy_on_write)
+        {
+            SLOT_MAP_ASSERT(pages.size() < (uint64_t(1) << 32));
+            parallelForPages(pages.size(), numDestructionThreads,
+                             [this](size_t pageIndex)
+                             {
+                                 Page& page = pages[pageIndex];
+                                 if (page.meta == nullptr || page.numAliveSlots == 0 || !dropSharedReference(page))
+                                 {
+                                     return;
+                                 }
+                                 destroyPageElements(page);
+                             });
+        }
+    }
+
+    void destroyPageElements(const Page& page)
+    {
+        if constexpr (!std::is_trivially_destructible<T>::value)
+        {
+            forEachAliveInPage(page,
+                               [&](size_type elementIndex)
+                               {
+                                   const ValueStorage* v = valueAt(page.values, elementIndex);
+                                   SLOT_MAP_ASSERT(isPointerAligned(v, alignof(T)));
+                                   destruct(reinterpret_cast<const T*>(v));
+                               });
+        }
+    }
+
+    template <bool IsConst, typename SLOT_MAP_PTR, typename FUNC> static void forEachChunkImpl(SLOT_MAP_PTR self, FUNC& fn)
+    {
+        static_assert(kLayout == slot_layout::split, "for_each_chunk requires contiguous values (slot_layout::split)");
+        using value_type = std::conditional_t<IsConst, const T, T>;
+        for (size_t pageIndex = 0; pageIndex < self->pages.size(); pageIndex++)
+        {
+            const Page& page = self->pages[pageIndex];
+            if (page.meta == nullptr || page.numUsedElements == 0)
+            {
+                continue;
+            }
+            value_type* values = reinterpret_cast<value_type*>(page.values);
+            index_t baseIndex = getIndexFromAddr(PageAddr{static_cast<size_type>(pageIndex), 0});
+            fn(std::span<value_type>(values, page.numUsedElements), std::span<const uint64_t>(page.alive, (page.numUsedElements + 63) / 64),
+               baseIndex);
+        }
+    }
+
+    // Calls fn(elementIndex) for every alive slot of an active page
+    template <typename FUNC> void forEachAliveInPage(const Page& page, FUNC&& fn) const
+    {
+        SLOT_MAP_ASSERT(page.alive);
+        for (size_type wordIndex = 0; wordIndex < kAliveWordsPerPage; wordIndex++)
+        {
+            uint64_t word = page.alive[wordIndex];
+            while (word != 0)
+            {
+                fn(wordIndex * 64 + static_cast<size_type>(std::countr_zero(word)));
+                word &= word - 1;
+            }
+        }
+    }
+
+    /*
+      Runs fn(pageIndex) for every page index in [0, numPages) on numThreads threads (the calling thread is one of them).
+
+      Every worker starts with a contiguous range of pages and takes pages from its front. A worker that runs out of pages steals from
+      the back of another worker's range, so uneven per-page costs (e.g. tombstone density) are balanced automatically.
+      Ranges are packed as (end << 32 | begin) into a single atomic, so both pops are a single CAS.
+
+      Threads that can't be started are not an error: their pages are stolen by the running workers, and without memory for the
+      bookkeeping everything runs on the calling thread. So only fn can throw (see callDtors).
+    */
+    template <typename FUNC> static void parallelForPages(size_t numPages, unsigned numThreads, FUNC&& fn)
+    {
+        if (numThreads == 0)
+        {
+            numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        numThreads = static_cast<unsigned>(std::min(static_cast<size_t>(numThreads), numPages));
+
+        struct alignas(64) WorkRange
+        {
+            std::atomic<uint64_t> range;
+        };
+        std::vector<WorkRange> ranges;
+        std::vector<std::thread> threads;
+        if (numThreads > 1)
+        {
+            try
+            {
+                ranges = std::vector<WorkRange>(numThreads);
+                threads.reserve(numThreads - 1);
+            }
+            catch (const std::bad_alloc&)
+            {
+                numThreads = 1;
+            }
+        }
+        if (numThreads <= 1)
+        {
+            for (size_t pageIndex = 0; pageIndex < numPages; pageIndex++)
+            {
+                fn(pageIndex);
+            }
+            return;
+        }
+
+        auto makeRange = [](uint64_t begin, uint64_t end) -> uint64_t { return (end << 32) | begin; };
+        for (size_t i = 0; i < numThreads; i++)
+        {
+            uint64_t begin = numPages * i / numThreads;
+            uint64_t end = numPages * (i + 1) / numThreads;
+            ranges[i].range.store(makeRange(begin, end), std::memory_order_relaxed);
+        }
+
+        // returns a claimed page index or numPages if the range is empty
+        auto popPage = [&](WorkRange& w, bool fromBack) -> size_t
+        {
+            uint64_t r = w.range.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                uint64_t begin = r & 0xffffffffull;
+                uint64_t end = r >> 32;
+                if (begin >= end)
+                {
+                    return numPages;
+                }
+                uint64_t next = fromBack ? makeRange(begin, end - 1) : makeRange(begin + 1, end);
+                if (w.range.compare_exchange_weak(r, next, std::memory_order_acq_rel, std::memory_order_relaxed))
+                {
+                    return static_cast<size_t>(fromBack ? (end - 1) : begin);
+                }
+            }
+        };
+
+        // the first exception thrown by fn stops all the workers, it is rethrown once they are joined
+        std::exception_ptr error;
+        std::atomic_flag hasError = ATOMIC_FLAG_INIT;
+        std::atomic<bool> isStopped(false);
+        auto worker = [&](size_t workerIndex) noexcept
+        {
+            try
+            {
+                WorkRange& own = ranges[workerIndex];
+                for (size_t pageIndex = popPage(own, false); pageIndex < numPages; pageIndex = popPage(own, false))
+                {
+                    if (isStopped.load(std::memory_order_relaxed))
+                    {
+                        return;
+                    }
+                    fn(pageIndex);
+                }
+                for (size_t i = 1; i < numThreads; i++)
+                {
+                    WorkRange& victim = ranges[(workerIndex + i) % numThreads];
+                    for (size_t pageIndex = popPage(victim, true); pageIndex < numPages; pageIndex = popPage(victim, true))
+                    {
+                        if (isStopped.load(std::memory_order_relaxed))
+                        {
+                            return;
+                        }
+                        fn(pageIndex);
+                    }
+                }
+            }
+            catch (...)
+            {
+                if (!hasError.test_and_set())
+                {
+                    error = std::current_exception();
+                }
+                isStopped.store(true, std::memory_order_relaxed);
+            }
+        };
+
+        {
+            // joins the started threads on every way out of the scope, so a throw can't leave them joinable
+            struct JoinGuard
+            {
+                std::vector<std::thread>& threads;
+                ~JoinGuard()
+                {
+                    for (std::thread& t : threads)
+                    {
+                        t.join();
+                    }
+                }
+            } joinGuard{threads};
+
+            for (size_t i = 1; i < numThreads; i++)
+            {
+                try
+                {
+                    threads.emplace_back(worker, i);
+                }
+                catch (const std::system_error&)
+                {
+                    // out of threads: the pages of the workers that didn't start are stolen by the others (the calling thread at least)
+                    break;
+                }
+            }
+            worker(0);
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+
+    template <bool IsConst, bool WITH_KEYS, typename SLOT_MAP_PTR, typename FUNC>
+    static void parallelForEachImpl(SLOT_MAP_PTR self, FUNC& fn, unsigned numThreads)
+    {
+        using value_type = std::conditional_t<IsConst, const T, T>;
+        SLOT_MAP_ASSERT(self->pages.size() < (uint64_t(1) << 32));
+        parallelForPages(self->pages.size(), numThreads,
+                         [&](size_t pageIndex)
+                         {
+                             const Page& page = self->pages[pageIndex];
+                             if (page.meta == nullptr)
+                             {
+                                 return;
+                             }
+                             self->forEachAliveInPage(page,
+                                                      [&](size_type elementIndex)
+                                                      {
+                                                          ValueStorage* storage = valueAt(page.values, elementIndex);
+                                                          value_type& value = *reinterpret_cast<value_type*>(storage);
+                                                          if constexpr (WITH_KEYS)
+                                                          {
+                                                              PageAddr addr{static_cast<size_type>(pageIndex), elementIndex};
+                                                              version_t version = metaAt(page.meta, elementIndex)->getVersion();
+                                                              fn(key::make(version, getIndexFromAddr(addr)), value);
+                                                          }
+                                                          else
+                                                          {
+                                                              fn(value);
+                                                          }
+                                                      });
+                         });
+    }
+
+    enum class EraseResult
+    {
+        NotFound,
+        ErasedAndIndexRecycled,
+        ErasedAndPageDeactivated,
+        ErasedAndPageReleased,
+    };
+
+    template <bool VERSION_CHECK> EraseResult eraseImpl(key k)
+    {
+        index_t index = key::toIndex(k);
+        if (index > getMaxValidIndex())
+        {
+            return EraseResult::NotFound;
+        }
+
+        PageAddr addr = getAddrFromIndex(index);
+        if (!isActivePage(addr))
+        {
+            return EraseResult::NotFound;
+        }
+
+        if (getMetaByAddrImpl(addr).isTombstone())
+        {
+            return EraseResult::NotFound;
+        }
+
+        version_t slotVersion = getMetaByAddrImpl(addr).getVersion();
+
+        if constexpr (VERSION_CHECK)
+        {
+            version_t version = key::toVersion(k);
+            if (slotVersion != version || slotVersion == key::kInvalidVersion || version == key::kInvalidVersion)
+            {
+                return EraseResult::NotFound;
+            }
+        }
+
+        beginPageWrite(pages[addr.page]);
+        Meta& m = getMetaByAddr(addr);
 
         bool deactivateSlot = (slotVersion == key::kMaxVersion);
         if (deactivateSlot)
         {
-            // version overflow = deactivate slot
-            m.inactive = 1;
+            // version overflow = deactivate slot
+            m.setInactive(slotVersion);
+        }
+        else
+        {
+            // increase version
+            slotVersion = key::increaseVersion(slotVersion);
+            SLOT_MAP_ASSERT(slotVersion != key::kInvalidVersion);
+            SLOT_MAP_ASSERT(slotVersion > m.getVersion());
+            m.setTombstone(slotVersion);
+        }
+        pages[addr.page].clearAlive(addr.index);
+
+        if constexpr (!std::is_trivially_destructible<T>::value)
+        {
+            ValueStorage& v = getValueByAddr(addr);
+            SLOT_MAP_ASSERT(isPointerAligned(&v, alignof(T)));
+            const T* pv = reinterpret_cast<const T*>(&v);
+            destruct(pv);
+        }
+        numItems--;
+
+        if (deactivateSlot)
+        {
+            Page& page = pages[addr.page];
+            page.numInactiveSlots++;
+            if (page.numInactiveSlots == kPageSize)
+            {
+                recyclePage(page);
+                return EraseResult::ErasedAndPageDeactivated;
+            }
+        }
+        else
+        {
+            Page& page = pages[addr.page];
+            if (releaseEmptyPages && page.numAliveSlots == 0 && page.numInactiveSlots == 0 && page.numUsedElements == kPageSize)
+            {
+                // free queue entries of this page go stale and are skipped later
+                releasePage(addr.page);
+                return EraseResult::ErasedAndPageReleased;
+            }
+            // recycle index id (note: tag is not saved!)
+            freeIndices.push_back(key::clearTagAndUpdateVersion(k, slotVersion));
+        }
+        return EraseResult::ErasedAndIndexRecycled;
+    }
+
+    /*
+      Page-wise erase of all the alive elements of a page (used by clear), same outcome as calling eraseImpl() for each of them.
+      Note: the elements must already be destroyed (see callDtors)
+    */
+    void clearPage(size_type pageIndex)
+    {
+        Page& page = pages[pageIndex];
+        SLOT_MAP_ASSERT(page.meta);
+        SLOT_MAP_ASSERT(page.numAliveSlots > 0);
+
+        // slots that run out of versions are deactivated, everything else becomes a tombstone with the next version
+        size_type numDeactivated = 0;
+        forEachAliveInPage(page,
+                           [&](size_type elementIndex)
+                           {
+                               Meta& m = *metaAt(page.meta, elementIndex);
+                               version_t slotVersion = m.getVersion();
+                               if (slotVersion == key::kMaxVersion)
+                               {
+                                   m.setInactive(slotVersion);
+                                   numDeactivated++;
+                               }
+                               else
+                               {
+                                   m.setTombstone(key::increaseVersion(slotVersion));
+                               }
+                           });
+
+        numItems -= page.numAliveSlots;
+        page.numInactiveSlots += numDeactivated;
+        bool releasePageAfterwards = releaseEmptyPages && page.numInactiveSlots == 0 && page.numUsedElements == kPageSize;
+        if (page.numInactiveSlots == kPageSize || releasePageAfterwards)
+        {
+            // nothing on this page goes to the free queue
+            std::memset(page.alive, 0, sizeof(uint64_t) * kAliveWordsPerPage);
+            page.numAliveSlots = 0;
+            if (releasePageAfterwards)
+            {
+                releasePage(pageIndex);
+            }
+            else
+            {
+                recyclePage(page);
+            }
+            return;
+        }
+
+        // recycle indices in slot order (note: tags are not saved!)
+        index_t baseIndex = getIndexFromAddr(PageAddr{pageIndex, 0});
+        forEachAliveInPage(page,
+                           [&](size_type elementIndex)
+                           {
+                               const Meta& m = *metaAt(page.meta, elementIndex);
+                               if (!m.isInactive())
+                               {
+                                   freeIndices.push_back(key::make(m.getVersion(), static_cast<index_t>(baseIndex + elementIndex)));
+                               }
+                           });
+        std::memset(page.alive, 0, sizeof(uint64_t) * kAliveWordsPerPage);
+        page.numAliveSlots = 0;
+    }
+
+    // Moves an alive element into a free slot (used by compact), the source slot is retired the same way as by erase()
+    template <typename FUNC> void relocateElement(PageAddr from, PageAddr to, FUNC& onRemap)
+    {
+        beginPageWrite(pages[from.page]);
+        beginPageWrite(pages[to.page]);
+        Meta& fromMeta = getMetaByAddr(from);
+        Meta& toMeta = getMetaByAddr(to);
+        SLOT_MAP_ASSERT(!fromMeta.isTombstone());
+        SLOT_MAP_ASSERT(toMeta.isTombstone() && !toMeta.isInactive());
+
+        ValueStorage& fromValue = getValueByAddr(from);
+        ValueStorage& toValue = getValueByAddr(to);
+        if constexpr (is_trivially_relocatable<T>::value)
+        {
+            std::memcpy(&toValue, &fromValue, sizeof(T));
+        }
+        else
+        {
+            // if the move constructor throws the element stays where it was
+            T* value = reinterpret_cast<T*>(&fromValue);
+            construct<T>(&toValue, std::move(*value));
+            destruct(value);
+        }
+
+        version_t toVersion = toMeta.getVersion();
+        toMeta.setAlive(toVersion);
+        pages[to.page].setAlive(to.index);
+
+        version_t fromVersion = fromMeta.getVersion();
+        key oldKey = key::make(fromVersion, getIndexFromAddr(from));
+        Page& fromPage = pages[from.page];
+        fromPage.clearAlive(from.index);
+        if (fromVersion == key::kMaxVersion)
+        {
+            // version overflow = deactivate slot
+            fromMeta.setInactive(fromVersion);
+            fromPage.numInactiveSlots++;
+        }
+        else
+        {
+            fromVersion = key::increaseVersion(fromVersion);
+            fromMeta.setTombstone(fromVersion);
+            freeIndices.push_back(key::make(fromVersion, getIndexFromAddr(from)));
+        }
+
+        onRemap(oldKey, key::make(toVersion, getIndexFromAddr(to)));
+    }
+
+    // Returns the first free (tombstone, not inactive) slot of an active page starting from elementIndex or kPageSize
+    size_type findFreeSlot(const Page& page, size_type elementIndex) const noexcept
+    {
+        for (; elementIndex < page.numUsedElements; elementIndex++)
+        {
+            uint64_t word = page.alive[elementIndex / 64] >> (elementIndex % 64);
+            if (word == ~uint64_t(0) >> (elementIndex % 64))
+            {
+                // the rest of the word is alive
+                elementIndex |= 63;
+                continue;
+            }
+            const Meta& m = *metaAt(page.meta, elementIndex);
+            if (m.isTombstone() && !m.isInactive())
+            {
+                return elementIndex;
+            }
+        }
+        return kPageSize;
+    }
+
+    /*
+      Snapshot file format (see save/load), all offsets are in bytes from the beginning of the file:
+
+      | Section                         | Content                                                              |
+      |---------------------------------|----------------------------------------------------------------------|
+      | SnapshotHeader                  | slot map type (checked on load), counters and section offsets        |
+      | SnapshotPage x numPages         | page table                                                           |
+      | key x numFreeIndices            | free queue, oldest first                                             |
+      | uint32_t x numReleasedPages     | indices of released pages                                            |
+      | page content x numActivePages   | values, meta and alive bits as laid out in a page block,             |
+      |                                 | every page starts at a multiple of kSnapshotAlignment,               |
+      |                                 | slots past numUsedElements are zeros                                 |
+
+      The format is native (no endianness or padding conversion), it is only meant to be loaded by the same slot map type.
+    */
+    static inline constexpr char kSnapshotMagic[8] = {'D', 'O', 'D', 'S', 'L', 'O', 'T', 'M'};
+    static inline constexpr uint32_t kSnapshotFormatVersion = 1;
+    static inline constexpr uint32_t kSnapshotByteOrderMark = 0x01020304;
+    static inline constexpr uint64_t kSnapshotAlignment = 4096;
+
+    struct SnapshotHeader
+    {
+        char magic[8];
+        uint32_t formatVersion;
+        uint32_t byteOrderMark;
+
+        // slot map type
+        uint32_t valueSize;
+        uint32_t valueAlignment;
+        uint32_t metaSize;
+        uint32_t keySize;
+        uint64_t keyMaxIndex;
+        uint64_t keyMaxVersion;
+        uint32_t pageSize;
+        uint32_t layout;
+        uint64_t pageContentSize;
+
+        // content
+        uint64_t numPages;
+        uint64_t numItems;
+        uint64_t maxValidIndex;
+        uint64_t numFreeIndices;
+        uint64_t numReleasedPages;
+        uint64_t pageTableOffset;
+        uint64_t freeIndicesOffset;
+        uint64_t releasedPagesOffset;
+        uint64_t fileSize;
+    };
+
+    struct SnapshotPage
+    {
+        // 0 for inactive and released pages
+        uint64_t contentOffset;
+        uint32_t numInactiveSlots;
+        uint32_t numUsedElements;
+        uint32_t numAliveSlots;
+        uint32_t releasedVersion;
+    };
+
+    static constexpr uint64_t alignOffset(uint64_t offset, uint64_t alignment) noexcept
+    {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr uint64_t getSnapshotPageStride() noexcept { return alignOffset(Page::getContentSize(), kSnapshotAlignment); }
+
+    static SnapshotHeader makeSnapshotHeader() noexcept
+    {
+        SnapshotHeader header = {};
+        std::memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+        header.formatVersion = kSnapshotFormatVersion;
+        header.byteOrderMark = kSnapshotByteOrderMark;
+        header.valueSize = static_cast<uint32_t>(sizeof(T));
+        header.valueAlignment = static_cast<uint32_t>(alignof(T));
+        header.metaSize = static_cast<uint32_t>(sizeof(Meta));
+        header.keySize = static_cast<uint32_t>(sizeof(key));
+        header.keyMaxIndex = key::kMaxIndex;
+        header.keyMaxVersion = key::kMaxVersion;
+        header.pageSize = kPageSize;
+        header.layout = static_cast<uint32_t>(kLayout);
+        header.pageContentSize = Page::getContentSize();
+        return header;
+    }
+
+    /*
+      Calls fn(offsetInBlock, memory, numBytes) for the parts of the page content that hold the first numSlots slots and for the alive
+      bits (separate arrays in the reserved range mode)
+    */
+    template <typename FUNC> static bool forEachPageContentSpan(const Page& page, size_type numSlots, FUNC&& fn)
+    {
+        if constexpr (kLayout == slot_layout::interleaved)
+        {
+            if (!fn(0, page.rawMemory, sizeof(InterleavedSlot) * numSlots))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            if (!fn(0, page.values, sizeof(ValueStorage) * numSlots) || !fn(Page::getMetaOffset(), page.meta, sizeof(Meta) * numSlots))
+            {
+                return false;
+            }
+        }
+        return fn(Page::getAliveOffset(), page.alive, sizeof(uint64_t) * kAliveWordsPerPage);
+    }
+
+    bool writeSnapshot(std::FILE* file) const
+    {
+        SnapshotHeader header = makeSnapshotHeader();
+        header.numPages = pages.size();
+        header.numItems = numItems;
+        header.maxValidIndex = maxValidIndex;
+        header.numFreeIndices = freeIndices.size();
+        header.numReleasedPages = releasedPages.size();
+        header.pageTableOffset = alignOffset(sizeof(SnapshotHeader), alignof(SnapshotPage));
+        header.freeIndicesOffset = alignOffset(header.pageTableOffset + sizeof(SnapshotPage) * header.numPages, alignof(key));
+        header.releasedPagesOffset = alignOffset(header.freeIndicesOffset + sizeof(key) * header.numFreeIndices, alignof(uint32_t));
+        uint64_t contentOffset = alignOffset(header.releasedPagesOffset + sizeof(uint32_t) * header.numReleasedPages, kSnapshotAlignment);
+
+        std::vector<SnapshotPage> table(pages.size());
+        for (size_t pageIndex = 0; pageIndex < pages.size(); pageIndex++)
+        {
+            const Page& page = pages[pageIndex];
+            SnapshotPage& entry = table[pageIndex];
+            entry.contentOffset = page.meta ? contentOffset : 0;
+            entry.numInactiveSlots = page.numInactiveSlots;
+            entry.numUsedElements = page.numUsedElements;
+            entry.numAliveSlots = page.numAliveSlots;
+            entry.releasedVersion = page.releasedVersion;
+            contentOffset += page.meta ? getSnapshotPageStride() : 0;
+        }
+        header.fileSize = contentOffset;
+
+        uint64_t cursor = 0;
+        auto write = [&](uint64_t offset, const void* data, size_t numBytes)
+        {
+            static const char kZeros[256] = {};
+            SLOT_MAP_ASSERT(offset >= cursor);
+            for (; cursor < offset; cursor += std::min(offset - cursor, uint64_t(sizeof(kZeros))))
+            {
+                if (std::fwrite(kZeros, 1, size_t(std::min(offset - cursor, uint64_t(sizeof(kZeros)))), file) == 0)
+                {
+                    return false;
+                }
+            }
+            cursor += numBytes;
+            return numBytes == 0 || std::fwrite(data, 1, numBytes, file) == numBytes;
+        };
+
+        if (!write(0, &header, sizeof(header)) || !write(header.pageTableOffset, table.data(), sizeof(SnapshotPage) * table.size()))
+        {
+            return false;
+        }
+        for (size_type i = 0; i < freeIndices.size(); i++)
+        {
+            if (!write(header.freeIndicesOffset + sizeof(key) * i, &freeIndices[i], sizeof(key)))
+            {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < releasedPages.size(); i++)
+        {
+            uint32_t pageIndex = releasedPages[i];
+            if (!write(header.releasedPagesOffset + sizeof(uint32_t) * i, &pageIndex, sizeof(pageIndex)))
+            {
+                return false;
+            }
+        }
+        for (size_t pageIndex = 0; pageIndex < pages.size(); pageIndex++)
+        {
+            if (pages[pageIndex].meta == nullptr)
+            {
+                continue;
+            }
+            // only the used slots are written, write() zero-fills the gaps up to the next span, so unused slots (never initialized)
+            // don't leak stale memory into the file
+            const Page& page = pages[pageIndex];
+            uint64_t base = table[pageIndex].contentOffset;
+            bool isWritten = forEachPageContentSpan(page, page.numUsedElements, [&](uint64_t offset, const void* data, size_t numBytes)
+                                                    { return write(base + offset, data, numBytes); });
+            if (!isWritten)
+            {
+                return false;
+            }
+        }
+        // trailing padding, so the last page content can be mapped as a whole
+        return write(header.fileSize, nullptr, 0);
+    }
+
+    static bool isValidSnapshotHeader(const SnapshotHeader& header, const char (&magic)[8]) noexcept
+    {
+        SnapshotHeader expected = makeSnapshotHeader();
+        bool isCompatible = std::memcmp(header.magic, magic, sizeof(header.magic)) == 0 && header.formatVersion == expected.formatVersion &&
+                            header.byteOrderMark == expected.byteOrderMark && header.valueSize == expected.valueSize &&
+                            header.valueAlignment == expected.valueAlignment && header.metaSize == expected.metaSize &&
+                            header.keySize == expected.keySize && header.keyMaxIndex == expected.keyMaxIndex &&
+                            header.keyMaxVersion == expected.keyMaxVersion && header.pageSize == expected.pageSize &&
+                            header.layout == expected.layout && header.pageContentSize == expected.pageContentSize;
+        uint64_t maxNumPages = (uint64_t(key::kMaxIndex) + kPageSize) / kPageSize;
+        return isCompatible && header.numPages <= maxNumPages && header.numReleasedPages <= header.numPages &&
+               header.numItems <= header.numPages * kPageSize && header.numFreeIndices <= header.numPages * kPageSize;
+    }
+
+    // SnapshotPage or StreamPage
+    template <typename ENTRY> static bool isValidPageEntry(const ENTRY& entry) noexcept
+    {
+        return entry.numUsedElements <= kPageSize && entry.numAliveSlots + entry.numInactiveSlots <= entry.numUsedElements;
+    }
+
+    /*
+      An alive mask read from a snapshot or a stream must only cover used slots, agree with the page counters and match the metadata of
+      every used slot: get() trusts the metadata, iteration and destruction trust the alive bits, so a mismatch would expose unconstructed
+      values.
+    */
+    static bool isValidAliveMask(Meta* meta, const uint64_t* alive, size_type numUsedElements, size_type numAliveSlots) noexcept
+    {
+        for (size_type elementIndex = 0; elementIndex < numUsedElements; elementIndex++)
+        {
+            bool isAlive = ((alive[elementIndex / 64] >> (elementIndex % 64)) & 1) != 0;
+            if (isAlive == metaAt(meta, elementIndex)->isTombstone())
+            {
+                return false;
+            }
+        }
+        size_type numAlive = 0;
+        for (size_type wordIndex = 0; wordIndex < kAliveWordsPerPage; wordIndex++)
+        {
+            size_type firstElement = wordIndex * 64;
+            uint64_t usedMask = (firstElement >= numUsedElements)       ? 0
+                                : (numUsedElements - firstElement >= 64) ? ~uint64_t(0)
+                                                                         : (uint64_t(1) << (numUsedElements - firstElement)) - 1;
+            if ((alive[wordIndex] & ~usedMask) != 0)
+            {
+                return false;
+            }
+            numAlive += static_cast<size_type>(std::popcount(alive[wordIndex]));
+        }
+        return numAlive == numAliveSlots;
+    }
+
+    template <typename ENTRY> static void restorePageCounters(Page& page, const ENTRY& entry) noexcept
+    {
+        page.numInactiveSlots = entry.numInactiveSlots;
+        page.numUsedElements = entry.numUsedElements;
+        page.numAliveSlots = page.meta ? entry.numAliveSlots : 0;
+        page.releasedVersion = static_cast<version_t>(entry.releasedVersion);
+    }
+
+    // The last step of a load: numAlive is the number of alive slots of the restored pages
+    bool restoreCounters(const SnapshotHeader& header, uint64_t numAlive) noexcept
+    {
+        if (numAlive != header.numItems || (header.numPages != 0 && header.maxValidIndex >= header.numPages * kPageSize))
+        {
+            return false;
+        }
+        numItems = static_cast<size_type>(header.numItems);
+        maxValidIndex = static_cast<index_t>(header.maxValidIndex);
+        return true;
+    }
+
+    /*
+      Builds the slot map from a snapshot. read(offset, dst, numBytes) reads from the file (offsets never decrease),
+      attachContent(page, entry) gives an active page its memory and content and checks it as far as the load mode allows.
+    */
+    template <typename READ, typename ATTACH> bool readSnapshot(READ&& read, ATTACH&& attachContent)
+    {
+        SnapshotHeader header;
+        if (!read(0, &header, sizeof(header)) || !isValidSnapshotHeader(header, kSnapshotMagic))
+        {
+            return false;
+        }
+
+        std::vector<SnapshotPage> table(size_t(header.numPages));
+        if (!read(header.pageTableOffset, table.data(), sizeof(SnapshotPage) * table.size()))
+        {
+            return false;
+        }
+        std::vector<key> keys(size_t(header.numFreeIndices));
+        std::vector<uint32_t> released(size_t(header.numReleasedPages));
+        if (!read(header.freeIndicesOffset, keys.data(), sizeof(key) * keys.size()) ||
+            !read(header.releasedPagesOffset, released.data(), sizeof(uint32_t) * released.size()))
+        {
+            return false;
+        }
+
+        uint64_t numAlive = 0;
+        pages.reserve(table.size());
+        for (const SnapshotPage& entry : table)
+        {
+            bool isValid = isValidPageEntry(entry) && (entry.contentOffset % kSnapshotAlignment) == 0 &&
+                           (entry.contentOffset == 0 || entry.contentOffset + getSnapshotPageStride() <= header.fileSize);
+            if (!isValid)
+            {
+                return false;
+            }
+            Page& page = pages.emplace_back();
+            if (entry.contentOffset != 0 && !attachContent(page, entry))
+            {
+                return false;
+            }
+            restorePageCounters(page, entry);
+            numAlive += page.numAliveSlots;
+        }
+        for (uint32_t pageIndex : released)
+        {
+            if (pageIndex >= pages.size() || !pages[pageIndex].isReleased())
+            {
+                return false;
+            }
+        }
+        // a truncated file is rejected, even if only the trailing padding is missing
+        if (!read(header.fileSize, nullptr, 0))
+        {
+            return false;
+        }
+
+        freeIndices.reserve(static_cast<size_type>(keys.size()));
+        for (key k : keys)
+        {
+            freeIndices.push_back(k);
+        }
+        releasedPages.assign(released.begin(), released.end());
+        return restoreCounters(header, numAlive);
+    }
+
+    bool loadCopy(const char* path)
+    {
+        std::FILE* file = std::fopen(path, "rb");
+        if (!file)
+        {
+            return false;
+        }
+        uint64_t cursor = 0;
+        auto read = [&](uint64_t offset, void* dst, size_t numBytes)
+        {
+            // the file is read front to back, padding is skipped
+            if (offset < cursor)
+            {
+                return false;
+            }
+            while (cursor < offset)
+            {
+                char skipped[256];
+                size_t numSkipped = size_t(std::min(offset - cursor, uint64_t(sizeof(skipped))));
+                if (std::fread(skipped, 1, numSkipped, file) != numSkipped)
+                {
+                    return false;
+                }
+                cursor += numSkipped;
+            }
+            cursor += numBytes;
+            return numBytes == 0 || std::fread(dst, 1, numBytes, file) == numBytes;
+        };
+        auto readContent = [&](Page& page, const SnapshotPage& entry)
+        {
+            allocatePage(page);
+            bool isRead = forEachPageContentSpan(page, kPageSize, [&](uint64_t offset, void* dst, size_t numBytes)
+                                                 { return read(entry.contentOffset + offset, dst, numBytes); });
+            return isRead && isValidAliveMask(page.meta, page.alive, static_cast<size_type>(entry.numUsedElements),
+                                              static_cast<size_type>(entry.numAliveSlots));
+        };
+        bool isLoaded = readSnapshot(read, readContent);
+        std::fclose(file);
+        return isLoaded;
+    }
+
+    bool loadMapped(const char* path)
+    {
+        SLOT_MAP_ASSERT(!reservedRange.memory);
+        mappedFile.memory = vm::map_file(path, mappedFile.numBytes);
+        mappedFile.unmap = &vm::unmap_file;
+        if (!mappedFile.memory)
+        {
+            return false;
+        }
+        const char* bytes = reinterpret_cast<const char*>(mappedFile.memory);
+        auto read = [&](uint64_t offset, void* dst, size_t numBytes)
+        {
+            if (offset > mappedFile.numBytes || numBytes > mappedFile.numBytes - offset)
+            {
+                return false;
+            }
+            if (numBytes != 0)
+            {
+                std::memcpy(dst, bytes + offset, numBytes);
+            }
+            return true;
+        };
+        return readSnapshot(read,
+                            [&](Page& page, const SnapshotPage& entry)
+                            {
+                                // the page content is not touched here, so loading costs O(page table) and the pages are faulted in
+                                // on first access
+                                if (entry.contentOffset + getSnapshotPageStride() > mappedFile.numBytes)
+                                {
+                                    return false;
+                                }
+                                page.attach(const_cast<char*>(bytes) + entry.contentOffset);
+                                return true;
+                            });
+    }
+
+    // Runs loadFn() on the emptied slot map, the slot map is left empty if it fails or throws
+    template <typename FUNC> bool loadWith(FUNC&& loadFn)
+    {
+        reset();
+        bool isLoaded = false;
+        try
+        {
+            isLoaded = loadFn();
+        }
+        catch (...)
+        {
+            reset();
+            throw;
+        }
+        if (!isLoaded)
+        {
+            reset();
+        }
+        needsFullDelta = true;
+        return isLoaded;
+    }
+
+    /*
+      Stream format (see save_stream/load_stream), the records follow each other without any padding:
+
+      | Record                          | Content                                                              |
+      |---------------------------------|----------------------------------------------------------------------|
+      | SnapshotHeader                  | slot map type and counters (the section offsets are not used)        |
+      | StreamPage                      | page counters, repeated numPages times, the content of an active     |
+      | page content                    | page follows its counters (see writeStreamPage)                      |
+      | uint32_t x numReleasedPages     | indices of released pages                                            |
+      | key x numFreeIndices            | free queue, oldest first                                             |
+    */
+    static inline constexpr char kStreamMagic[8] = {'D', 'O', 'D', 'S', 'L', 'O', 'T', 'S'};
+    // the number of small items (metadata, keys, page indices) sent with one write() call
+    static inline constexpr size_t kStreamChunkSize = 64;
+
+    struct StreamPage
+    {
+        uint32_t isActive;
+        uint32_t numInactiveSlots;
+        uint32_t numUsedElements;
+        uint32_t numAliveSlots;
+        uint32_t releasedVersion;
+    };
+
+    static StreamPage makeStreamPage(const Page& page) noexcept
+    {
+        StreamPage entry = {};
+        entry.isActive = page.meta ? 1 : 0;
+        entry.numInactiveSlots = page.numInactiveSlots;
+        entry.numUsedElements = page.numUsedElements;
+        entry.numAliveSlots = page.numAliveSlots;
+        entry.releasedVersion = page.releasedVersion;
+        return entry;
+    }
+
+    template <typename WRITE> static bool writeBytes(WRITE& write, const void* data, size_t numBytes)
+    {
+        return numBytes == 0 || write(std::span<const std::byte>(static_cast<const std::byte*>(data), numBytes));
+    }
+
+    template <typename READ> static bool readBytes(READ& read, void* dst, size_t numBytes)
+    {
+        return numBytes == 0 || read(std::span<std::byte>(static_cast<std::byte*>(dst), numBytes));
+    }
+
+    // Writes itemAt(0) ... itemAt(numItems - 1), kStreamChunkSize items at a time
+    template <typename ITEM, typename WRITE, typename FUNC> static bool writeChunked(WRITE& write, size_t numItems, FUNC&& itemAt)
+    {
+        ITEM chunk[kStreamChunkSize];
+        for (size_t first = 0; first < numItems; first += kStreamChunkSize)
+        {
+            size_t numInChunk = std::min(numItems - first, kStreamChunkSize);
+            for (size_t i = 0; i < numInChunk; i++)
+            {
+                chunk[i] = itemAt(first + i);
+            }
+            if (!writeBytes(write, chunk, sizeof(ITEM) * numInChunk))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Reads numItems items written by writeChunked and passes them to fn(index, item), stops as soon as fn returns false
+    template <typename ITEM, typename READ, typename FUNC> static bool readChunked(READ& read, size_t numItems, FUNC&& fn)
+    {
+        ITEM chunk[kStreamChunkSize];
+        for (size_t first = 0; first < numItems; first += kStreamChunkSize)
+        {
+            size_t numInChunk = std::min(numItems - first, kStreamChunkSize);
+            if (!readBytes(read, chunk, sizeof(ITEM) * numInChunk))
+            {
+                return false;
+            }
+            for (size_t i = 0; i < numInChunk; i++)
+            {
+                if (!fn(first + i, chunk[i]))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /*
+      The content of an active page in a stream only covers its used slots:
+        trivially copyable T - the values and metadata (or the interleaved slots) as laid out in memory, then the alive bits,
+                               written straight from the page memory
+        other types          - the metadata, the alive bits, then every alive value encoded by slot_map_codec<T> in slot order
+    */
+    template <typename WRITE> bool writeStreamPage(WRITE& write, const Page& page) const
+    {
+        if constexpr (std::is_trivially_copyable<T>::value)
+        {
+            return forEachPageContentSpan(page, page.numUsedElements,
+                                          [&](uint64_t, const void* data, size_t numBytes) { return writeBytes(write, data, numBytes); });
+        }
+        else
+        {
+            auto metaOf = [&](size_t elementIndex) { return *metaAt(page.meta, elementIndex); };
+            bool isWritten = writeChunked<Meta>(write, page.numUsedElements, metaOf) &&
+                             writeBytes(write, page.alive, sizeof(uint64_t) * kAliveWordsPerPage);
+            forEachAliveInPage(page,
+                               [&](size_type elementIndex)
+                               {
+                                   const ValueStorage* v = valueAt(page.values, elementIndex);
+                                   isWritten = isWritten && slot_map_codec<T>::encode(*reinterpret_cast<const T*>(v), write);
+                               });
+            return isWritten;
+        }
+    }
+
+    template <typename READ> bool readStreamPage(READ& read, Page& page, const StreamPage& entry)
+    {
+        allocatePage(page);
+        size_type numUsedElements = static_cast<size_type>(entry.numUsedElements);
+        size_type numAliveSlots = static_cast<size_type>(entry.numAliveSlots);
+        if constexpr (std::is_trivially_copyable<T>::value)
+        {
+            bool isRead = forEachPageContentSpan(page, numUsedElements,
+                                                 [&](uint64_t, void* dst, size_t numBytes) { return readBytes(read, dst, numBytes); });
+            return isRead && isValidAliveMask(page.meta, page.alive, numUsedElements, numAliveSlots);
+        }
+        else
+        {
+            uint64_t alive[kAliveWordsPerPage];
+            bool isRead = readChunked<Meta>(read, numUsedElements,
+                                            [&](size_t elementIndex, const Meta& m)
+                                            {
+                                                *metaAt(page.meta, elementIndex) = m;
+                                                return true;
+                                            }) &&
+                          readBytes(read, alive, sizeof(alive));
+            if (!isRead || !isValidAliveMask(page.meta, alive, numUsedElements, numAliveSlots))
+            {
+                return false;
+            }
+            // a slot becomes alive once its value is constructed, so a failed load destroys exactly the decoded values
+            for (size_type wordIndex = 0; wordIndex < kAliveWordsPerPage; wordIndex++)
+            {
+                for (uint64_t word = alive[wordIndex]; word != 0; word &= word - 1)
+                {
+                    size_type elementIndex = wordIndex * 64 + static_cast<size_type>(std::countr_zero(word));
+                    std::optional<T> value = slot_map_codec<T>::decode(read);
+                    if (!value)
+                    {
+                        return false;
+                    }
+                    ValueStorage* v = valueAt(page.values, elementIndex);
+                    SLOT_MAP_ASSERT(isPointerAligned(v, alignof(T)));
+                    construct<T>(v, std::move(*value));
+                    page.setAlive(elementIndex);
+                }
+            }
+            return true;
+        }
+    }
+
+    template <typename READ> bool readStream(READ& read)
+    {
+        SnapshotHeader header;
+        if (!readBytes(read, &header, sizeof(header)) || !isValidSnapshotHeader(header, kStreamMagic))
+        {
+            return false;
+        }
+
+        uint64_t numAlive = 0;
+        pages.reserve(size_t(header.numPages));
+        for (uint64_t pageIndex = 0; pageIndex < header.numPages; pageIndex++)
+        {
+            StreamPage entry;
+            if (!readBytes(read, &entry, sizeof(entry)) || !isValidPageEntry(entry))
+            {
+                return false;
+            }
+            Page& page = pages.emplace_back();
+            if (entry.isActive != 0 && !readStreamPage(read, page, entry))
+            {
+                return false;
+            }
+            restorePageCounters(page, entry);
+            numAlive += page.numAliveSlots;
+        }
+
+        releasedPages.reserve(size_t(header.numReleasedPages));
+        bool isRead = readChunked<uint32_t>(read, size_t(header.numReleasedPages),
+                                            [&](size_t, uint32_t pageIndex)
+                                            {
+                                                if (pageIndex >= pages.size() || !pages[pageIndex].isReleased())
+                                                {
+                                                    return false;
+                                                }
+                                                releasedPages.push_back(pageIndex);
+                                                return true;
+                                            });
+        freeIndices.reserve(static_cast<size_type>(header.numFreeIndices));
+        isRead = isRead && readChunked<key>(read, size_t(header.numFreeIndices),
+                                            [&](size_t, key k)
+                                            {
+                                                freeIndices.push_back(k);
+                                                return true;
+                                            });
+        return isRead && restoreCounters(header, numAlive);
+    }
+
+    /*
+      Delta format (see collect_delta/apply_delta), the same records as in a stream:
+
+      | Record                          | Content                                                              |
+      |---------------------------------|----------------------------------------------------------------------|
+      | DeltaHeader                     | slot map type and counters, delta sequence number                    |
+      | DeltaPage                       | index and counters of a dirty page, repeated numDirtyPages times in  |
+      | page content                    | page order, the content of an active page follows its counters       |
+      | uint32_t x numReleasedPages     | indices of all the released pages                                    |
+      | key x numFreeIndices            | keys pushed to the free queue (numPoppedFreeIndices keys are removed |
+      |                                 | from its front first)                                                |
+
+      A full delta lists every page and the whole free queue, the replica drops its content first.
+    */
+    static inline constexpr char kDeltaMagic[8] = {'D', 'O', 'D', 'S', 'L', 'O', 'T', 'D'};
+
+    struct DeltaHeader
+    {
+        // numPages, numItems, maxValidIndex, numReleasedPages and numFreeIndices (sent keys) are used
+        SnapshotHeader content;
+        uint64_t isFull;
+        // the number of deltas applied to the replica before this one
+        uint64_t baseSequence;
+        uint64_t numDirtyPages;
+        uint64_t numPoppedFreeIndices;
+    };
+
+    struct DeltaPage
+    {
+        uint32_t pageIndex;
+        StreamPage state;
+    };
+
+    template <typename WRITE> bool writeDelta(WRITE& write, bool isFull) const
+    {
+        // the free queue since the last delta is (queue at the checkpoint + pushed keys) without the popped keys
+        uint64_t numPushed = freeIndices.getNumPushed();
+        uint64_t numPopped = freeIndices.getNumPopped();
+        uint64_t numKeysAtCheckpoint = uint64_t(freeIndices.size()) + numPopped - numPushed;
+
+        DeltaHeader header = {};
+        header.content = makeSnapshotHeader();
+        std::memcpy(header.content.magic, kDeltaMagic, sizeof(header.content.magic));
+        header.content.numPages = pages.size();
+        header.content.numItems = numItems;
+        header.content.maxValidIndex = maxValidIndex;
+        header.content.numReleasedPages = releasedPages.size();
+        header.content.numFreeIndices = isFull ? freeIndices.size() : std::min(numPushed, uint64_t(freeIndices.size()));
+        header.isFull = isFull ? 1 : 0;
+        header.baseSequence = deltaSequence;
+        header.numPoppedFreeIndices = isFull ? 0 : std::min(numPopped, numKeysAtCheckpoint);
+        for (const Page& page : pages)
+        {
+            header.numDirtyPages += (isFull || page.isDirty) ? 1 : 0;
+        }
+        if (!writeBytes(write, &header, sizeof(header)))
+        {
+            return false;
+        }
+
+        for (size_t pageIndex = 0; pageIndex < pages.size(); pageIndex++)
+        {
+            const Page& page = pages[pageIndex];
+            if (!isFull && !page.isDirty)
+            {
+                continue;
+            }
+            DeltaPage record = {static_cast<uint32_t>(pageIndex), makeStreamPage(page)};
+            if (!writeBytes(write, &record, sizeof(record)) || (page.meta && !writeStreamPage(write, page)))
+            {
+                return false;
+            }
+        }
+
+        // the pushed keys that are still queued are the newest ones
+        size_t firstKey = size_t(freeIndices.size() - header.content.numFreeIndices);
+        return writeChunked<uint32_t>(write, releasedPages.size(), [&](size_t i) { return static_cast<uint32_t>(releasedPages[i]); }) &&
+               writeChunked<key>(write, size_t(header.content.numFreeIndices),
+                                 [&](size_t i) { return freeIndices[static_cast<size_type>(firstKey + i)]; });
+    }
+
+    template <typename READ> bool readDelta(READ& read, const DeltaHeader& header)
+    {
+        if (header.isFull != 0)
+        {
+            recycleAllPages();
+        }
+        if (header.content.numPages < pages.size() || header.numPoppedFreeIndices > freeIndices.size())
+        {
+            return false;
+        }
+        pages.reserve(size_t(header.content.numPages));
+        while (pages.size() < header.content.numPages)
+        {
+            pages.emplace_back();
+        }
+
+        uint64_t nextPageIndex = 0;
+        for (uint64_t i = 0; i < header.numDirtyPages; i++)
+        {
+            DeltaPage record;
+            if (!readBytes(read, &record, sizeof(record)) || record.pageIndex < nextPageIndex || record.pageIndex >= pages.size() ||
+                !isValidPageEntry(record.state))
+            {
+                return false;
+            }
+            nextPageIndex = uint64_t(record.pageIndex) + 1;
+
+            // the page is rebuilt from scratch, its old block goes to the page cache
+            Page& page = pages[record.pageIndex];
+            if (page.meta && dropSharedReference(page))
+            {
+                destroyPageElements(page);
+                recyclePage(page);
+            }
+            if (record.state.isActive != 0 && !readStreamPage(read, page, record.state))
+            {
+                return false;
+            }
+            restorePageCounters(page, record.state);
+            page.isDirty = true;
+        }
+
+        releasedPages.clear();
+        releasedPages.reserve(size_t(header.content.numReleasedPages));
+        bool isRead = readChunked<uint32_t>(read, size_t(header.content.numReleasedPages),
+                                            [&](size_t, uint32_t pageIndex)
+                                            {
+                                                if (pageIndex >= pages.size() || !pages[pageIndex].isReleased())
+                                                {
+                                                    return false;
+                                                }
+                                                releasedPages.push_back(pageIndex);
+                                                return true;
+                                            });
+        for (uint64_t i = 0; i < header.numPoppedFreeIndices; i++)
+        {
+            freeIndices.pop_front();
+        }
+        isRead = isRead && readChunked<key>(read, size_t(header.content.numFreeIndices),
+                                            [&](size_t, key k)
+                                            {
+                                                freeIndices.push_back(k);
+                                                return true;
+                                            });
+
+        uint64_t numAlive = 0;
+        for (const Page& page : pages)
+        {
+            numAlive += page.meta ? page.numAliveSlots : 0;
+        }
+        return isRead && restoreCounters(header.content, numAlive);
+    }
+
+  public:
+    slot_map()
+        : slot_map(allocator_type())
+    {
+    }
+
+    /*
+      Constructs an empty slot map that takes all its memory (pages, page table and free indices) from the given allocator.
+      Any std::pmr::polymorphic_allocator or STL compatible allocator (such as stl::Allocator) can be used.
+    */
+    explicit slot_map(const allocator_type& allocator)
+        : pages(allocator)
+        , freeIndices(allocator)
+        , cachedPageBlocks(allocator)
+        , releasedPages(allocator)
+        , compactOrder(allocator)
+        , numItems(0)
+        , maxValidIndex(0)
+    {
+    }
+
+    ~slot_map()
+    {
+        reset();
+        releaseReservedRange();
+    }
+
+    /*
+      Returns the allocator associated with the slot map.
+    */
+    allocator_type get_allocator() const noexcept { return allocator_type(pages.get_allocator()); }
+
+    /*
+      Returns true if the slot map contains a specific key
+    */
+    bool has_key(key k) const noexcept
+    {
+        index_t index = key::toIndex(k);
+        if (index > getMaxValidIndex())
+        {
+            return false;
+        }
+        version_t version = key::toVersion(k);
+        if (reservedRange.meta)
+        {
+            return metaAt(reservedRange.meta, index)->isAlive(version);
+        }
+        PageAddr addr = getAddrFromIndex(index);
+        if (!isActivePage(addr))
+        {
+            return false;
+        }
+        return getMetaByAddr(addr).isAlive(version);
+    }
+
+    bool contains(key k) const noexcept { return has_key(k); }
+
+    /*
+      Clears the slot map and releases any allocated memory.
+      Note: By calling this function, you must guarantee that no handles are in use!
+      Otherwise calling this function might be dangerous and lead to key "collisions".
+      You might consider using "clear()" instead.
+    */
+    void reset()
+    {
+        callDtors();
+
+        numItems = 0;
+        maxValidIndex = 0;
+        needsFullDelta = true;
+
+        // Release used memory
+        for (Page& page : pages)
+        {
+            freePage(page);
+        }
+        pages.clear();
+        pages.shrink_to_fit();
+        releaseMappedFile();
+
+        freeIndices.release();
+        releaseCachedPageBlocks();
+        releasedPages.clear();
+        releasedPages.shrink_to_fit();
+        compactOrder.clear();
+        compactOrder.shrink_to_fit();
+    }
+
+    /*
+      Clears the slot map but keeps the allocated memory for reuse.
+      Automatically increases version for all the removed elements (the same as calling "erase()" for all existing elements)
+      Note: with set_release_empty_pages(true) emptied pages are released instead
+    */
+    void clear()
+    {
+        beginAllPagesWrite();
+        callDtors();
+        // one free queue growth for the whole map instead of one per erased element
+        freeIndices.reserve(freeIndices.size() + numItems);
+        for (size_t pageIndex = 0; pageIndex < pages.size(); pageIndex++)
+        {
+            Page& page = pages[pageIndex];
+            if (page.meta == nullptr || page.numAliveSlots == 0)
+            {
+                continue;
+            }
+            clearPage(static_cast<size_type>(pageIndex));
+        }
+        SLOT_MAP_ASSERT(numItems == 0);
+    }
+
+    /*
+      If key exists returns a const pointer to the value corresponding to the given key or returns null elsewere.
+    */
+    const T* get(key k) const noexcept { return getImpl(k); }
+
+    /*
+      If key exists returns a pointer to the value corresponding to the given key or returns null elsewere.
+      slot_sharing::copy_on_write: the pointer is invalidated by the first write to its page after the slot map is copied.
+    */
+    T* get(key k) noexcept(kSharing == slot_sharing::exclusive)
+    {
+        if constexpr (kSharing == slot_sharing::copy_on_write)
+        {
+            beginKeyPageWrite(k);
+        }
+        T* value = const_cast<T*>(getImpl(k));
+        if (kSharing == slot_sharing::exclusive && isTrackingDirtyPages && value)
+        {
+            markKeyPageDirty(k);
+        }
+        return value;
+    }
+
+    /*
+      Batched version of get(): values[i] receives the value pointer for keys[i] (or null if the key does not exist).
+      Lookups are software-pipelined and the found values are prefetched. For maps that do not fit into the cache, call it on chunks of a
+      few hundred keys and consume each chunk right away: if the caller does real work per value, the value misses overlap that work and
+      this is up to ~2x faster than a loop of get() calls; for a bare lookup+load it is about as fast as such a loop.
+      Returns the number of keys found.
+    */
+    size_type get_many(std::span<const key> keys, std::span<const T*> values) const noexcept
+    {
+        SLOT_MAP_ASSERT(values.size() >= keys.size());
+        size_type numFound = 0;
+        lookupMany<true>(keys.data(), keys.size(),
+                         [&](size_t i, const ValueStorage* v)
+                         {
+                             const T* value = reinterpret_cast<const T*>(v);
+                             values[i] = value;
+                             numFound += static_cast<size_type>(value != nullptr);
+                         });
+        return numFound;
+    }
+
+    size_type get_many(std::span<const key> keys, std::span<T*> values) noexcept(kSharing == slot_sharing::exclusive)
+    {
+        SLOT_MAP_ASSERT(values.size() >= keys.size());
+        if constexpr (kSharing == slot_sharing::copy_on_write)
+        {
+            for (key k : keys)
+            {
+                beginKeyPageWrite(k);
+            }
+        }
+        size_type numFound = 0;
+        lookupMany<true>(keys.data(), keys.size(),
+                         [&](size_t i, const ValueStorage* v)
+                         {
+                             T* value = const_cast<T*>(reinterpret_cast<const T*>(v));
+                             values[i] = value;
+                             numFound += static_cast<size_type>(value != nullptr);
+                         });
+        if (kSharing == slot_sharing::exclusive && isTrackingDirtyPages)
+        {
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                if (values[i])
+                {
+                    markKeyPageDirty(keys[i]);
+                }
+            }
+        }
+        return numFound;
+    }
+
+    /*
+      Batched version of has_key(): results[i] receives has_key(keys[i]).
+      Returns the number of keys found.
+    */
+    size_type has_key_many(std::span<const key> keys, std::span<bool> results) const noexcept
+    {
+        SLOT_MAP_ASSERT(results.size() >= keys.size());
+        size_type numFound = 0;
+        lookupMany<false>(keys.data(), keys.size(),
+                          [&](size_t i, const ValueStorage* v)
+                          {
+                              bool res = (v != nullptr);
+                              results[i] = res;
+                              numFound += static_cast<size_type>(res);
+                          });
+        return numFound;
+    }
+
+    /*
+      Constructs element in-place and returns a unique key that can be used to access this value.
+      Throws std::length_error if all the indices of the key type (key::kMaxIndex) are in use.
+    */
+    template <class... Args> key emplace(Args&&... args)
+    {
+        key k;
+        if (popRecycledKey(k))
+        {
+            index_t index = key::toIndex(k);
+            SLOT_MAP_ASSERT(index <= getMaxValidIndex());
+
+            PageAddr addr = getAddrFromIndex(index);
+            beginPageWrite(pages[addr.page]);
+            Meta& m = getMetaByAddr(addr);
+            SLOT_MAP_ASSERT(!m.isInactive());
+            SLOT_MAP_ASSERT(m.isTombstone());
+            SLOT_MAP_ASSERT(k.get_tag() == 0);
+
+            m.setAlive(m.getVersion());
+            pages[addr.page].setAlive(addr.index);
+
+            ValueStorage& v = getValueByAddr(addr);
+            SLOT_MAP_ASSERT(isPointerAligned(&v, alignof(T)));
+            construct<T>(&v, std::forward<Args>(args)...);
+            numItems++;
+            return k;
+        }
+
+        // allocate new item
+        index_t index = appendElement();
+        maxValidIndex = std::max(maxValidIndex, index);
+
+        PageAddr addr = getAddrFromIndex(index);
+        const Meta& m = getMetaByAddr(addr);
+        SLOT_MAP_ASSERT(!m.isTombstone());
+
+        ValueStorage& v = getValueByAddr(addr);
+        SLOT_MAP_ASSERT(isPointerAligned(&v, alignof(T)));
+        construct<T>(&v, std::forward<Args>(args)...);
+        numItems++;
+        k = key::make(m.getVersion(), index);
+        return k;
+    }
+
+    /*
+      Removes element (if such key exists) from the slot map.
+    */
+    void erase(key k) { eraseImpl<true>(k); }
+
+    /*
+      Removes element (if such key exists) from the slot map, returning the value at the key if the key was not previously removed.
+    */
+    std::optional<T> pop(key k)
+    {
+        T* val = get(k);
+        if (val == nullptr)
+        {
+            return {};
+        }
+
+        T res(std::move(*val));
+        eraseImpl<true>(k);
+        return res;
+    }
+
+    /*
+      Returns true if the slot map is empty.
+    */
+    bool empty() const noexcept { return (numItems == 0); }
+
+    /*
+      Returns the number of elements in the slot map.
+    */
+    size_type size() const noexcept { return numItems; }
+
+    /*
+      Pre-allocates page memory and page table capacity, so that the slot map can hold at least numElements elements
+      without touching the allocator (i.e. the next (numElements - size()) emplace calls never allocate).
+    */
+    void reserve(size_type numElements)
+    {
+        if (numElements <= numItems)
+        {
+            return;
+        }
+        if (reservedRange.memory)
+        {
+            // pages are committed in the reserved range on demand
+            pages.reserve(std::min(size_t(reservedRange.maxNumPages), (size_t(numElements) + kPageSize - 1) / kPageSize));
+            return;
+        }
+        size_type numRequired = numElements - numItems;
+        size_t numAvailable = cachedPageBlocks.size() * kPageSize;
+        if (!pages.empty() && pages.back().meta != nullptr)
+        {
+            numAvailable += kPageSize - pages.back().numUsedElements;
+        }
+        if (numAvailable < numRequired)
+        {
+            // push_back below never throws, so a new block can't leak
+            cachedPageBlocks.reserve(cachedPageBlocks.size() + (numRequired - numAvailable + kPageSize - 1) / kPageSize);
+        }
+        while (numAvailable < numRequired)
+        {
+            cachedPageBlocks.push_back(allocatePageBlock());
+            numAvailable += kPageSize;
+        }
+        // released pages are revived from cached blocks too
+        pages.reserve(pages.size() + cachedPageBlocks.size());
+    }
+
+    /*
+      Releases memory that is not needed to hold the current elements:
+      the page cache (including blocks pre-allocated by reserve()) and trailing pages without alive elements.
+      Released pages keep a compact version record, so stale keys are still rejected and the pages can be reused later.
+    */
+    void shrink_to_fit()
+    {
+        for (size_t pageIndex = pages.size(); pageIndex-- > 0;)
+        {
+            Page& page = pages[pageIndex];
+            if (page.meta == nullptr)
+            {
+                continue;
+            }
+            if (page.numAliveSlots != 0 || page.numInactiveSlots != 0)
+            {
+                break;
+            }
+            releasePage(static_cast<size_type>(pageIndex));
+        }
+        releaseCachedPageBlocks();
+    }
+
+    /*
+      Incremental compaction: moves up to `budget` alive elements out of the sparsest pages into free slots of the densest pages
+      and releases the pages that become empty (the same way as set_release_empty_pages() does).
+      onRemap(oldKey, newKey) is called for every moved element, oldKey is invalid from then on.
+
+      Returns the number of moved elements, 0 once there is nothing left to compact.
+      Every call starts from the current state of the slot map, so a compaction can be spread over many frames
+      (i.e. call compact(256, fn) once per frame) and interleaved with any other operations.
+
+      Elements are moved with memcpy if dod::is_trivially_relocatable<T> is true, with move constructor + destructor otherwise.
+      Every call also sorts the pages with alive elements by density, O(pages * log(pages)) on top of the moves, so prefer a larger
+      budget over many tiny calls on maps with a lot of pages. The page order buffer is kept between calls.
+      Note: pointers to moved elements are invalidated, key tags are not carried over to the new keys
+    */
+    template <typename FUNC> size_type compact(size_type budget, FUNC&& onRemap)
+    {
+        // pages with alive elements, sparse first
+        auto& order = compactOrder;
+        order.clear();
+        for (size_t pageIndex = 0; pageIndex < pages.size(); pageIndex++)
+        {
+            if (pages[pageIndex].meta && pages[pageIndex].numAliveSlots > 0)
+            {
+                order.push_back(static_cast<size_type>(pageIndex));
+            }
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [this](size_type a, size_type b) { return pages[a].numAliveSlots < pages[b].numAliveSlots; });
+
+        auto getNumFreeSlots = [](const Page& page) { return page.numUsedElements - page.numAliveSlots - page.numInactiveSlots; };
+
+        size_type numMoved = 0;
+        size_t lo = 0;
+        size_t hi = order.size();
+        size_type dstCursor = 0;
+        bool isSourceChecked = false;
+        // free slots of the destination pages order[lo + 1, hi)
+        size_t dstCapacity = 0;
+        for (size_t i = 1; i < hi; i++)
+        {
+            dstCapacity += getNumFreeSlots(pages[order[i]]);
+        }
+        auto nextSource = [&]()
+        {
+            lo++;
+            isSourceChecked = false;
+            if (lo < hi)
+            {
+                dstCapacity -= getNumFreeSlots(pages[order[lo]]);
+            }
+        };
+        while (numMoved < budget && lo + 1 < hi)
+        {
+            Page& src = pages[order[lo]];
+            Page& dst = pages[order[hi - 1]];
+            if (src.numInactiveSlots != 0)
+            {
+                // can't be released
+                nextSource();
+                continue;
+            }
+            // only start evacuating a page if the denser pages can take all its elements
+            if (!isSourceChecked)
+            {
+                if (dstCapacity < src.numAliveSlots)
+                {
+                    break;
+                }
+                isSourceChecked = true;
+            }
+
+            size_type dstIndex = findFreeSlot(dst, dstCursor);
+            if (dstIndex == kPageSize)
+            {
+                dstCapacity -= getNumFreeSlots(dst);
+                hi--;
+                dstCursor = 0;
+                continue;
+            }
+            dstCursor = dstIndex + 1;
+            PageAddr from = getAddrFromIndex(nextAliveIndex(getIndexFromAddr(PageAddr{order[lo], 0})));
+            SLOT_MAP_ASSERT(from.page == order[lo]);
+            size_t numDstFreeSlots = getNumFreeSlots(dst);
+            relocateElement(from, PageAddr{order[hi - 1], dstIndex}, onRemap);
+            dstCapacity -= numDstFreeSlots - getNumFreeSlots(dst);
+            numMoved++;
+
+            if (src.numInactiveSlots == kPageSize)
+            {
+                recyclePage(src);
+                nextSource();
+            }
+            else if (src.numAliveSlots == 0)
+            {
+                if (src.numInactiveSlots == 0)
+                {
+                    releasePage(order[lo]);
+                }
+                nextSource();
+            }
+        }
+        return numMoved;
+    }
+
+    /*
+      Enables or disables the release of pages whose elements were all erased (disabled by default).
+
+      When enabled, erasing the last alive element of a full page returns the page memory to the allocator right away,
+      so resident memory goes down after traffic peaks. Stale keys are still rejected and released pages are reused before the
+      slot map grows. Pages with version-exhausted (inactive) slots are never released.
+      Note: enabling the policy does not release already empty pages (see shrink_to_fit())
+    */
+    void set_release_empty_pages(bool enable) noexcept { releaseEmptyPages = enable; }
+
+    /*
+      Returns true if empty pages are released on erase.
+    */
+    bool release_empty_pages() const noexcept { return releaseEmptyPages; }
+
+    /*
+      Sets the number of threads used to run the element destructors in clear(), reset(), the destructor and on assignment
+      (1 by default, 0 = one per hardware thread).
+
+      Pages are destroyed in parallel, which helps tearing down huge maps of types with expensive destructors.
+      Trivially destructible types skip the destructor pass altogether, so the setting has no effect for them.
+      Threads that can't be started don't make the destructor throw, the calling thread takes over their pages.
+      Note: destructors of T must be safe to run concurrently for different elements
+    */
+    void set_destruction_threads(unsigned numThreads) noexcept { numDestructionThreads = numThreads; }
+
+    /*
+      Returns the number of threads used to run the element destructors.
+    */
+    unsigned destruction_threads() const noexcept { return numDestructionThreads; }
+
+    /*
+      Sets the maximum number of freed page blocks kept for reuse (kDefaultPageCacheCapacity by default).
+
+      Pages are freed when they are released (see set_release_empty_pages()), deactivated or dropped by copy assignment.
+      New pages and copies take blocks from the cache first. Use page_cache_stats() to size the cache.
+      Note: blocks pre-allocated by reserve() are kept regardless of the capacity, the capacity is not copied along with the content
+    */
+    void set_page_cache_capacity(size_type numPages)
+    {
+        pageCacheCapacity = numPages;
+        while (cachedPageBlocks.size() > pageCacheCapacity)
+        {
+            freePageBlock(cachedPageBlocks.back());
+            cachedPageBlocks.pop_back();
+        }
+    }
+
+    /*
+      Returns the maximum number of freed page blocks kept for reuse.
+    */
+    size_type page_cache_capacity() const noexcept { return pageCacheCapacity; }
+
+    struct PageCacheStats
+    {
+        // page allocations served from the cache
+        uint64_t numHits = 0;
+        // page allocations that went to the allocator
+        uint64_t numMisses = 0;
+        size_type numCachedPages = 0;
+    };
+
+    /*
+      Returns the page cache counters (accumulated over the lifetime of the slot map).
+    */
+    PageCacheStats page_cache_stats() const noexcept
+    {
+        PageCacheStats stats;
+        stats.numHits = pageCacheHits;
+        stats.numMisses = pageCacheMisses;
+        stats.numCachedPages = static_cast<size_type>(cachedPageBlocks.size());
+        return stats;
+    }
+
+    /*
+      Switches an empty slot map to the reserved range storage mode.
+
+      One virtual address range for up to maxNumElements slots is reserved up front and pages are committed in it on demand.
+      Values and metadata are addressed as base + index, so get() and has_key() read the slot directly instead of going through
+      the page table, and pointers to values stay stable.
+      Freed pages (see set_release_empty_pages()) give their physical memory back (madvise(MADV_DONTNEED)) but keep their addresses.
+
+      Returns false if the slot map is not empty, uses slot_sharing::copy_on_write or the address range can't be reserved
+      (the slot map keeps using regular page allocations).
+      Note: emplace() throws std::bad_alloc once the reserved range is exhausted, reset() keeps the mode
+    */
+    bool use_reserved_range(size_type maxNumElements)
+    {
+        if (!pages.empty() || reservedRange.memory || kSharing == slot_sharing::copy_on_write)
+        {
+            return false;
+        }
+        size_t maxNumPages = std::min((size_t(maxNumElements) + kPageSize - 1) / kPageSize, (size_t(key::kMaxIndex) + 1) / kPageSize);
+        releaseCachedPageBlocks();
+        return reserveRange(static_cast<size_type>(maxNumPages), getRangeApi());
+    }
+
+    /*
+      Returns the number of slots of the reserved range (0 if the slot map doesn't use the reserved range storage mode).
+    */
+    size_type reserved_range_capacity() const noexcept
+    {
+        size_t numSlots = size_t(reservedRange.maxNumPages) * kPageSize;
+        return static_cast<size_type>(std::min(numSlots, size_t(std::numeric_limits<size_type>::max())));
+    }
+
+    /*
+      Writes the slot map into a binary snapshot file: the page table, the free queue and the content of every active page
+      (values, metadata and alive bits as they are laid out in memory). The page contents are aligned to 4K in the file,
+      so load(path, load_mode::map) can use them in place. Only for trivially copyable types.
+
+      The snapshot is written to path + ".tmp" and renamed over path once it is complete, so a failed or interrupted save()
+      never damages an existing snapshot, and slot maps that have the old file mapped (load_mode::map) keep their content.
+      Returns false if the file can't be written.
+    */
+    bool save(const char* path) const
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshots store the values as raw bytes");
+        static_assert(Page::getBlockAlignment() <= kSnapshotAlignment, "Page content can't be mapped with this alignment");
+        std::string tempPath = std::string(path) + ".tmp";
+        std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+        if (!file)
+        {
+            return false;
+        }
+        bool isWritten = writeSnapshot(file) && (std::fflush(file) == 0) && vm::sync_file(file);
+        isWritten = (std::fclose(file) == 0) && isWritten;
+        if (!isWritten || !vm::replace_file(tempPath.c_str(), path))
+        {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    /*
+      Replaces the content of the slot map by the content of a snapshot file written by save().
+      All the keys of the saved slot map stay valid and the free queue is restored, so emplace() hands out the same keys as
+      the saved slot map would.
+
+      load_mode::copy reads the pages into regular page memory and checks the metadata and alive bits of every page against each other.
+      load_mode::map maps the file and points the pages into it: only the header and the page table are read and checked while loading,
+      the page content is read from disk when it is accessed and is trusted as it is, like the values. The mapping is private
+      (changes never reach the file) and lives until the slot map is reset, cleared by assignment or destroyed.
+      The reserved range mode and slot_sharing::copy_on_write always load a copy.
+
+      Returns false if the file can't be read or was written by a slot map with a different memory layout (value size and alignment,
+      key type, page size or slot layout), the slot map is left empty then.
+    */
+    bool load(const char* path, load_mode mode = load_mode::copy)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Snapshots store the values as raw bytes");
+        static_assert(Page::getBlockAlignment() <= kSnapshotAlignment, "Page content can't be mapped with this alignment");
+        bool canMap = (mode == load_mode::map) && !reservedRange.memory && kSharing == slot_sharing::exclusive;
+        return loadWith([&]() { return canMap ? loadMapped(path) : loadCopy(path); });
+    }
+
+    /*
+      Streams the slot map to write(std::span<const std::byte>) -> bool one page at a time: a header, the counters and the content of
+      every page, the released pages and the free queue. Nothing is buffered on the way (values of trivially copyable types are written
+      straight from page memory), so a slot map that doesn't fit into memory twice can still be written to a file, a socket or a
+      compressor. Values of other types are written one by one through dod::slot_map_codec<T>.
+      Returns false as soon as write() returns false.
+    */
+    template <typename WRITE> bool save_stream(WRITE&& write) const
+    {
+        SnapshotHeader header = makeSnapshotHeader();
+        std::memcpy(header.magic, kStreamMagic, sizeof(header.magic));
+        header.numPages = pages.size();
+        header.numItems = numItems;
+        header.maxValidIndex = maxValidIndex;
+        header.numFreeIndices = freeIndices.size();
+        header.numReleasedPages = releasedPages.size();
+        if (!writeBytes(write, &header, sizeof(header)))
+        {
+            return false;
+        }
+
+        for (const Page& page : pages)
+        {
+            StreamPage entry = makeStreamPage(page);
+            if (!writeBytes(write, &entry, sizeof(entry)) || (page.meta && !writeStreamPage(write, page)))
+            {
+                return false;
+            }
+        }
+        return writeChunked<uint32_t>(write, releasedPages.size(), [&](size_t i) { return static_cast<uint32_t>(releasedPages[i]); }) &&
+               writeChunked<key>(write, size_t(freeIndices.size()), [&](size_t i) { return freeIndices[static_cast<size_type>(i)]; });
+    }
+
+    /*
+      Replaces the content of the slot map by a stream written by save_stream(). read(std::span<std::byte>) -> bool has to fill the
+      whole span and return false at the end of the stream or on errors. Pages are rebuilt as their records arrive, so the only memory
+      used on top of the slot map itself is a small fixed size buffer.
+      The same as for load(): all the keys stay valid and the free queue is restored.
+
+      Returns false if the stream is incomplete, malformed or was written by a slot map with a different memory layout
+      (the slot map is left empty then).
+    */
+    template <typename READ> bool load_stream(READ&& read)
+    {
+        return loadWith([&]() { return readStream(read); });
+    }
+
+    /*
+      Incremental replication: writes the changes since the previous collect_delta() call to write(std::span<const std::byte>) -> bool
+      (the same sink as for save_stream) and starts a new checkpoint. A delta holds the pages that changed (emplace, erase, clear,
+      compact or non-const access through get, get_many, iterators, items or for_each...) with their whole content, the page table
+      changes and the changes of the free queue, so its size is proportional to the write set and not to the size of the slot map.
+      Use a const reference for read-only access, non-const iteration marks every page with alive elements as changed.
+      Non-const access is only tracked once collect_delta() was called, so slot maps that are not replicated never pay for it
+      (the first delta is a full one anyway).
+
+      The first delta of a slot map (and the first one after reset, assignment, swap or load) is a full delta with all the pages,
+      full = true forces one (i.e. to bring up a new replica, replicas that are up to date can apply it as well).
+      Returns false as soon as write() returns false, the next delta is a full one then.
+    */
+    template <typename WRITE> bool collect_delta(WRITE&& write, bool full = false)
+    {
+        isTrackingDirtyPages = true;
+        bool isFull = full || needsFullDelta;
+        if (!writeDelta(write, isFull))
+        {
+            needsFullDelta = true;
+            return false;
+        }
+        for (Page& page : pages)
+        {
+            page.isDirty = false;
+        }
+        freeIndices.resetChangeCounters();
+        deltaSequence++;
+        needsFullDelta = false;
+        return true;
+    }
+
+    /*
+      Applies a delta written by collect_delta() of another slot map of the same type (the primary), in place: only the pages in the
+      delta are rebuilt. After that the slot map has the same content, keys and free queue as the primary had at collect_delta().
+      A replica must not be modified other than by apply_delta().
+
+      Returns false and leaves the slot map untouched if the delta doesn't directly follow the last applied one (a replica that missed
+      a delta needs a full delta) or was written by a slot map with a different memory layout.
+      Returns false and leaves the slot map empty if the delta turns out to be incomplete or malformed while it is applied.
+    */
+    template <typename READ> bool apply_delta(READ&& read)
+    {
+        DeltaHeader header;
+        if (!readBytes(read, &header, sizeof(header)) || !isValidSnapshotHeader(header.content, kDeltaMagic) ||
+            header.numDirtyPages > header.content.numPages || (header.isFull == 0 && header.baseSequence != deltaSequence))
+        {
+            return false;
+        }
+        bool isApplied = false;
+        try
+        {
+            isApplied = readDelta(read, header);
+        }
+        catch (...)
+        {
+            reset();
+            deltaSequence = 0;
+            throw;
+        }
+        if (!isApplied)
+        {
+            reset();
+            deltaSequence = 0;
+            return false;
+        }
+        deltaSequence = header.baseSequence + 1;
+        return true;
+    }
+
+    /*
+      Exchanges the content of the slot map by the content of another slot map object of the same type.
+    */
+    void swap(slot_map& other) noexcept
+    {
+        pages.swap(other.pages);
+        freeIndices.swap(other.freeIndices);
+        cachedPageBlocks.swap(other.cachedPageBlocks);
+        releasedPages.swap(other.releasedPages);
+        compactOrder.swap(other.compactOrder);
+        std::swap(numItems, other.numItems);
+        std::swap(maxValidIndex, other.maxValidIndex);
+        std::swap(releaseEmptyPages, other.releaseEmptyPages);
+        std::swap(pageCacheCapacity, other.pageCacheCapacity);
+        std::swap(numDestructionThreads, other.numDestructionThreads);
+        std::swap(pageCacheHits, other.pageCacheHits);
+        std::swap(pageCacheMisses, other.pageCacheMisses);
+        std::swap(reservedRange, other.reservedRange);
+        std::swap(mappedFile, other.mappedFile);
+        std::swap(deltaSequence, other.deltaSequence);
+        needsFullDelta = other.needsFullDelta = true;
+    }
+
+    // copy constructor
+    slot_map(const slot_map& other)
+        : slot_map(AllocatorTraits::select_on_container_copy_construction(other.get_allocator()))
+    {
+        copyFrom(other);
+    }
+
+    // copy assignment (note: allocators are never propagated on assignment, the same as for std::pmr containers)
+    slot_map& operator=(const slot_map& other)
+    {
+        if (this != &other)
+        {
+            copyFrom(other);
+        }
+        return *this;
+    }
+
+    /*
+      Replaces the content with a copy of another slot map using numThreads threads (0 = one per hardware thread).
+      The same as copy assignment, but the pages are split between the threads, which helps cloning huge maps.
+      Note: copy constructors of T must be safe to run concurrently for different elements
+    */
+    void copy_from(const slot_map& other, unsigned numThreads = 0)
+    {
+        if (this != &other)
+        {
+            copyFrom(other, numThreads);
+        }
+    }
+
+    // move constructor
+    slot_map(slot_map&& other) noexcept
+        : slot_map(other.get_allocator())
+    {
+        numItems = other.numItems;
+        maxValidIndex = other.maxValidIndex;
+        pages.swap(other.pages);
+        freeIndices.swap(other.freeIndices);
+        cachedPageBlocks.swap(other.cachedPageBlocks);
+        releasedPages.swap(other.releasedPages);
+        compactOrder.swap(other.compactOrder);
+        std::swap(releaseEmptyPages, other.releaseEmptyPages);
+        std::swap(pageCacheCapacity, other.pageCacheCapacity);
+        std::swap(numDestructionThreads, other.numDestructionThreads);
+        std::swap(pageCacheHits, other.pageCacheHits);
+        std::swap(pageCacheMisses, other.pageCacheMisses);
+        std::swap(reservedRange, other.reservedRange);
+        std::swap(mappedFile, other.mappedFile);
+        std::swap(deltaSequence, other.deltaSequence);
+        other.numItems = 0;
+        other.maxValidIndex = 0;
+        other.needsFullDelta = true;
+    }
+
+    // move asignment
+    slot_map& operator=(slot_map&& other) noexcept(AllocatorTraits::is_always_equal::value)
+    {
+        if constexpr (!AllocatorTraits::is_always_equal::value)
+        {
+            if (get_allocator() != other.get_allocator())
+            {
+                // memory of the other slot map can't be taken over, move the elements one by one
+                copyFrom<true>(other);
+                other.reset();
+                return *this;
+            }
+        }
+
+        // reset and swap
+        reset();
+
+        pages.swap(other.pages);
+        freeIndices.swap(other.freeIndices);
+        cachedPageBlocks.swap(other.cachedPageBlocks);
+        releasedPages.swap(other.releasedPages);
+        compactOrder.swap(other.compactOrder);
+        std::swap(numItems, other.numItems);
+        std::swap(maxValidIndex, other.maxValidIndex);
+        std::swap(releaseEmptyPages, other.releaseEmptyPages);
+        std::swap(pageCacheCapacity, other.pageCacheCapacity);
+        std::swap(numDestructionThreads, other.numDestructionThreads);
+        std::swap(pageCacheHits, other.pageCacheHits);
+        std::swap(pageCacheMisses, other.pageCacheMisses);
+        std::swap(reservedRange, other.reservedRange);
+        std::swap(mappedFile, other.mappedFile);
+        std::swap(deltaSequence, other.deltaSequence);
+        needsFullDelta = other.needsFullDelta = true;
+        return *this;
+    }
+
+    struct Stats
+    {
+        size_type numPagesTotal = 0;
+        size_type numInactivePages = 0;
+        size_type numActivePages = 0;
+        size_type numReleasedPages = 0;
+        size_type numCachedPages = 0;
+        // active pages whose memory is shared with other slot maps (slot_sharing::copy_on_write)
+        size_type numSharedPages = 0;
+
+        size_type numItemsTotal = 0;
+        size_type numAliveItems = 0;
+        size_type numTombstoneItems = 0;
+        size_type numInactiveItems = 0;
+    };
+
+    /*
+      Returns the internal stats for debug purposes
+
+      Note: O(n) complexity!
+    */
+    Stats debug_stats() const noexcept
+    {
+        Stats stats;
+        stats.numPagesTotal = static_cast<size_type>(pages.size());
+        stats.numCachedPages = static_cast<size_type>(cachedPageBlocks.size());
+
+        for (size_t pageIndex = 0; pageIndex < pages.size(); pageIndex++)
+        {
+            const Page& page = pages[pageIndex];
+            if (page.isReleased())
+            {
+                stats.numReleasedPages++;
+                continue;
+            }
+            if (page.meta == nullptr)
+            {
+                stats.numInactivePages++;
+                continue;
+            }
+            stats.numActivePages++;
+            stats.numSharedPages += page.isShared() ? 1 : 0;
+
+            stats.numItemsTotal += page.numUsedElements;
+            for (size_type elementIndex = 0; elementIndex < page.numUsedElements; elementIndex++)
+            {
+                PageAddr addr;
+                addr.page = static_cast<size_type>(pageIndex);
+                addr.index = static_cast<size_type>(elementIndex);
+                const Meta& m = getMetaByAddr(addr);
+                if (m.isInactive())
+                {
+                    stats.numInactiveItems++;
+                }
+                else if (m.isTombstone())
+                {
+                    stats.numTombstoneItems++;
+                }
+                else
+                {
+                    stats.numAliveItems++;
+                }
+            }
+        }
+        return stats;
+    }
+
+    /*
+      Calls fn(values, aliveMask, baseIndex) once for every active page:
+        values    - std::span<T> over the first numUsedElements slots of the page, values[i] is the slot with global index (baseIndex + i)
+        aliveMask - std::span<const uint64_t>, bit (i % 64) of aliveMask[i / 64] is set if values[i] holds a live element
+
+      Tombstoned slots stay in the span so that kernels can run branch-free masked loops over contiguous memory,
+      but they do not hold live objects: never read them as T (unless T is trivially copyable) and never write to them.
+
+      Only available with slot_layout::split (interleaved values are not contiguous).
+    */
+    template <typename FUNC> void for_each_chunk(FUNC&& fn) const { forEachChunkImpl<true>(this, fn); }
+    template <typename FUNC> void for_each_chunk(FUNC&& fn)
+    {
+        beginAllPagesWrite();
+        forEachChunkImpl<false>(this, fn);
+    }
+
+    /*
+      Parallel traversal: calls fn(value) (parallel_for_each) or fn(key, value) (parallel_items) for every element using numThreads threads
+      (0 = std::thread::hardware_concurrency()). Work is split and stolen at page granularity.
+
+      fn is called concurrently for different elements, so it must be thread-safe. If fn throws, the remaining pages are skipped and
+      the first exception is rethrown once all the threads are done. The slot map itself must not be modified until the call returns.
+    */
+    template <typename FUNC> void parallel_for_each(FUNC&& fn, unsigned numThreads = 0) const
+    {
+        parallelForEachImpl<true, false>(this, fn, numThreads);
+    }
+    template <typename FUNC> void parallel_for_each(FUNC&& fn, unsigned numThreads = 0)
+    {
+        beginAllPagesWrite();
+        parallelForEachImpl<false, false>(this, fn, numThreads);
+    }
+    template <typename FUNC> void parallel_items(FUNC&& fn, unsigned numThreads = 0) const
+    {
+        parallelForEachImpl<true, true>(this, fn, numThreads);
+    }
+    template <typename FUNC> void parallel_items(FUNC&& fn, unsigned numThreads = 0)
+    {
+        beginAllPagesWrite();
+        parallelForEachImpl<false, true>(this, fn, numThreads);
+    }
+
+  public:
+    // iterators.....
+
+    // for(const auto& kv : slot_map.items()) {} // key/value
+    // for(const auto& v : slot_map) {} // values only
+
+    // values iterator implementation...................................
+    template <bool IsConst> class values_iterator_impl
+    {
+      private:
+        using slot_map_ptr = std::conditional_t<IsConst, const slot_map*, slot_map*>;
+        using value_ptr = std::conditional_t<IsConst, const T*, T*>;
+        using value_ref = std::conditional_t<IsConst, const T&, T&>;
+        using storage_ref = std::conditional_t<IsConst, const ValueStorage&, ValueStorage&>;
+
+        value_ptr getCurrent() const noexcept
+        {
+            SLOT_MAP_ASSERT(currentIndex <= slotMap->getMaxValidIndex());
+            PageAddr addr = slotMap->getAddrFromIndex(currentIndex);
+            SLOT_MAP_ASSERT(slotMap->isActivePage(addr));
+            storage_ref v = slotMap->getValueByAddr(addr);
+            SLOT_MAP_ASSERT(slotMap->isPointerAligned(&v, alignof(T)));
+            return reinterpret_cast<value_ptr>(&v);
+        }
+
+      public:
+        explicit values_iterator_impl(slot_map_ptr _slotMap, size_type index) noexcept
+            : slotMap(_slotMap)
+            , currentIndex(index)
+        {
         }
-        else
+
+        // Allow non-const to const conversion
+        template <bool OtherIsConst, typename = std::enable_if_t<IsConst && !OtherIsConst>>
+        values_iterator_impl(const values_iterator_impl<OtherIsConst>& other) noexcept
+            : slotMap(other.slotMap)
+            , currentIndex(other.currentIndex)
         {
-            // increase version
-            slotVersion = key::increaseVersion(slotVersion);
-            SLOT_MAP_ASSERT(slotVersion != key::kInvalidVersion);
-            SLOT_MAP_ASSERT(slotVersion > m.version);
         }
 
-        m.version = slotVersion;
-        m.tombstone = 1;
+        value_ref operator*() const noexcept { return *getCurrent(); }
+        value_ptr operator->() const noexcept { return getCurrent(); }
+
+        bool operator==(const values_iterator_impl& other) const noexcept
+        {
+            return slotMap == other.slotMap && currentIndex == other.currentIndex;
+        }
+        bool operator!=(const values_iterator_impl& other) const noexcept
+        {
+            return slotMap != other.slotMap || currentIndex != other.currentIndex;
+        }
 
-        if constexpr (!std::is_trivially_destructible<T>::value)
+        values_iterator_impl& operator++() noexcept
         {
-            ValueStorage& v = getValueByAddr(addr);
-            SLOT_MAP_ASSERT(isPointerAligned(&v, alignof(T)));
-            const T* pv = reinterpret_cast<const T*>(&v);
-            destruct(pv);
+            currentIndex = slotMap->nextAliveIndex(currentIndex + 1);
+            return *this;
+        }
+
+        values_iterator_impl operator++(int) noexcept
+        {
+            values_iterator_impl res = *this;
+            ++*this;
+            return res;
+        }
+
+      private:
+        slot_map_ptr slotMap;
+        size_type currentIndex;
+
+        template <bool> friend class values_iterator_impl;
+    };
+
+    // Type aliases for clean API
+    using const_values_iterator = values_iterator_impl<true>;
+    using values_iterator = values_iterator_impl<false>;
+
+    const_values_iterator begin() const noexcept
+    {
+        if (pages.empty())
+            return end();
+
+        return const_values_iterator(this, nextAliveIndex(0));
+    }
+    const_values_iterator end() const noexcept { return const_values_iterator(this, getMaxValidIndex() + static_cast<size_type>(1)); }
+
+    // slot_sharing::copy_on_write: makes all the pages private, references to values follow the same rules as get()
+    values_iterator begin() noexcept(kSharing == slot_sharing::exclusive)
+    {
+        beginAllPagesWrite();
+        if (pages.empty())
+            return end();
+
+        return values_iterator(this, nextAliveIndex(0));
+    }
+    values_iterator end() noexcept { return values_iterator(this, getMaxValidIndex() + static_cast<size_type>(1)); }
+
+    // key-value iterator implementation...................................
+    template <bool IsConst> class kv_iterator_impl
+    {
+      public:
+        // pretty much similar to std::reference_wrapper
+        template <typename TYPE> struct reference
+        {
+            TYPE* ptr = nullptr;
+
+            explicit reference(TYPE* _ptr)
+                : ptr(_ptr)
+            {
+            }
+
+            reference(const reference& /*other*/) noexcept = default;
+            reference(reference&& /*other*/) noexcept = default;
+            reference& operator=(const reference& /*other*/) noexcept = default;
+            reference& operator=(reference&& /*other*/) noexcept = default;
+
+            void set(TYPE* _ptr) noexcept { ptr = _ptr; }
+
+            TYPE& get() const noexcept
+            {
+                SLOT_MAP_ASSERT(ptr);
+                return *ptr;
+            }
+
+            operator TYPE&() const noexcept { return get(); }
+        };
+
+        using slot_map_ptr = std::conditional_t<IsConst, const slot_map*, slot_map*>;
+        using value_ptr = std::conditional_t<IsConst, const T*, T*>;
+        using storage_ref = std::conditional_t<IsConst, const ValueStorage&, ValueStorage&>;
+        using KeyValue = std::conditional_t<IsConst, std::pair<key, const reference<const T>>, std::pair<key, reference<T>>>;
+
+      private:
+        void updateTmpKV() const noexcept
+        {
+            SLOT_MAP_ASSERT(currentIndex <= slotMap->getMaxValidIndex());
+            PageAddr addr = slotMap->getAddrFromIndex(currentIndex);
+            SLOT_MAP_ASSERT(slotMap->isActivePage(addr));
+            const Meta& m = slotMap->getMetaByAddr(addr);
+            storage_ref v = slotMap->getValueByAddr(addr);
+            SLOT_MAP_ASSERT(slotMap->isPointerAligned(&v, alignof(T)));
+            value_ptr value = reinterpret_cast<value_ptr>(&v);
+            tmpKv.first = key::make(m.getVersion(), index_t(currentIndex));
+
+            if constexpr (IsConst)
+            {
+                const_cast<reference<const T>&>(tmpKv.second).set(value);
+            }
+            else
+            {
+                tmpKv.second.set(value);
+            }
+        }
+
+      public:
+        explicit kv_iterator_impl(slot_map_ptr _slotMap, size_type index) noexcept
+            : slotMap(_slotMap)
+            , currentIndex(index)
+            , tmpKv(key::invalid(), std::conditional_t<IsConst, reference<const T>, reference<T>>(nullptr))
+        {
+        }
+
+        // Allow non-const to const conversion
+        template <bool OtherIsConst, typename = std::enable_if_t<IsConst && !OtherIsConst>>
+        kv_iterator_impl(const kv_iterator_impl<OtherIsConst>& other) noexcept
+            : slotMap(other.slotMap)
+            , currentIndex(other.currentIndex)
+            , tmpKv(key::invalid(), reference<const T>(nullptr))
+        {
+        }
+
+        const KeyValue& operator*() const noexcept
+        {
+            updateTmpKV();
+            return tmpKv;
+        }
+
+        const KeyValue* operator->() const noexcept
+        {
+            updateTmpKV();
+            return &tmpKv;
+        }
+
+        bool operator==(const kv_iterator_impl& other) const noexcept
+        {
+            return slotMap == other.slotMap && currentIndex == other.currentIndex;
+        }
+        bool operator!=(const kv_iterator_impl& other) const noexcept
+        {
+            return slotMap != other.slotMap || currentIndex != other.currentIndex;
+        }
+
+        kv_iterator_impl& operator++() noexcept
+        {
+            currentIndex = slotMap->nextAliveIndex(currentIndex + 1);
+            return *this;
+        }
+
+        kv_iterator_impl operator++(int) noexcept
+        {
+            kv_iterator_impl res = *this;
+            ++*this;
+            return res;
+        }
+
+      private:
+        slot_map_ptr slotMap;
+        size_type currentIndex;
+        // unfortunately we need this to make it look like standard STL iterator (operator* and operator->)
+        mutable KeyValue tmpKv;
+
+        template <bool> friend class kv_iterator_impl;
+    };
+
+    // Type aliases for clean API
+    using const_kv_iterator = kv_iterator_impl<true>;
+    using kv_iterator = kv_iterator_impl<false>;
+
+    // proxy items object
+    template <bool IsConst> class items_impl
+    {
+        using slot_map_ptr = std::conditional_t<IsConst, const slot_map*, slot_map*>;
+        using iterator_type = std::conditional_t<IsConst, const_kv_iterator, kv_iterator>;
+
+        slot_map_ptr slotMap;
+
+      public:
+        explicit items_impl(slot_map_ptr _slotMap) noexcept
+            : slotMap(_slotMap)
+        {
+        }
+
+        iterator_type begin() const noexcept
+        {
+            if (slotMap->pages.empty())
+                return end();
+            return iterator_type(slotMap, slotMap->nextAliveIndex(0));
+        }
+        iterator_type end() const noexcept { return iterator_type(slotMap, slotMap->getMaxValidIndex() + static_cast<size_type>(1)); }
+    };
+
+    using Items = items_impl<true>;
+    using MutableItems = items_impl<false>;
+
+    Items items() const noexcept { return Items(this); }
+    // slot_sharing::copy_on_write: makes all the pages private, references to values follow the same rules as get()
+    MutableItems items() noexcept(kSharing == slot_sharing::exclusive)
+    {
+        beginAllPagesWrite();
+        return MutableItems(this);
+    }
+
+  private:
+    std::vector<Page, RebindAllocator<Page>> pages;
+    FreeIndexQueue freeIndices;
+    // page cache: freed page memory blocks and blocks pre-allocated by reserve(), new pages take them first
+    std::vector<void*, RebindAllocator<void*>> cachedPageBlocks;
+    // indices of released pages that can be revived
+    std::vector<size_type, RebindAllocator<size_type>> releasedPages;
+    // scratch buffer of compact(), reused between calls
+    std::vector<size_type, RebindAllocator<size_type>> compactOrder;
+    size_type numItems;
+    index_t maxValidIndex;
+    bool releaseEmptyPages = false;
+    ReservedRange reservedRange;
+    MappedFile mappedFile;
+    size_type pageCacheCapacity = kDefaultPageCacheCapacity;
+    unsigned numDestructionThreads = 1;
+    uint64_t pageCacheHits = 0;
+    uint64_t pageCacheMisses = 0;
+    // the number of deltas collected (primary) or applied (replica), see collect_delta
+    uint64_t deltaSequence = 0;
+    bool needsFullDelta = true;
+    // set by the first collect_delta(), non-const access marks pages dirty from then on
+    bool isTrackingDirtyPages = false;
+};
+
+template <class T, size_t PAGESIZE = 4096, size_t MINFREEINDICES = 64, class TAllocator = stl::Allocator<T, alignof(void*)>,
+          slot_layout LAYOUT = slot_layout::split>
+using slot_map32 = slot_map<T, dod::slot_map_key32<T>, PAGESIZE, MINFREEINDICES, TAllocator, LAYOUT>;
+
+template <class T, size_t PAGESIZE = 4096, size_t MINFREEINDICES = 64, class TAllocator = stl::Allocator<T, alignof(void*)>,
+          slot_layout LAYOUT = slot_layout::split>
+using slot_map64 = slot_map<T, dod::slot_map_key64<T>, PAGESIZE, MINFREEINDICES, TAllocator, LAYOUT>;
+
+// slot map with interleaved {Meta, T} slots (see slot_layout)
+template <class T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4096, size_t MINFREEINDICES = 64,
+          class TAllocator = stl::Allocator<T, alignof(void*)>>
+using interleaved_slot_map = slot_map<T, TKeyType, PAGESIZE, MINFREEINDICES, TAllocator, slot_layout::interleaved>;
+
+// slot map with copy-on-write pages, copies are cheap snapshots (see slot_sharing)
+template <class T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4096, size_t MINFREEINDICES = 64,
+          class TAllocator = stl::Allocator<T, alignof(void*)>, slot_layout LAYOUT = slot_layout::split>
+using cow_slot_map = slot_map<T, TKeyType, PAGESIZE, MINFREEINDICES, TAllocator, LAYOUT, slot_sharing::copy_on_write>;
+
+/*
+  A slot map companion that keeps all the values in one packed contiguous array.
+
+  Keys are the same as for slot_map: a key index points into a sparse slot table (version + position in the dense array),
+  the values live in a dense array with no holes. Erase moves the last value into the hole (swap-and-pop), so:
+    - iteration is a plain loop over std::span<T> (values() or begin/end), the order of the values changes on erase
+    - get() costs one more indirection than slot_map (slot table -> dense array)
+    - pointers to values are NOT stable, they are invalidated by emplace() and erase()
+    - T must be move constructible and move assignable
+
+  Usage example:
+  ```
+  dense_slot_map<Particle> particles;
+  auto p = particles.emplace(...);
+  for (Particle& particle : particles.values())
+  {
+    particle.update(dt);
+  }
+  particles.erase(p);
+  ```
+*/
+template <typename T, typename TKeyType = slot_map_key64<T>, size_t MINFREEINDICES = 64,
+          typename TAllocator = stl::Allocator<T, alignof(void*)>>
+class dense_slot_map
+{
+  public:
+    using key = TKeyType;
+    using version_t = typename TKeyType::version_t;
+    using index_t = typename TKeyType::index_t;
+    using size_type = uint32_t;
+    using allocator_type = TAllocator;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    // See slot_map::kMinFreeIndices
+    static inline constexpr size_type kMinFreeIndices = static_cast<size_type>(MINFREEINDICES);
+
+  private:
+    template <typename U> using RebindAllocator = typename std::allocator_traits<TAllocator>::template rebind_alloc<U>;
+
+    /*
+      Sparse slot: the version packed with an alive marker (top bit) and
+      the position of the value in the dense array (alive slots) or the next slot in the free list (free slots)
+    */
+    struct Slot
+    {
+        static inline constexpr version_t kAliveFlag = static_cast<version_t>(version_t(1) << (sizeof(version_t) * 8 - 1));
+        static_assert(key::kMaxVersion < kAliveFlag, "Not enough bits to pack version and alive marker");
+
+        index_t denseIndex;
+        version_t bits;
+
+        version_t getVersion() const noexcept { return static_cast<version_t>(bits & ~kAliveFlag); }
+        bool isAlive(version_t version) const noexcept { return bits == static_cast<version_t>(version | kAliveFlag); }
+    };
+
+    static inline constexpr index_t kInvalidIndex = std::numeric_limits<index_t>::max();
+
+    const Slot* getSlot(key k) const noexcept
+    {
+        index_t index = key::toIndex(k);
+        if (index >= slots.size())
+        {
+            return nullptr;
         }
-        numItems--;
+        const Slot& slot = slots[index];
+        return slot.isAlive(key::toVersion(k)) ? &slot : nullptr;
+    }
 
-        if (deactivateSlot)
+    // FIFO of free slots threaded through Slot::denseIndex (oldest first, see slot_map::kMinFreeIndices)
+    void pushFreeSlot(index_t index) noexcept
+    {
+        slots[index].denseIndex = kInvalidIndex;
+        if (numFreeSlots == 0)
         {
-            Page& page = pages[addr.page];
-            page.numInactiveSlots++;
-            if (page.numInactiveSlots == kPageSize)
-            {
-                page.deallocate();
-                return EraseResult::ErasedAndPageDeactivated;
-            }
+            freeHead = index;
         }
         else
         {
-            // recycle index id (note: tag is not saved!)
-            freeIndices.emplace_back(key::clearTagAndUpdateVersion(k, slotVersion));
+            slots[freeTail].denseIndex = index;
         }
-        return EraseResult::ErasedAndIndexRecycled;
+        freeTail = index;
+        numFreeSlots++;
     }
 
-  public:
-    slot_map()
-        : numItems(0)
-        , maxValidIndex(0)
+    index_t popFreeSlot() noexcept
     {
+        SLOT_MAP_ASSERT(numFreeSlots > 0);
+        index_t index = freeHead;
+        freeHead = slots[index].denseIndex;
+        numFreeSlots--;
+        return index;
     }
-    ~slot_map() { callDtors(); }
 
-    /*
-      Returns true if the slot map contains a specific key
-    */
-    bool has_key(key k) const noexcept
+    // Marks the slot as free with a bumped version, a slot whose versions are exhausted is retired
+    void releaseSlot(index_t index) noexcept
     {
-        index_t index = key::toIndex(k);
-        if (index > getMaxValidIndex())
-        {
-            return false;
-        }
-        version_t version = key::toVersion(k);
-        PageAddr addr = getAddrFromIndex(index);
-        if (!isActivePage(addr))
+        Slot& slot = slots[index];
+        version_t version = slot.getVersion();
+        if (version >= key::kMaxVersion)
         {
-            return false;
+            slot.bits = version;
+            slot.denseIndex = kInvalidIndex;
+            numRetiredSlots++;
+            return;
         }
-        const Meta& m = getMetaByAddr(addr);
-        if (m.tombstone != 0 || m.inactive != 0)
+        slot.bits = key::increaseVersion(version);
+        pushFreeSlot(index);
+    }
+
+    void eraseAt(index_t slotIndex)
+    {
+        Slot& slot = slots[slotIndex];
+        index_t denseIndex = slot.denseIndex;
+        index_t lastIndex = static_cast<index_t>(denseValues.size() - 1);
+        if (denseIndex != lastIndex)
         {
-            return false;
+            // swap-and-pop: the last value fills the hole
+            denseValues[denseIndex] = std::move(denseValues[lastIndex]);
+            index_t movedSlotIndex = denseToSlot[lastIndex];
+            denseToSlot[denseIndex] = movedSlotIndex;
+            slots[movedSlotIndex].denseIndex = denseIndex;
         }
-        return (m.version == version);
+        denseValues.pop_back();
+        denseToSlot.pop_back();
+        releaseSlot(slotIndex);
     }
 
-    bool contains(key k) const noexcept { return has_key(k); }
-
-    /*
-      Clears the slot map and releases any allocated memory.
-      Note: By calling this function, you must guarantee that no handles are in use!
-      Otherwise calling this function might be dangerous and lead to key "collisions".
-      You might consider using "clear()" instead.
-    */
-    void reset()
+  public:
+    dense_slot_map() = default;
+    explicit dense_slot_map(const allocator_type& _allocator)
+        : denseValues(_allocator)
+        , denseToSlot(RebindAllocator<index_t>(_allocator))
+        , slots(RebindAllocator<Slot>(_allocator))
     {
-        callDtors();
-
-        numItems = 0;
-        maxValidIndex = 0;
+    }
 
-        // Release used memory (using swap trick)
-        if (!pages.empty())
-        {
-            std::vector<Page, stl::Allocator<Page>> tmpPages;
-            pages.swap(tmpPages);
-        }
+    dense_slot_map(const dense_slot_map&) = default;
+    dense_slot_map& operator=(const dense_slot_map&) = default;
+
+    // the moved-from dense slot map is left empty
+    dense_slot_map(dense_slot_map&& other) noexcept
+        : denseValues(std::move(other.denseValues))
+        , denseToSlot(std::move(other.denseToSlot))
+        , slots(std::move(other.slots))
+        , freeHead(other.freeHead)
+        , freeTail(other.freeTail)
+        , numFreeSlots(other.numFreeSlots)
+        , numRetiredSlots(other.numRetiredSlots)
+    {
+        other.reset();
+    }
 
-        if (!freeIndices.empty())
+    dense_slot_map& operator=(dense_slot_map&& other)
+    {
+        if (this == &other)
         {
-            std::deque<key, stl::Allocator<key>> tmpFreeIndices;
-            freeIndices.swap(tmpFreeIndices);
+            return *this;
         }
+        denseValues = std::move(other.denseValues);
+        denseToSlot = std::move(other.denseToSlot);
+        slots = std::move(other.slots);
+        freeHead = other.freeHead;
+        freeTail = other.freeTail;
+        numFreeSlots = other.numFreeSlots;
+        numRetiredSlots = other.numRetiredSlots;
+        other.reset();
+        return *this;
     }
 
+    allocator_type get_allocator() const noexcept { return denseValues.get_allocator(); }
+
     /*
-      Clears the slot map but keeps the allocated memory for reuse.
-      Automatically increases version for all the removed elements (the same as calling "erase()" for all existing elements)
+      Constructs element in-place and returns a unique key that can be used to access this value.
+      Throws std::length_error if all the indices of the key type (key::kMaxIndex) are in use.
     */
-    void clear()
+    template <class... Args> key emplace(Args&&... args)
     {
-        for (size_t pageIndex = 0; pageIndex < pages.size(); pageIndex++)
+        if (numFreeSlots <= kMinFreeIndices && slots.size() > size_t(key::kMaxIndex))
         {
-            Page& page = pages[pageIndex];
-            if (page.meta == nullptr)
+            throw std::length_error("dense_slot_map: too many elements for the key type");
+        }
+        denseValues.emplace_back(std::forward<Args>(args)...);
+        index_t denseIndex = static_cast<index_t>(denseValues.size() - 1);
+
+        index_t slotIndex;
+        version_t version;
+        try
+        {
+            if (numFreeSlots > kMinFreeIndices)
             {
-                continue;
+                slotIndex = popFreeSlot();
+                version = slots[slotIndex].getVersion();
             }
-            for (size_type elementIndex = 0; elementIndex < page.numUsedElements; elementIndex++)
+            else
             {
-                index_t index = getIndexFromAddr(PageAddr{static_cast<size_type>(pageIndex), elementIndex});
-                // note: version doesn't matter here
-                EraseResult res = eraseImpl<false>(key::make(key::kMinVersion, index));
-                if (res == EraseResult::ErasedAndPageDeactivated)
-                {
-                    // noting left on this page - go to the next page
-                    break;
-                }
+                slotIndex = static_cast<index_t>(slots.size());
+                version = key::kMinVersion;
+                slots.push_back(Slot{kInvalidIndex, version});
             }
+            denseToSlot.push_back(slotIndex);
+        }
+        catch (...)
+        {
+            denseValues.pop_back();
+            throw;
         }
-        SLOT_MAP_ASSERT(numItems == 0);
-    }
 
-    /*
-      If key exists returns a const pointer to the value corresponding to the given key or returns null elsewere.
-    */
-    const T* get(key k) const noexcept { return getImpl(k); }
+        Slot& slot = slots[slotIndex];
+        slot.denseIndex = denseIndex;
+        slot.bits = static_cast<version_t>(version | Slot::kAliveFlag);
+        return key::make(version, slotIndex);
+    }
 
     /*
       If key exists returns a pointer to the value corresponding to the given key or returns null elsewere.
+      Note: the pointer is invalidated by the next emplace() or erase()
     */
+    const T* get(key k) const noexcept
+    {
+        const Slot* slot = getSlot(k);
+        return slot ? &denseValues[slot->denseIndex] : nullptr;
+    }
     T* get(key k) noexcept
     {
-        const T* constRes = getImpl(k);
-        return const_cast<T*>(constRes);
+        const Slot* slot = getSlot(k);
+        return slot ? &denseValues[slot->denseIndex] : nullptr;
     }
 
     /*
-      Constructs element in-place and returns a unique key that can be used to access this value.
+      Returns true if the dense slot map contains a specific key
     */
-    template <class... Args> key emplace(Args&&... args)
+    bool has_key(key k) const noexcept { return getSlot(k) != nullptr; }
+
+    /*
+      Removes element (if such key exists), the last element is moved into its place.
+    */
+    void erase(key k)
     {
-        // Use recycled IDs only if we accumulated enough of them
-        if (static_cast<size_type>(freeIndices.size()) > kMinFreeIndices)
+        if (getSlot(k))
         {
-            key k = freeIndices.front();
-            freeIndices.pop_front();
-
-            index_t index = key::toIndex(k);
-            SLOT_MAP_ASSERT(index <= getMaxValidIndex());
-
-            PageAddr addr = getAddrFromIndex(index);
-            Meta& m = getMetaByAddr(addr);
-            SLOT_MAP_ASSERT(m.inactive == 0);
-            SLOT_MAP_ASSERT(m.tombstone != 0);
-            SLOT_MAP_ASSERT(k.get_tag() == 0);
-
-            m.tombstone = 0;
-
-            ValueStorage& v = getValueByAddr(addr);
-            SLOT_MAP_ASSERT(isPointerAligned(&v, alignof(T)));
-            construct<T>(&v, std::forward<Args>(args)...);
-            numItems++;
-            return k;
+            eraseAt(key::toIndex(k));
         }
-
-        // allocate new item
-        index_t index = appendElement();
-        maxValidIndex = std::max(maxValidIndex, index);
-
-        PageAddr addr = getAddrFromIndex(index);
-        const Meta& m = getMetaByAddr(addr);
-        SLOT_MAP_ASSERT(m.tombstone == 0);
-
-        ValueStorage& v = getValueByAddr(addr);
-        SLOT_MAP_ASSERT(isPointerAligned(&v, alignof(T)));
-        construct<T>(&v, std::forward<Args>(args)...);
-        numItems++;
-        key k = key::make(m.version, index);
-        return k;
     }
 
     /*
-      Removes element (if such key exists) from the slot map.
-    */
-    void erase(key k) { eraseImpl<true>(k); }
-
-    /*
-      Removes element (if such key exists) from the slot map, returning the value at the key if the key was not previously removed.
+      Removes element (if such key exists), returning the value at the key if the key was not previously removed.
     */
     std::optional<T> pop(key k)
     {
@@ -1008,419 +4695,476 @@ template <typename T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4
         {
             return {};
         }
-
-        T res(std::move(*val));
-        eraseImpl<true>(k);
+        std::optional<T> res(std::move(*val));
+        eraseAt(key::toIndex(k));
         return res;
     }
 
     /*
-      Returns true if the slot map is empty.
-    */
-    bool empty() const noexcept { return (numItems == 0); }
-
-    /*
-      Returns the number of elements in the slot map.
+      Removes all the elements (the same as calling "erase()" for all of them), keeps the allocated memory for reuse.
     */
-    size_type size() const noexcept { return numItems; }
+    void clear()
+    {
+        for (index_t slotIndex : denseToSlot)
+        {
+            releaseSlot(slotIndex);
+        }
+        denseValues.clear();
+        denseToSlot.clear();
+    }
 
     /*
-      Exchanges the content of the slot map by the content of another slot map object of the same type.
+      Clears the dense slot map and releases any allocated memory.
+      Note: By calling this function, you must guarantee that no handles are in use! (see slot_map::reset)
     */
-    void swap(slot_map& other) noexcept
+    void reset() noexcept
     {
-        pages.swap(other.pages);
-        freeIndices.swap(other.freeIndices);
-        std::swap(numItems, other.numItems);
-        std::swap(maxValidIndex, other.maxValidIndex);
+        std::vector<T, TAllocator>(denseValues.get_allocator()).swap(denseValues);
+        std::vector<index_t, RebindAllocator<index_t>>(denseToSlot.get_allocator()).swap(denseToSlot);
+        std::vector<Slot, RebindAllocator<Slot>>(slots.get_allocator()).swap(slots);
+        freeHead = freeTail = kInvalidIndex;
+        numFreeSlots = 0;
+        numRetiredSlots = 0;
     }
 
-    // copy constructor
-    slot_map(const slot_map& other)
-        : numItems(0)
-        , maxValidIndex(0)
+    // Reserves memory for numElements values (and their slots)
+    void reserve(size_type numElements)
     {
-        copyFrom(other);
+        denseValues.reserve(numElements);
+        denseToSlot.reserve(numElements);
+        slots.reserve(numElements);
     }
 
-    // copy assignment
-    slot_map& operator=(const slot_map& other)
-    {
-        copyFrom(other);
-        return *this;
-    }
+    bool empty() const noexcept { return denseValues.empty(); }
+    size_type size() const noexcept { return static_cast<size_type>(denseValues.size()); }
 
-    // move constructor
-    slot_map(slot_map&& other) noexcept
-        : numItems(other.numItems)
-        , maxValidIndex(other.maxValidIndex)
+    /*
+      The packed values (in no particular order), values()[i] belongs to key_at(i)
+    */
+    std::span<T> values() noexcept { return std::span<T>(denseValues.data(), denseValues.size()); }
+    std::span<const T> values() const noexcept { return std::span<const T>(denseValues.data(), denseValues.size()); }
+
+    // Returns the key of the value at position denseIndex of the packed array
+    key key_at(size_type denseIndex) const noexcept
     {
-        std::swap(pages, other.pages);
-        std::swap(freeIndices, other.freeIndices);
-        other.numItems = 0;
-        other.maxValidIndex = 0;
+        SLOT_MAP_ASSERT(denseIndex < denseValues.size());
+        index_t slotIndex = denseToSlot[denseIndex];
+        return key::make(slots[slotIndex].getVersion(), slotIndex);
     }
 
-    // move asignment
-    slot_map& operator=(slot_map&& other) noexcept
-    {
-        // reset and swap
-        reset();
+    iterator begin() noexcept { return denseValues.data(); }
+    iterator end() noexcept { return denseValues.data() + denseValues.size(); }
+    const_iterator begin() const noexcept { return denseValues.data(); }
+    const_iterator end() const noexcept { return denseValues.data() + denseValues.size(); }
 
-        pages.swap(other.pages);
-        freeIndices.swap(other.freeIndices);
-        std::swap(numItems, other.numItems);
-        std::swap(maxValidIndex, other.maxValidIndex);
-        return *this;
-    }
+    // The number of slots whose versions are exhausted (they are never reused)
+    size_type num_retired_slots() const noexcept { return numRetiredSlots; }
 
-    struct Stats
+    void swap(dense_slot_map& other) noexcept
     {
-        size_type numPagesTotal = 0;
-        size_type numInactivePages = 0;
-        size_type numActivePages = 0;
+        denseValues.swap(other.denseValues);
+        denseToSlot.swap(other.denseToSlot);
+        slots.swap(other.slots);
+        std::swap(freeHead, other.freeHead);
+        std::swap(freeTail, other.freeTail);
+        std::swap(numFreeSlots, other.numFreeSlots);
+        std::swap(numRetiredSlots, other.numRetiredSlots);
+    }
 
-        size_type numItemsTotal = 0;
-        size_type numAliveItems = 0;
-        size_type numTombstoneItems = 0;
-        size_type numInactiveItems = 0;
-    };
+  private:
+    std::vector<T, TAllocator> denseValues;
+    // dense position -> slot index (to patch the slot of a moved value on erase)
+    std::vector<index_t, RebindAllocator<index_t>> denseToSlot;
+    std::vector<Slot, RebindAllocator<Slot>> slots;
+    index_t freeHead = kInvalidIndex;
+    index_t freeTail = kInvalidIndex;
+    size_type numFreeSlots = 0;
+    size_type numRetiredSlots = 0;
+};
 
-    /*
-      Returns the internal stats for debug purposes
+/*
+  Structure-of-arrays slot map: every element is a row of components (Ts...), each component type is stored in its own column.
 
-      Note: O(n) complexity!
-    */
-    Stats debug_stats() const noexcept
-    {
-        Stats stats;
-        stats.numPagesTotal = static_cast<size_type>(pages.size());
+  The key space, slot metadata and paging come from a slot_map (one Meta array per page), every page additionally owns
+  one memory block with a contiguous column of kPageSize values per component type. A pass that touches 2 of 12 components
+  only streams those 2 columns through the cache.
 
-        for (size_t pageIndex = 0; pageIndex < pages.size(); pageIndex++)
-        {
-            const Page& page = pages[pageIndex];
-            if (page.meta == nullptr)
-            {
-                stats.numInactivePages++;
-                continue;
-            }
-            stats.numActivePages++;
+  Usage example:
+  ```
+  soa_slot_map<Position, Velocity, Name> entities;
+  auto e = entities.emplace(Position{}, Velocity{1, 0}, Name{"player"});
+  entities.get<0>(e)->x += 1.0f;
 
-            stats.numItemsTotal += page.numUsedElements;
-            for (size_type elementIndex = 0; elementIndex < page.numUsedElements; elementIndex++)
-            {
-                PageAddr addr;
-                addr.page = static_cast<size_type>(pageIndex);
-                addr.index = static_cast<size_type>(elementIndex);
-                const Meta& m = getMetaByAddr(addr);
-                if (m.inactive != 0)
-                {
-                    stats.numInactiveItems++;
-                }
-                else if (m.tombstone != 0)
-                {
-                    stats.numTombstoneItems++;
-                }
-                else
-                {
-                    stats.numAliveItems++;
-                }
-            }
-        }
-        return stats;
-    }
+  // integrate positions (Name column is never loaded)
+  entities.for_each_chunk<0, 1>(
+      [](std::span<Position> positions, std::span<Velocity> velocities, std::span<const uint64_t> aliveMask, auto baseIndex) { ... });
+  ```
+*/
+template <typename TKeyType, size_t PAGESIZE, typename... Ts> class basic_soa_slot_map
+{
+    static_assert(sizeof...(Ts) > 0, "At least one component type is required");
 
-  public:
-    // iterators.....
+    // the key space (and slot metadata), slot values are empty
+    struct KeySlot
+    {
+    };
+    using KeyMap = slot_map<KeySlot, TKeyType, PAGESIZE>;
 
-    // for(const auto& kv : slot_map.items()) {} // key/value
-    // for(const auto& v : slot_map) {} // values only
+  public:
+    using key = TKeyType;
+    using index_t = typename TKeyType::index_t;
+    using size_type = uint32_t;
+    template <size_t COLUMN> using column_type = std::tuple_element_t<COLUMN, std::tuple<Ts...>>;
 
-    // values iterator implementation...................................
-    template <bool IsConst> class values_iterator_impl
-    {
-      private:
-        using slot_map_ptr = std::conditional_t<IsConst, const slot_map*, slot_map*>;
-        using value_ptr = std::conditional_t<IsConst, const T*, T*>;
-        using value_ref = std::conditional_t<IsConst, const T&, T&>;
-        using storage_ref = std::conditional_t<IsConst, const ValueStorage&, ValueStorage&>;
+    static inline constexpr size_type kPageSize = KeyMap::kPageSize;
+    static inline constexpr size_t kNumColumns = sizeof...(Ts);
 
-        value_ptr getCurrent() const noexcept
-        {
-            SLOT_MAP_ASSERT(currentIndex <= slotMap->getMaxValidIndex());
-            PageAddr addr = slotMap->getAddrFromIndex(currentIndex);
-            SLOT_MAP_ASSERT(slotMap->isActivePage(addr));
-            storage_ref v = slotMap->getValueByAddr(addr);
-            SLOT_MAP_ASSERT(slotMap->isPointerAligned(&v, alignof(T)));
-            return reinterpret_cast<value_ptr>(&v);
-        }
+  private:
+    static inline constexpr size_t kBlockAlignment = std::max({alignof(Ts)..., alignof(void*), size_t(16)});
 
-      public:
-        explicit values_iterator_impl(slot_map_ptr _slotMap, size_type index) noexcept
-            : slotMap(_slotMap)
-            , currentIndex(index)
+    // Byte offset of a column inside a page block, getColumnOffset(kNumColumns) is the block size
+    static constexpr size_t getColumnOffset(size_t column) noexcept
+    {
+        constexpr size_t kSizes[] = {sizeof(Ts)...};
+        constexpr size_t kAlignments[] = {alignof(Ts)...};
+        size_t offset = 0;
+        for (size_t i = 0; i < column; i++)
         {
+            offset = (offset + kAlignments[i] - 1) & ~(kAlignments[i] - 1);
+            offset += kSizes[i] * kPageSize;
         }
+        size_t alignment = (column < kNumColumns) ? kAlignments[column] : kBlockAlignment;
+        return (offset + alignment - 1) & ~(alignment - 1);
+    }
 
-        // Allow non-const to const conversion
-        template <bool OtherIsConst, typename = std::enable_if_t<IsConst && !OtherIsConst>>
-        values_iterator_impl(const values_iterator_impl<OtherIsConst>& other) noexcept
-            : slotMap(other.slotMap)
-            , currentIndex(other.currentIndex)
-        {
-        }
+    struct alignas(kBlockAlignment) BlockUnit
+    {
+        std::byte data[kBlockAlignment];
+    };
+    using BlockAllocator = stl::Allocator<BlockUnit>;
+    static constexpr size_t getNumBlockUnits() noexcept { return getColumnOffset(kNumColumns) / sizeof(BlockUnit); }
 
-        value_ref operator*() const noexcept { return *getCurrent(); }
-        value_ptr operator->() const noexcept { return getCurrent(); }
+    template <size_t COLUMN> static column_type<COLUMN>* getColumn(void* block) noexcept
+    {
+        return reinterpret_cast<column_type<COLUMN>*>(reinterpret_cast<char*>(block) + getColumnOffset(COLUMN));
+    }
+    template <size_t COLUMN> static const column_type<COLUMN>* getColumn(const void* block) noexcept
+    {
+        return reinterpret_cast<const column_type<COLUMN>*>(reinterpret_cast<const char*>(block) + getColumnOffset(COLUMN));
+    }
 
-        bool operator==(const values_iterator_impl& other) const noexcept
+    void* allocateBlock(size_type pageIndex)
+    {
+        if (pageIndex >= blocks.size())
         {
-            return slotMap == other.slotMap && currentIndex == other.currentIndex;
+            blocks.resize(size_t(pageIndex) + 1, nullptr);
         }
-        bool operator!=(const values_iterator_impl& other) const noexcept
+        if (!blocks[pageIndex])
         {
-            return slotMap != other.slotMap || currentIndex != other.currentIndex;
+            BlockAllocator allocator;
+            blocks[pageIndex] = std::allocator_traits<BlockAllocator>::allocate(allocator, getNumBlockUnits());
         }
+        return blocks[pageIndex];
+    }
 
-        values_iterator_impl& operator++() noexcept
+    void freeBlocks() noexcept
+    {
+        BlockAllocator allocator;
+        for (void* block : blocks)
         {
-            do
+            if (block)
             {
-                currentIndex++;
-            } while (currentIndex <= slotMap->getMaxValidIndex() && slotMap->isTombstone(currentIndex));
-            return *this;
+                std::allocator_traits<BlockAllocator>::deallocate(allocator, static_cast<BlockUnit*>(block), getNumBlockUnits());
+            }
         }
+        blocks.clear();
+    }
 
-        values_iterator_impl operator++(int) noexcept
+    // Constructs a row column by column, already constructed components are destroyed if a constructor throws
+    template <size_t... COLUMNS, typename... Args>
+    static void constructRow(void* block, size_type elementIndex, std::index_sequence<COLUMNS...>, Args&&... components)
+    {
+        size_t numConstructed = 0;
+        try
         {
-            values_iterator_impl res = *this;
-            ++*this;
-            return res;
+            ((new (getColumn<COLUMNS>(block) + elementIndex) column_type<COLUMNS>(std::forward<Args>(components)), numConstructed++), ...);
         }
+        catch (...)
+        {
+            ((COLUMNS < numConstructed ? std::destroy_at(getColumn<COLUMNS>(block) + elementIndex) : void()), ...);
+            throw;
+        }
+    }
 
-      private:
-        slot_map_ptr slotMap;
-        size_type currentIndex;
-
-        template <bool> friend class values_iterator_impl;
-    };
+    template <size_t... COLUMNS>
+    static void copyRow(void* block, const void* otherBlock, size_type elementIndex, std::index_sequence<COLUMNS...>)
+    {
+        constructRow(block, elementIndex, std::index_sequence<COLUMNS...>{}, getColumn<COLUMNS>(otherBlock)[elementIndex]...);
+    }
 
-    // Type aliases for clean API
-    using const_values_iterator = values_iterator_impl<true>;
-    using values_iterator = values_iterator_impl<false>;
+    template <size_t... COLUMNS> static void destroyRow(void* block, size_type elementIndex, std::index_sequence<COLUMNS...>) noexcept
+    {
+        (std::destroy_at(getColumn<COLUMNS>(block) + elementIndex), ...);
+    }
 
-    const_values_iterator begin() const noexcept
+    // Calls fn(index) for every alive element
+    template <typename FUNC> void forEachAlive(FUNC&& fn) const
     {
-        if (pages.empty())
-            return end();
+        keys.for_each_chunk(
+            [&](std::span<const KeySlot>, std::span<const uint64_t> aliveMask, index_t baseIndex)
+            {
+                for (size_t wordIndex = 0; wordIndex < aliveMask.size(); wordIndex++)
+                {
+                    uint64_t word = aliveMask[wordIndex];
+                    while (word != 0)
+                    {
+                        fn(static_cast<index_t>(baseIndex + wordIndex * 64 + size_t(std::countr_zero(word))));
+                        word &= word - 1;
+                    }
+                }
+            });
+    }
 
-        size_type index = 0;
-        while (index <= getMaxValidIndex() && isTombstone(index))
+    void destroyAll() noexcept
+    {
+        if constexpr (!(std::is_trivially_destructible_v<Ts> && ...))
         {
-            index++;
+            forEachAlive([this](index_t index)
+                         { destroyRow(blocks[index / kPageSize], index % kPageSize, std::index_sequence_for<Ts...>{}); });
         }
-        return const_values_iterator(this, index);
     }
-    const_values_iterator end() const noexcept { return const_values_iterator(this, getMaxValidIndex() + static_cast<size_type>(1)); }
 
-    values_iterator begin() noexcept
+    void copyFrom(const basic_soa_slot_map& other)
     {
-        if (pages.empty())
-            return end();
-
-        size_type index = 0;
-        while (index <= getMaxValidIndex() && isTombstone(index))
+        SLOT_MAP_ASSERT(keys.empty() && blocks.empty());
+        size_t numCopied = 0;
+        try
+        {
+            other.forEachAlive(
+                [&](index_t index)
+                {
+                    size_type pageIndex = index / kPageSize;
+                    void* block = allocateBlock(pageIndex);
+                    copyRow(block, other.blocks[pageIndex], index % kPageSize, std::index_sequence_for<Ts...>{});
+                    numCopied++;
+                });
+            keys = other.keys;
+        }
+        catch (...)
         {
-            index++;
+            // roll back the rows copied so far (in the same order)
+            other.forEachAlive(
+                [&](index_t index)
+                {
+                    if (numCopied > 0)
+                    {
+                        destroyRow(blocks[index / kPageSize], index % kPageSize, std::index_sequence_for<Ts...>{});
+                        numCopied--;
+                    }
+                });
+            freeBlocks();
+            keys.reset();
+            throw;
         }
-        return values_iterator(this, index);
     }
-    values_iterator end() noexcept { return values_iterator(this, getMaxValidIndex() + static_cast<size_type>(1)); }
 
-    // key-value iterator implementation...................................
-    template <bool IsConst> class kv_iterator_impl
+    template <typename SELF, typename FUNC, size_t... COLUMNS>
+    static void forEachChunkImpl(SELF* self, FUNC& fn, std::index_sequence<COLUMNS...>)
     {
-      public:
-        // pretty much similar to std::reference_wrapper
-        template <typename TYPE> struct reference
-        {
-            TYPE* ptr = nullptr;
-
-            explicit reference(TYPE* _ptr)
-                : ptr(_ptr)
-            {
-            }
-
-            reference(const reference& /*other*/) noexcept = default;
-            reference(reference&& /*other*/) noexcept = default;
-            reference& operator=(const reference& /*other*/) noexcept = default;
-            reference& operator=(reference&& /*other*/) noexcept = default;
-
-            void set(TYPE* _ptr) noexcept { ptr = _ptr; }
-
-            TYPE& get() const noexcept
+        constexpr bool kIsConst = std::is_const_v<SELF>;
+        self->keys.for_each_chunk(
+            [&](std::span<const KeySlot> slots, std::span<const uint64_t> aliveMask, index_t baseIndex)
             {
-                SLOT_MAP_ASSERT(ptr);
-                return *ptr;
-            }
-
-            operator TYPE&() const noexcept { return get(); }
-        };
+                size_type pageIndex = baseIndex / kPageSize;
+                void* block = (pageIndex < self->blocks.size()) ? self->blocks[pageIndex] : nullptr;
+                if (!block)
+                {
+                    // a page without any constructed elements
+                    return;
+                }
+                fn(std::span<std::conditional_t<kIsConst, const column_type<COLUMNS>, column_type<COLUMNS>>>(
+                       getColumn<COLUMNS>(block), slots.size())...,
+                   aliveMask, baseIndex);
+            });
+    }
 
-        using slot_map_ptr = std::conditional_t<IsConst, const slot_map*, slot_map*>;
-        using value_ptr = std::conditional_t<IsConst, const T*, T*>;
-        using storage_ref = std::conditional_t<IsConst, const ValueStorage&, ValueStorage&>;
-        using KeyValue = std::conditional_t<IsConst, std::pair<key, const reference<const T>>, std::pair<key, reference<T>>>;
+  public:
+    basic_soa_slot_map() = default;
+    ~basic_soa_slot_map()
+    {
+        destroyAll();
+        freeBlocks();
+    }
 
-      private:
-        void updateTmpKV() const noexcept
+    basic_soa_slot_map(const basic_soa_slot_map& other) { copyFrom(other); }
+    basic_soa_slot_map& operator=(const basic_soa_slot_map& other)
+    {
+        if (this != &other)
         {
-            SLOT_MAP_ASSERT(currentIndex <= slotMap->getMaxValidIndex());
-            PageAddr addr = slotMap->getAddrFromIndex(currentIndex);
-            SLOT_MAP_ASSERT(slotMap->isActivePage(addr));
-            const Meta& m = slotMap->getMetaByAddr(addr);
-            storage_ref v = slotMap->getValueByAddr(addr);
-            SLOT_MAP_ASSERT(slotMap->isPointerAligned(&v, alignof(T)));
-            value_ptr value = reinterpret_cast<value_ptr>(&v);
-            tmpKv.first = key::make(m.version, index_t(currentIndex));
-
-            if constexpr (IsConst)
-            {
-                const_cast<reference<const T>&>(tmpKv.second).set(value);
-            }
-            else
-            {
-                tmpKv.second.set(value);
-            }
+            basic_soa_slot_map tmp(other);
+            swap(tmp);
         }
+        return *this;
+    }
 
-      public:
-        explicit kv_iterator_impl(slot_map_ptr _slotMap, size_type index) noexcept
-            : slotMap(_slotMap)
-            , currentIndex(index)
-            , tmpKv(key::invalid(), std::conditional_t<IsConst, reference<const T>, reference<T>>(nullptr))
+    basic_soa_slot_map(basic_soa_slot_map&& other) noexcept
+        : keys(std::move(other.keys))
+    {
+        blocks.swap(other.blocks);
+    }
+    basic_soa_slot_map& operator=(basic_soa_slot_map&& other) noexcept
+    {
+        if (this != &other)
         {
+            reset();
+            swap(other);
         }
+        return *this;
+    }
 
-        // Allow non-const to const conversion
-        template <bool OtherIsConst, typename = std::enable_if_t<IsConst && !OtherIsConst>>
-        kv_iterator_impl(const kv_iterator_impl<OtherIsConst>& other) noexcept
-            : slotMap(other.slotMap)
-            , currentIndex(other.currentIndex)
-            , tmpKv(key::invalid(), reference<const T>(nullptr))
+    /*
+      Constructs a row in-place (one argument per column) and returns a unique key that can be used to access its components.
+    */
+    template <typename... Args> key emplace(Args&&... components)
+    {
+        static_assert(sizeof...(Args) == kNumColumns, "emplace() takes exactly one argument per column");
+        key k = keys.emplace();
+        index_t index = key::toIndex(k);
+        try
         {
+            void* block = allocateBlock(index / kPageSize);
+            constructRow(block, index % kPageSize, std::index_sequence_for<Ts...>{}, std::forward<Args>(components)...);
         }
-
-        const KeyValue& operator*() const noexcept
+        catch (...)
         {
-            updateTmpKV();
-            return tmpKv;
+            keys.erase(k);
+            throw;
         }
+        return k;
+    }
 
-        const KeyValue* operator->() const noexcept
+    /*
+      If key exists returns a pointer to its component of the given column or returns null elsewere.
+    */
+    template <size_t COLUMN> const column_type<COLUMN>* get(key k) const noexcept
+    {
+        if (!keys.has_key(k))
         {
-            updateTmpKV();
-            return &tmpKv;
+            return nullptr;
         }
+        index_t index = key::toIndex(k);
+        return getColumn<COLUMN>(blocks[index / kPageSize]) + (index % kPageSize);
+    }
+    template <size_t COLUMN> column_type<COLUMN>* get(key k) noexcept
+    {
+        const column_type<COLUMN>* value = std::as_const(*this).template get<COLUMN>(k);
+        return const_cast<column_type<COLUMN>*>(value);
+    }
 
-        bool operator==(const kv_iterator_impl& other) const noexcept
-        {
-            return slotMap == other.slotMap && currentIndex == other.currentIndex;
-        }
-        bool operator!=(const kv_iterator_impl& other) const noexcept
-        {
-            return slotMap != other.slotMap || currentIndex != other.currentIndex;
-        }
+    /*
+      Returns true if the slot map contains a specific key
+    */
+    bool has_key(key k) const noexcept { return keys.has_key(k); }
 
-        kv_iterator_impl& operator++() noexcept
+    /*
+      Removes the row (if such key exists)
+    */
+    void erase(key k)
+    {
+        if (!keys.has_key(k))
         {
-            do
-            {
-                currentIndex++;
-            } while (currentIndex <= slotMap->getMaxValidIndex() && slotMap->isTombstone(currentIndex));
-            return *this;
+            return;
         }
+        index_t index = key::toIndex(k);
+        destroyRow(blocks[index / kPageSize], index % kPageSize, std::index_sequence_for<Ts...>{});
+        keys.erase(k);
+    }
 
-        kv_iterator_impl operator++(int) noexcept
-        {
-            kv_iterator_impl res = *this;
-            ++*this;
-            return res;
-        }
+    /*
+      Removes all the rows (the same as calling "erase()" for all of them), keeps the allocated memory for reuse.
+    */
+    void clear()
+    {
+        destroyAll();
+        keys.clear();
+    }
 
-      private:
-        slot_map_ptr slotMap;
-        size_type currentIndex;
-        // unfortunately we need this to make it look like standard STL iterator (operator* and operator->)
-        mutable KeyValue tmpKv;
+    /*
+      Clears the slot map and releases any allocated memory.
+      Note: By calling this function, you must guarantee that no handles are in use! (see slot_map::reset)
+    */
+    void reset()
+    {
+        destroyAll();
+        freeBlocks();
+        keys.reset();
+    }
 
-        template <bool> friend class kv_iterator_impl;
-    };
+    bool empty() const noexcept { return keys.empty(); }
+    size_type size() const noexcept { return keys.size(); }
 
-    // Type aliases for clean API
-    using const_kv_iterator = kv_iterator_impl<true>;
-    using kv_iterator = kv_iterator_impl<false>;
+    /*
+      Calls fn(columns..., aliveMask, baseIndex) once for every active page:
+        columns   - one std::span<column_type<I>> per selected column (all the columns if none are selected),
+                    columns[i] is the component of the element with global index (baseIndex + i)
+        aliveMask - std::span<const uint64_t>, bit (i % 64) of aliveMask[i / 64] is set if row i holds a live element
 
-    // proxy items object
-    template <bool IsConst> class items_impl
+      The same rules as for slot_map::for_each_chunk apply: components of dead rows are not objects, never touch them.
+    */
+    template <size_t... COLUMNS, typename FUNC> void for_each_chunk(FUNC&& fn) const
     {
-        using slot_map_ptr = std::conditional_t<IsConst, const slot_map*, slot_map*>;
-        using iterator_type = std::conditional_t<IsConst, const_kv_iterator, kv_iterator>;
-
-        slot_map_ptr slotMap;
-
-      public:
-        explicit items_impl(slot_map_ptr _slotMap) noexcept
-            : slotMap(_slotMap)
+        if constexpr (sizeof...(COLUMNS) == 0)
         {
+            forEachChunkImpl(this, fn, std::index_sequence_for<Ts...>{});
         }
-
-        iterator_type begin() const noexcept
+        else
         {
-            if (slotMap->pages.empty())
-                return end();
-            size_type index = 0;
-            while (index <= slotMap->getMaxValidIndex() && slotMap->isTombstone(index))
-            {
-                index++;
-            }
-            return iterator_type(slotMap, index);
+            forEachChunkImpl(this, fn, std::index_sequence<COLUMNS...>{});
         }
-        iterator_type end() const noexcept { return iterator_type(slotMap, slotMap->getMaxValidIndex() + static_cast<size_type>(1)); }
-    };
-
-    using Items = items_impl<true>;
-    using MutableItems = items_impl<false>;
+    }
+    template <size_t... COLUMNS, typename FUNC> void for_each_chunk(FUNC&& fn)
+    {
+        if constexpr (sizeof...(COLUMNS) == 0)
+        {
+            forEachChunkImpl(this, fn, std::index_sequence_for<Ts...>{});
+        }
+        else
+        {
+            forEachChunkImpl(this, fn, std::index_sequence<COLUMNS...>{});
+        }
+    }
 
-    Items items() const noexcept { return Items(this); }
-    MutableItems items() noexcept { return MutableItems(this); }
+    void swap(basic_soa_slot_map& other) noexcept
+    {
+        keys.swap(other.keys);
+        blocks.swap(other.blocks);
+    }
 
   private:
-    std::vector<Page, stl::Allocator<Page>> pages;
-    std::deque<key, stl::Allocator<key>> freeIndices;
-    size_type numItems;
-    index_t maxValidIndex;
+    KeyMap keys;
+    // one block of columns per page of the key map (null for pages that never had an element)
+    std::vector<void*> blocks;
 };
 
-template <class T, size_t PAGESIZE = 4096, size_t MINFREEINDICES = 64>
-using slot_map32 = slot_map<T, dod::slot_map_key32<T>, PAGESIZE, MINFREEINDICES>;
+template <typename... Ts> using soa_slot_map = basic_soa_slot_map<slot_map_key64<std::tuple<Ts...>>, 4096, Ts...>;
 
-template <class T, size_t PAGESIZE = 4096, size_t MINFREEINDICES = 64>
-using slot_map64 = slot_map<T, dod::slot_map_key64<T>, PAGESIZE, MINFREEINDICES>;
+namespace pmr
+{
+// slot map that uses a std::pmr::memory_resource (i.e. a monotonic arena or a per-thread pool)
+template <class T, typename TKeyType = slot_map_key64<T>, size_t PAGESIZE = 4096, size_t MINFREEINDICES = 64,
+          slot_layout LAYOUT = slot_layout::split, slot_sharing SHARING = slot_sharing::exclusive>
+using slot_map = dod::slot_map<T, TKeyType, PAGESIZE, MINFREEINDICES, std::pmr::polymorphic_allocator<T>, LAYOUT, SHARING>;
+} // namespace pmr
 
 } // namespace dod
 
 // std::hash support
 namespace std
 {
-template <typename T> struct hash<typename dod::slot_map_key64<T>>
-{
-    size_t operator()(const typename dod::slot_map_key64<T>& key) const noexcept { return key.hash(); }
-};
-
-template <typename T> struct hash<typename dod::slot_map_key32<T>>
+template <typename T, size_t INDEXBITS, size_t VERSIONBITS, size_t TAGBITS>
+struct hash<dod::slot_map_key<T, INDEXBITS, VERSIONBITS, TAGBITS>>
 {
-    size_t operator()(const typename dod::slot_map_key32<T>& key) const noexcept { return key.hash(); }
+    size_t operator()(const dod::slot_map_key<T, INDEXBITS, VERSIONBITS, TAGBITS>& key) const noexcept { return key.hash(); }
 };
 
 } // namespace std
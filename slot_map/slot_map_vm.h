@@ -0,0 +1,382 @@
+#pragma once
+
+// Platform part of slot_map.h: the virtual memory and file API behind dod::vm.
+// Opt-in, so <windows.h> / <sys/mman.h> and their macros only reach the files that use huge_page_resource, use_reserved_range(),
+// save() or load(). Include it instead of (or after) slot_map.h there.
+#include "slot_map.h"
+
+#if defined(_WIN32)
+#if !defined(NOMINMAX)
+#define NOMINMAX
+#endif
+#if !defined(WIN32_LEAN_AND_MEAN)
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dod
+{
+namespace vm
+{
+inline void* map_huge(size_t numBytes, bool& usesHugeTlb) noexcept
+{
+    SLOT_MAP_ASSERT((numBytes % kHugePageSize) == 0);
+    usesHugeTlb = false;
+#if defined(_WIN32)
+    SIZE_T largePageSize = GetLargePageMinimum();
+    if (largePageSize != 0 && (numBytes % largePageSize) == 0)
+    {
+        // requires SeLockMemoryPrivilege
+        void* p = VirtualAlloc(nullptr, numBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (p)
+        {
+            usesHugeTlb = true;
+            return p;
+        }
+    }
+    return VirtualAlloc(nullptr, numBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+#if defined(MAP_HUGETLB)
+    void* huge = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (huge != MAP_FAILED)
+    {
+        usesHugeTlb = true;
+        return huge;
+    }
+#endif
+    // over-map and trim to get huge page alignment
+    size_t numBytesMapped = numBytes + kHugePageSize;
+    void* mapped = mmap(nullptr, numBytesMapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED)
+    {
+        return nullptr;
+    }
+    uintptr_t begin = reinterpret_cast<uintptr_t>(mapped);
+    uintptr_t alignedBegin = (begin + (kHugePageSize - 1)) & ~uintptr_t(kHugePageSize - 1);
+    size_t headSize = alignedBegin - begin;
+    size_t tailSize = numBytesMapped - headSize - numBytes;
+    if (headSize != 0)
+    {
+        munmap(mapped, headSize);
+    }
+    if (tailSize != 0)
+    {
+        munmap(reinterpret_cast<void*>(alignedBegin + numBytes), tailSize);
+    }
+    void* p = reinterpret_cast<void*>(alignedBegin);
+#if defined(MADV_HUGEPAGE)
+    madvise(p, numBytes, MADV_HUGEPAGE);
+#endif
+    return p;
+#endif
+}
+
+inline size_t page_size() noexcept
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return static_cast<size_t>(info.dwPageSize);
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+inline void* reserve(size_t numBytes) noexcept
+{
+#if defined(_WIN32)
+    return VirtualAlloc(nullptr, numBytes, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void* p = mmap(nullptr, numBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return (p == MAP_FAILED) ? nullptr : p;
+#endif
+}
+
+inline bool commit(void* p, size_t numBytes) noexcept
+{
+#if defined(_WIN32)
+    return VirtualAlloc(p, numBytes, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+    return mprotect(p, numBytes, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+inline void discard(void* p, size_t numBytes) noexcept
+{
+#if defined(_WIN32)
+    VirtualAlloc(p, numBytes, MEM_RESET, PAGE_READWRITE);
+#else
+    madvise(p, numBytes, MADV_DONTNEED);
+#endif
+}
+
+inline void unmap(void* p, size_t numBytes) noexcept
+{
+#if defined(_WIN32)
+    (void)numBytes;
+    VirtualFree(p, 0, MEM_RELEASE);
+#else
+    munmap(p, numBytes);
+#endif
+}
+
+inline void* map_file(const char* path, size_t& numBytes) noexcept
+{
+    numBytes = 0;
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    void* p = nullptr;
+    if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (mapping)
+        {
+            p = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+            // the view keeps the mapping alive
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    if (p)
+    {
+        numBytes = static_cast<size_t>(fileSize.QuadPart);
+    }
+    return p;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    struct stat info;
+    void* p = nullptr;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        p = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        p = (p == MAP_FAILED) ? nullptr : p;
+    }
+    // the mapping keeps the file alive
+    close(fd);
+    if (p)
+    {
+        numBytes = static_cast<size_t>(info.st_size);
+    }
+    return p;
+#endif
+}
+
+inline void unmap_file(void* p, size_t numBytes) noexcept
+{
+#if defined(_WIN32)
+    (void)numBytes;
+    UnmapViewOfFile(p);
+#else
+    munmap(p, numBytes);
+#endif
+}
+
+inline bool sync_file(std::FILE* file) noexcept
+{
+#if defined(_WIN32)
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(file)))) != 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+inline bool replace_file(const char* from, const char* to) noexcept
+{
+#if defined(_WIN32)
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    // the replaced inode lives on as long as it is mapped
+    return std::rename(from, to) == 0;
+#endif
+}
+} // namespace vm
+
+/*
+  Memory resource that carves allocations out of large regions backed by huge pages.
+
+  Every slot map page is a separate block of kPageSize * (sizeof(T) + sizeof(Meta)) bytes. With the default allocator, a big map is
+  scattered over thousands of 4K pages, and TLB misses dominate random get() calls. This resource packs the page blocks into
+  regions mapped with explicit huge pages (MAP_HUGETLB), falling back to normal pages with a transparent huge pages hint
+  (madvise(MADV_HUGEPAGE)) when no huge pages are reserved.
+
+  Freed blocks are reused for allocations of the same size. Regions are only unmapped by release() or when the resource is destroyed.
+  Note: not thread-safe (the same as std::pmr::unsynchronized_pool_resource)
+
+  Usage:
+  ```
+  dod::huge_page_resource resource;
+  dod::pmr::slot_map<Particle> particles(&resource);
+  ```
+*/
+class huge_page_resource : public std::pmr::memory_resource
+{
+  public:
+    explicit huge_page_resource(size_t _regionSize = 64 * 1024 * 1024)
+        : regionSize(std::max(roundUp(_regionSize, vm::kHugePageSize), vm::kHugePageSize))
+    {
+    }
+
+    huge_page_resource(const huge_page_resource&) = delete;
+    huge_page_resource& operator=(const huge_page_resource&) = delete;
+
+    ~huge_page_resource() override { release(); }
+
+    /*
+      Unmaps all the regions (all memory allocated from this resource becomes invalid).
+    */
+    void release() noexcept
+    {
+        for (const Region& region : regions)
+        {
+            vm::unmap(region.memory, region.numBytes);
+        }
+        regions.clear();
+        freeLists.clear();
+        cursor = nullptr;
+        end = nullptr;
+    }
+
+    struct Stats
+    {
+        size_t numRegions = 0;
+        // regions backed by explicit huge pages (the rest rely on transparent huge pages)
+        size_t numHugeTlbRegions = 0;
+        size_t numBytesMapped = 0;
+    };
+
+    Stats stats() const noexcept
+    {
+        Stats res;
+        res.numRegions = regions.size();
+        for (const Region& region : regions)
+        {
+            res.numHugeTlbRegions += region.usesHugeTlb ? 1 : 0;
+            res.numBytesMapped += region.numBytes;
+        }
+        return res;
+    }
+
+  private:
+    struct Region
+    {
+        void* memory;
+        size_t numBytes;
+        bool usesHugeTlb;
+        // the region holds a single large allocation
+        bool isDedicated;
+    };
+
+    // singly linked list of freed blocks of the same size and alignment
+    struct FreeList
+    {
+        size_t numBytes;
+        size_t alignment;
+        void* head;
+    };
+
+    static size_t roundUp(size_t value, size_t alignment) noexcept { return (value + (alignment - 1)) & ~(alignment - 1); }
+
+    Region& mapRegion(size_t numBytes, bool isDedicated)
+    {
+        numBytes = roundUp(numBytes, vm::kHugePageSize);
+        // make room first, so a failing emplace_back can't leak the mapping
+        regions.reserve(regions.size() + 1);
+        bool usesHugeTlb = false;
+        void* memory = vm::map_huge(numBytes, usesHugeTlb);
+        if (!memory)
+        {
+            throw std::bad_alloc();
+        }
+        return regions.emplace_back(Region{memory, numBytes, usesHugeTlb, isDedicated});
+    }
+
+    FreeList& getFreeList(size_t numBytes, size_t alignment)
+    {
+        for (FreeList& freeList : freeLists)
+        {
+            if (freeList.numBytes == numBytes && freeList.alignment == alignment)
+            {
+                return freeList;
+            }
+        }
+        return freeLists.emplace_back(FreeList{numBytes, alignment, nullptr});
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        alignment = std::max(alignment, alignof(void*));
+        size_t numBytes = roundUp(std::max(bytes, sizeof(void*)), alignment);
+        if (numBytes > regionSize / 4)
+        {
+            return mapRegion(numBytes, true).memory;
+        }
+
+        FreeList& freeList = getFreeList(numBytes, alignment);
+        if (freeList.head)
+        {
+            void* p = freeList.head;
+            std::memcpy(&freeList.head, p, sizeof(void*));
+            return p;
+        }
+
+        char* p = cursor ? reinterpret_cast<char*>(roundUp(reinterpret_cast<uintptr_t>(cursor), alignment)) : nullptr;
+        if (!p || p + numBytes > end)
+        {
+            // note: the tail of the previous region is abandoned
+            Region& region = mapRegion(regionSize, false);
+            p = static_cast<char*>(region.memory);
+            end = p + region.numBytes;
+        }
+        cursor = p + numBytes;
+        return p;
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        alignment = std::max(alignment, alignof(void*));
+        size_t numBytes = roundUp(std::max(bytes, sizeof(void*)), alignment);
+        if (numBytes > regionSize / 4)
+        {
+            for (size_t i = 0; i < regions.size(); i++)
+            {
+                if (regions[i].isDedicated && regions[i].memory == p)
+                {
+                    vm::unmap(regions[i].memory, regions[i].numBytes);
+                    regions.erase(regions.begin() + static_cast<ptrdiff_t>(i));
+                    return;
+                }
+            }
+            SLOT_MAP_ASSERT(false && "Unknown allocation");
+            return;
+        }
+
+        FreeList& freeList = getFreeList(numBytes, alignment);
+        std::memcpy(p, &freeList.head, sizeof(void*));
+        freeList.head = p;
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+    std::vector<Region> regions;
+    std::vector<FreeList> freeLists;
+    char* cursor = nullptr;
+    char* end = nullptr;
+    size_t regionSize;
+};
+} // namespace dod